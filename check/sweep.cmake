@@ -0,0 +1,12 @@
+# Runs the sweep on RUNS and compares its CSV output with EXPECTED.
+# Usage: cmake -DSWEEP=<sweep-dishwash> -DRUNS=<runs file> -DEXPECTED=<csv> -P sweep.cmake
+execute_process(COMMAND ${SWEEP} ${RUNS}
+                OUTPUT_VARIABLE output
+                ERROR_QUIET
+                RESULT_VARIABLE result)
+file(READ ${EXPECTED} expected)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "${SWEEP} ${RUNS} failed with ${result}")
+elseif(NOT output STREQUAL expected)
+  message(FATAL_ERROR "The sweep results differ from ${EXPECTED}:\n${output}")
+endif()
@@ -0,0 +1,160 @@
+#include "accounting.h"
+#include "dishwash.h"
+#include <algorithm>
+
+using namespace std;
+
+constexpr Accounting::Meter Accounting::cMeters[];
+
+uint32_t Accounting::Run::getOnTime(Meter const aMeter) const noexcept {
+  uint32_t result = 0u;
+  for(auto const &state : onTimes) {
+    result += state[static_cast<int32_t>(aMeter)];
+  }
+  return result;
+}
+
+double Accounting::Run::getEnergy() const noexcept {
+  return getOnTime(Meter::Heat) / cMsInHour * Config::cHeaterPower / cWInKw;
+}
+
+double Accounting::Run::getWater() const noexcept {
+  return getOnTime(Meter::Fill) / static_cast<double>(cMsInSecond) * Config::cFillFlowRate / cMlInL;
+}
+
+double Accounting::Run::getPumpHours() const noexcept {
+  return (getOnTime(Meter::Circ) + getOnTime(Meter::Drain)) / cMsInHour;
+}
+
+Accounting::Accounting() noexcept : Component() {
+  mOnSince.fill(cNotOn);
+}
+
+bool Accounting::shouldBeQueued(EventType const aType) const noexcept {
+  switch(aType) {
+  case EventType::Actuate:
+  case EventType::MachineState:
+  case EventType::Program:
+  case EventType::MeasuredTemperature:
+  case EventType::Error:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void Accounting::accumulate() noexcept {
+  int64_t now = mTimerManager.getPlanTime();
+  for(int32_t meter = 0; meter < cMeterCount; ++meter) {
+    if(mOnSince[meter] != cNotOn) {
+      mCurrent.onTimes[static_cast<int32_t>(mState)][meter] += static_cast<uint32_t>((now - mOnSince[meter]) / cUsInMs);
+      mOnSince[meter] = now;
+    }
+    else { // nothing to do
+    }
+  }
+}
+
+void Accounting::startRun() noexcept {
+  mCurrent = Run{};
+  mCurrent.start = mTimerManager.getPlanTime();
+  mCurrent.program = mProgram;
+  mRunning = true;
+  mStopped = false;
+}
+
+void Accounting::finishRun(bool const aCompleted) noexcept {
+  accumulate();
+  mCurrent.length = static_cast<uint32_t>((mTimerManager.getPlanTime() - mCurrent.start) / cUsInMs);
+  mCurrent.completed = aCompleted;
+  mRuns[mRunCount % cRunCount] = mCurrent;
+  ++mRunCount;
+  mRunning = false;
+  logRun(mCurrent);
+}
+
+void Accounting::logRun(Run const &aRun) const noexcept {
+  Log::i(nowtech::LogApp::cSystem) << Event::cStrProgram[static_cast<int32_t>(aRun.program) + 1]
+                                   << (aRun.completed ? " completed in " : " aborted after ") << static_cast<int32_t>(aRun.length / cMsInMinute)
+                                   << " min, heater " << static_cast<int32_t>(aRun.getEnergy() * cWInKw) << " Wh, water "
+                                   << static_cast<int32_t>(aRun.getWater() * cMlInL) << " ml, pumps " << static_cast<int32_t>(aRun.getPumpHours() * cMinutesInHour)
+                                   << " min, heating rise " << aRun.heatingRise << " C, errors " << aRun.errors << Log::end;
+  for(int32_t state = 0; state < cStateCount; ++state) {
+    auto const &onTimes = aRun.onTimes[state];
+    if(std::any_of(onTimes.begin(), onTimes.end(), [](uint32_t const aOnTime){ return aOnTime > 0u; })) {
+      Log::i(nowtech::LogApp::cSystem) << "  " << Event::cStrMachineState[state + 1]
+                                       << " heat " << onTimes[static_cast<int32_t>(Meter::Heat)] / cMsInSecond
+                                       << " s, fill " << onTimes[static_cast<int32_t>(Meter::Fill)] / cMsInSecond
+                                       << " s, circ " << onTimes[static_cast<int32_t>(Meter::Circ)] / cMsInSecond
+                                       << " s, drain " << onTimes[static_cast<int32_t>(Meter::Drain)] / cMsInSecond << " s" << Log::end;
+    }
+    else { // nothing to do
+    }
+  }
+}
+
+void Accounting::process(Event const &aEvent) noexcept {
+  EventType type = aEvent.getType();
+  if(type == EventType::Program) {
+    Program program = aEvent.getProgram();
+    if(program == Program::Stop) {
+      mStopped = true;
+    }
+    else if(program != Program::None) {
+      mProgram = program;
+    }
+    else { // nothing to do
+    }
+  }
+  else if(type == EventType::MachineState) {
+    accumulate();
+    mState = aEvent.getMachineState();
+    if(!mRunning && mState != MachineState::Idle) {
+      startRun();
+    }
+    else if(mRunning && (mState == MachineState::Idle || mState == MachineState::Shutdown)) {
+      // Shutdown only switches the power relay off.
+      finishRun(!mStopped);
+    }
+    else { // nothing to do
+    }
+  }
+  else if(type == EventType::Actuate) {
+    uint32_t raw = static_cast<uint32_t>(aEvent.getActuate());
+    Meter meter = (raw / 2u < sizeof(cMeters) / sizeof(cMeters[0]) ? cMeters[raw / 2u] : Meter::Invalid);
+    if(meter != Meter::Invalid) {
+      int64_t &onSince = mOnSince[static_cast<int32_t>(meter)];
+      // Automat may repeat the same command, only the changes count.
+      if((raw & 1u) != 0u && onSince == cNotOn) {
+        onSince = mTimerManager.getPlanTime();
+      }
+      else if((raw & 1u) == 0u && onSince != cNotOn) {
+        accumulate();
+        onSince = cNotOn;
+      }
+      else { // nothing to do
+      }
+    }
+    else { // nothing to do
+    }
+  }
+  else if(type == EventType::MeasuredTemperature) {
+    int32_t temperature = aEvent.getIntValue();
+    if(mRunning && mOnSince[static_cast<int32_t>(Meter::Heat)] != cNotOn && temperature > mTemperature) {
+      mCurrent.heatingRise += temperature - mTemperature;
+    }
+    else { // nothing to do
+    }
+    mTemperature = temperature;
+  }
+  else if(type == EventType::Error) {
+    if(mRunning) {
+      mCurrent.errors |= static_cast<int32_t>(aEvent.getError());
+      finishRun(false);
+    }
+    else { // nothing to do
+    }
+  }
+  else { // nothing to do
+  }
+}
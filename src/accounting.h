@@ -0,0 +1,127 @@
+#ifndef DISHWASHER_ACCOUNTING_INCLUDED
+#define DISHWASHER_ACCOUNTING_INCLUDED
+
+#include "base.h"
+#include <array>
+
+/** Integrates the on-times of the heater, the fill valve and the pumps from the Actuate events
+ * for each program run, broken down by MachineState. The finished runs are kept in a ring.
+ * The temperature rise while heating is also summed, so a degrading heater shows up as less
+ * rise per kWh without extra sensors. The times are plan times, see TimerManager::getPlanTime. */
+class Accounting final : public Component {
+public:
+  enum class Meter : int32_t {
+    Invalid = -1, Heat, Fill, Circ, Drain, Count
+  };
+
+  static constexpr int32_t cMeterCount = static_cast<int32_t>(Meter::Count);
+  static constexpr int32_t cStateCount = static_cast<int32_t>(MachineState::Count);
+  static constexpr int32_t cRunCount   = 16;
+
+  /// Under 200 bytes each.
+  struct Run final {
+    /// ms for each state and meter.
+    std::array<std::array<uint32_t, cMeterCount>, cStateCount> onTimes;
+    /// us
+    int64_t  start;
+    /// ms
+    uint32_t length;
+    /// Celsius, summed over the heating periods.
+    int32_t  heatingRise;
+    /// Raised during the run.
+    int32_t  errors;
+    Program  program;
+    /// False if stopped or halted by an error.
+    bool     completed;
+
+    /// ms in all states.
+    uint32_t getOnTime(Meter const aMeter) const noexcept;
+
+    /// kWh, from the nominal heater power.
+    double getEnergy() const noexcept;
+
+    /// l, from the nominal fill flow rate.
+    double getWater() const noexcept;
+
+    /// h, the circulation and the drain pump together.
+    double getPumpHours() const noexcept;
+  };
+
+private:
+  static constexpr int64_t  cNotOn         = -1;
+  static constexpr int64_t  cUsInMs        = 1000;
+  static constexpr uint32_t cMsInSecond    = 1000u;
+  static constexpr double   cMsInMinute    = 60000.0;
+  static constexpr double   cMsInHour      = 3600000.0;
+  static constexpr double   cMinutesInHour = 60.0;
+  static constexpr double   cMlInL         = 1000.0;
+  static constexpr double   cWInKw         = 1000.0;
+
+  /// Meter of each Actuate value pair, Actuate::Shutdown0 / 2 first.
+  static constexpr Meter cMeters[] = {
+    Meter::Invalid, Meter::Heat, Meter::Drain, Meter::Fill, Meter::Invalid, Meter::Invalid, Meter::Circ, Meter::Invalid
+  };
+
+  std::array<Run, cRunCount> mRuns;
+  /// All the runs so far, the ring holds the last cRunCount ones.
+  int32_t      mRunCount    = 0;
+  Run          mCurrent;
+  bool         mRunning     = false;
+  bool         mStopped     = false;
+  Program      mProgram     = Program::None;
+  MachineState mState       = MachineState::Idle;
+  /// us, cNotOn if the meter is off
+  std::array<int64_t, cMeterCount> mOnSince;
+  int32_t      mTemperature = 0;
+
+public:
+  Accounting() noexcept;
+  virtual ~Accounting() noexcept {
+  }
+
+  /// Only from the thread of the component, or after it has stopped.
+  int32_t getRunCount() const noexcept {
+    return mRunCount;
+  }
+
+  /// Only from the thread of the component, or after it has stopped.
+  /// @param aAgo 0 for the last finished run, less than min(getRunCount(), cRunCount)
+  Run const & getRun(int32_t const aAgo) const noexcept {
+    return mRuns[(mRunCount - 1 - aAgo) % cRunCount];
+  }
+
+protected:
+  virtual char const * getTaskName() const noexcept override {
+    return "account";
+  }
+
+  virtual bool shouldHaltOnError() const noexcept override {
+    return false;
+  }
+
+  virtual bool shouldBeQueued(EventType const aType) const noexcept override;
+
+  virtual bool shouldCoalesce(EventType const aType) const noexcept override {
+    return aType == EventType::MeasuredTemperature;
+  }
+
+  /// An error finishes the run, so the Actuate events sent before it must be accounted first.
+  virtual bool shouldOvertake(EventType const) const noexcept override {
+    return false;
+  }
+
+private:
+  /// Adds the on-times until now to the current state and restarts them from now.
+  void accumulate() noexcept;
+
+  void startRun() noexcept;
+  void finishRun(bool const aCompleted) noexcept;
+  void logRun(Run const &aRun) const noexcept;
+
+  virtual void process(Event const &aEvent) noexcept override;
+
+  virtual void process(int32_t const) noexcept override {
+  }
+};
+
+#endif // DISHWASHER_ACCOUNTING_INCLUDED
@@ -4,8 +4,13 @@
 
 using namespace std;
 
-bool Automat::shouldBeQueued(Event const &aEvent) const noexcept {
-  switch(aEvent.getType()) {
+Automat::Automat(char const * const aSprayModelFilename, Tuning const &aTuning)
+  : Component(), mTuning(aTuning), mHeatController(aTuning.heaterPwmPeriod), mSprayCalibration(aSprayModelFilename) {
+}
+
+bool Automat::shouldBeQueued(EventType const aType) const noexcept {
+  switch(aType) {
+  case EventType::MeasuredDoor:
   case EventType::MeasuredSpray:
   case EventType::MeasuredWaterLevel:
   case EventType::MeasuredTemperature:
@@ -22,55 +27,58 @@ bool Automat::shouldBeQueued(Event const &aEvent) const noexcept {
   }
 }
 
+bool Automat::shouldCoalesce(EventType const aType) const noexcept {
+  switch(aType) {
+  case EventType::MeasuredWaterLevel:
+  case EventType::MeasuredTemperature:
+  case EventType::MeasuredCircCurrent:
+  case EventType::MeasuredDrainCurrent:
+    return true;
+  default:
+    return false;
+  }
+}
+
 void Automat::doResinWashSwitch(OnOffState const aDesired) noexcept {
   mDesiredResinWash = aDesired;
   if(mDesiredResinWash == OnOffState::On) {
-    mSprayChangeTransition = true;
-    // great time to calibrate the spray changer mechanism
-    mTimerManager.schedule(Config::cSprayChangeSearch, cTimerFinishSearchSprayChangePosition);
-    send(Actuate::Spray1);
-    mMeasureStart = mTimerManager.now();
-    if(mWaterLevel < Config::cWaterLevelFull) {
-      send(Actuate::Fill1);
+    if(!mSprayCalibration.isValid() && !mSprayCalibration.isSearching()) {
+      // great time to calibrate the spray changer mechanism
+      startSprayChangeSearch();
     }
-    else { // nothing to do
+    else { // nothing to do, the persisted model is still valid
     }
-    send(Actuate::Drain1);
+    mWaterController.stop();
+    switchFill(mWaterLevel < Config::cWaterLevelFull);
+    switchDrain(true);
   }
   else {
     mDesiredWaterLevel = 0;
     mDesiredTemperature = 0;
     mDesiredCirculate = OnOffState::Off;
     mDesiredSprayChange = OnOffState::Off;
-    send(Actuate::Fill0);
-    send(Actuate::Drain0);
+    switchFill(false);
+    switchDrain(false);
   }
 }
 
 void Automat::doResinWashWaterLevel(uint16_t const aLevel) noexcept {
   mWaterLevel = aLevel;
   if(mWaterLevel < Config::cWaterLevelHalf) {
-    send(Actuate::Fill1);
+    switchFill(true);
   }
   else { // nothing to do
   }
   if(mWaterLevel >= Config::cWaterLevelFull) {
-    send(Actuate::Fill0);
+    switchFill(false);
   }
   else { // nothing to do
   }
 }
 
 void Automat::doResinWashSpray(OnOffState const aSpray) noexcept {
-  if(mSprayContact == OnOffState::Invalid) {
-    int64_t now = mTimerManager.now();
-    ensure(mMeasuredTimeCount < cSprayChangeMaxMeasuredTimeCount);
-    mSprayChangeTimes[mMeasuredTimeCount++] = now - mMeasureStart;
-    mMeasureStart = now;
-    mSprayContact = aSpray;
-  }
-  else { // nothing to do
-  }
+  mSprayContact = aSpray;
+  mSprayCalibration.contact(aSpray, mTimerManager.getPlanTime());
 }
 
 void Automat::doResinWash(const Event &aEvent) noexcept {
@@ -89,76 +97,136 @@ void Automat::doResinWash(const Event &aEvent) noexcept {
 }
 
 void Automat::doWaterLevel(Event const &aEvent) noexcept {
-  // TODO DrainCurrent
   EventType type = aEvent.getType();
   if(type == EventType::DesiredWaterLevel) {
-    ensure(mDesiredCirculate == OnOffState::On);
+    ensure(mDesiredCirculate != OnOffState::On);
     mDesiredWaterLevel = aEvent.getIntValue();
-    if(mWaterLevel < mDesiredWaterLevel - Config::cWaterLevelHisteresis) {
-      send(Actuate::Drain0);
-      send(Actuate::Fill1);
-      // TODO timeout
-    }
-    else { // nothing to do
-    }
-    if(mWaterLevel > mDesiredWaterLevel + Config::cWaterLevelHisteresis) {
-      send(Actuate::Drain1);
-      send(Actuate::Fill0);
-      // TODO timeout
-    }
-    else { // nothing to do
-    }
+    switchFlow(mWaterController.start(mDesiredWaterLevel, mWaterLevel, mTimerManager.getPlanTime()));
   }
   else if(type == EventType::MeasuredWaterLevel) {
     mWaterLevel = aEvent.getIntValue();
-    if(mDesiredCirculate == OnOffState::On) {
-      return;
+    switchFlow(mWaterController.measure(mWaterLevel, mTimerManager.getPlanTime()));
+    Error error = mWaterController.getError();
+    if(error != Error::None) {
+      Log::i(nowtech::LogApp::cError) << "level " << mWaterLevel << " mm, learnt fill " << mWaterController.getFillRate()
+                                      << " drain " << mWaterController.getDrainRate() << " mm/s" << Log::end;
+      raise(error, "water flow deviates from the learnt rate");
     }
     else { // nothing to do
     }
-    if(mWaterLevel < mDesiredWaterLevel - Config::cWaterLevelHisteresis) {
-      send(Actuate::Drain0);
-      send(Actuate::Fill1);
-    }
-    else if(mWaterLevel > mDesiredWaterLevel + Config::cWaterLevelHisteresis) {
-      send(Actuate::Drain1);
-      send(Actuate::Fill0);
-    }
-    else {
-      // TODO cancel
-    }
   }
   else { // nothing to do
   }
 }
 
-void Automat::doTemperature(Event const &aEvent) noexcept {
+void Automat::switchFill(bool const aOn) noexcept {
+  if(aOn != mFill) {
+    send(aOn ? Actuate::Fill1 : Actuate::Fill0);
+    mFill = aOn;
+  }
+  else { // nothing to do
+  }
+}
+
+void Automat::switchDrain(bool const aOn) noexcept {
+  if(aOn != mDrain) {
+    send(aOn ? Actuate::Drain1 : Actuate::Drain0);
+    mDrain = aOn;
+    mDrainMonitor.expect(mDrain && !mDoorOpen, mTimerManager.getPlanTime());
+  }
+  else { // nothing to do
+  }
+}
+
+void Automat::switchCirc(bool const aOn) noexcept {
+  if(aOn != mCirc) {
+    send(aOn ? Actuate::Circ1 : Actuate::Circ0);
+    mCirc = aOn;
+    mCircMonitor.expect(mCirc && !mDoorOpen, mTimerManager.getPlanTime());
+  }
+  else { // nothing to do
+  }
+}
+
+void Automat::switchFlow(WaterController::Flow const aFlow) noexcept {
+  bool fill = (aFlow == WaterController::Flow::Fill);
+  bool drain = (aFlow == WaterController::Flow::Drain);
+  // closes before opens
+  switchFill(mFill && fill);
+  switchDrain(mDrain && drain);
+  switchFill(fill);
+  switchDrain(drain);
+}
+
+void Automat::doPumps(Event const &aEvent) noexcept {
   EventType type = aEvent.getType();
-  if(type == EventType::DesiredTemperature) {
-    mDesiredTemperature = aEvent.getIntValue();
-    if(mTemperature < mDesiredTemperature - Config::cTempHisteresis) {
-      send(Actuate::Heat1);
-        // TODO timeout
+  int64_t now = mTimerManager.getPlanTime();
+  if(type == EventType::MeasuredDoor) {
+    // Output cuts the power of the actuators while the door is open
+    mDoorOpen = (aEvent.getDoor() == DoorState::Open);
+    mCircMonitor.expect(mCirc && !mDoorOpen, now);
+    mDrainMonitor.expect(mDrain && !mDoorOpen, now);
+  }
+  else {
+    PumpMonitor &monitor = (type == EventType::MeasuredCircCurrent ? mCircMonitor : mDrainMonitor);
+    Error error = monitor.measure(aEvent.getIntValue(), now);
+    if(error != Error::None) {
+      Log::i(nowtech::LogApp::cError) << aEvent.getTypeConstStr() << ' ' << aEvent.getIntValue() << " mA, lifetime mean " << monitor.getLifetime().getMean()
+                                      << " sd " << monitor.getLifetime().getStdDev() << " mA" << Log::end;
+      raise(error, "pump current contradicts the command");
     }
     else { // nothing to do
     }
-    if(mTemperature > mDesiredTemperature + Config::cTempHisteresis) {
-      send(Actuate::Heat0);
-        // TODO timeout
+  }
+}
+
+void Automat::doTemperature(Event const &aEvent) noexcept {
+  EventType type = aEvent.getType();
+  if(type == EventType::DesiredTemperature) {
+    mDesiredTemperature = aEvent.getIntValue();
+    mHeatController.setTarget(mDesiredTemperature);
+    if(mHeatController.isPwm()) {
+      mTimerManager.cancel(mHeatPeriod);
+      mTimerManager.cancel(mHeatPeriodOff);
+      startHeatPeriod();
     }
-    else { // nothing to do
+    else {
+      switchHeat(mHeatController.decide());
     }
   }
   else if(type == EventType::MeasuredTemperature) {
     mTemperature = aEvent.getIntValue();
-    if(mTemperature < mDesiredTemperature - Config::cTempHisteresis) {
-      send(Actuate::Heat1);
+    mHeatController.measure(mTemperature, mTimerManager.getPlanTime());
+    // PWM switches on only at the period start, but off as soon as the target is predicted
+    if(!mHeatController.isPwm() || (mHeat && !mHeatController.decide())) {
+      switchHeat(mHeatController.decide());
     }
-    else if(mTemperature > mDesiredTemperature + Config::cTempHisteresis) {
-      send(Actuate::Heat0);
+    else { // nothing to do
     }
-    else {
-        // TODO cancel
+  }
+  else { // nothing to do
+  }
+}
+
+void Automat::switchHeat(bool const aOn) noexcept {
+  if(aOn != mHeat) {
+    send(aOn ? Actuate::Heat1 : Actuate::Heat0);
+    mHeat = aOn;
+    mHeatController.switched(aOn, mTimerManager.getPlanTime());
+  }
+  else { // nothing to do
+  }
+}
+
+void Automat::startHeatPeriod() noexcept {
+  int32_t onTime = mHeatController.getPwmOnTime();
+  switchHeat(onTime > 0);
+  if(mDesiredTemperature > 0) {
+    mHeatPeriod = mTimerManager.schedule(mHeatController.getPwmPeriod(), cTimerHeatPeriod);
+    if(onTime > 0 && onTime < mHeatController.getPwmPeriod()) {
+      mHeatPeriodOff = mTimerManager.schedule(onTime, cTimerHeatPeriodOff);
+    }
+    else { // nothing to do
     }
   }
   else { // nothing to do
@@ -171,14 +239,17 @@ void Automat::doCirculate(Event const &aEvent) noexcept {
   if(type == EventType::DesiredCirc) {
     mDesiredCirculate = aEvent.getOnOff();
     if(mDesiredCirculate == OnOffState::On) {
+      // the circulation takes the water out of the sump, so the level wish is fulfilled by now
+      mWaterController.stop();
+      switchFlow(WaterController::Flow::None);
       if(mSprayChangeTransition == false) {
-        send(Actuate::Circ1);
+        switchCirc(true);
       }
       else { // nothing to do
       }
     }
     else {
-      send(Actuate::Circ0);
+      switchCirc(false);
     }
   }
   else { // nothing to do
@@ -196,33 +267,37 @@ void Automat::doSpray(Event const &event) noexcept {
     }
     mDesiredSprayChange = desired;
     if(mDesiredSprayChange == OnOffState::On) {
-      ensure((mSprayPosition == SprayChangeState::Upper ||
-              mSprayPosition == SprayChangeState::Lower ||
-              mSprayPosition == SprayChangeState::Both) &&
-              mSprayContact == OnOffState::On);
-      send(Actuate::Spray1);
-      send(Actuate::Circ0);  // prevent circulation during transition
-      mSprayChangeTransition = true;
+      // a crash while moving must not leave a stale position behind
+      mSprayCalibration.save(false);
+      if(!mSprayCalibration.isSearching()) {
+        startSprayChange();
+      }
+      else { // nothing to do, continues after the search
+      }
     }
-    else { // nothing to do
+    else if(!mSprayChangeTransition) {
+      mSprayCalibration.save(true);
+    }
+    else { // nothing to do, saved when the motor stops
     }
   }
   else if(type == EventType::MeasuredSpray) {
     mSprayContact = event.getOnOff();
-    if(mSprayContact == OnOffState::On) {
-      if(mSprayPosition == SprayChangeState::Upper) {
-        mTimerManager.schedule(Config::cSprayChangeDownOn, cTimerSprayChangeStop);
-        mSprayPosition = SprayChangeState::Lower;
+    mSprayCalibration.contact(mSprayContact, mTimerManager.getPlanTime());
+    if(mSpray && mSprayContact == OnOffState::On && !mSprayCalibration.isSearching()) {
+      SprayChangeState position = getSprayPosition();
+      if(position == SprayChangeState::Lower) {
+        mTimerManager.schedule(mSprayCalibration.scale(Config::cSprayChangeDownOn), cTimerSprayChangeStop);
       }
-      else if(mSprayPosition == SprayChangeState::Lower) {
-        mTimerManager.schedule(Config::cSprayChangeBothOn, cTimerSprayChangeStop);
-        mSprayPosition = SprayChangeState::Both;
+      else if(position == SprayChangeState::Both) {
+        mTimerManager.schedule(mSprayCalibration.scale(Config::cSprayChangeBothOn), cTimerSprayChangeStop);
       }
-      else if(mSprayPosition == SprayChangeState::Both) {
-        mTimerManager.schedule(Config::cSprayChangeUpOn, cTimerSprayChangeStop);
-        mSprayPosition = SprayChangeState::Upper;
+      else if(position == SprayChangeState::Upper) {
+        mTimerManager.schedule(mSprayCalibration.scale(Config::cSprayChangeUpOn), cTimerSprayChangeStop);
       }
-      else { // nothing to do
+      else {
+        // lost, the next change will search
+        mTimerManager.schedule(0, cTimerSprayChangeStop);
       }
     }
     else { // nothing to do
@@ -232,21 +307,59 @@ void Automat::doSpray(Event const &event) noexcept {
   }
 }
 
+void Automat::switchSpray(bool const aOn) noexcept {
+  if(aOn != mSpray) {
+    send(aOn ? Actuate::Spray1 : Actuate::Spray0);
+    mSpray = aOn;
+    mSprayCalibration.motor(aOn);
+  }
+  else { // nothing to do
+  }
+}
+
+void Automat::startSprayChange() noexcept {
+  if(getSprayPosition() == SprayChangeState::Invalid) {
+    startSprayChangeSearch();
+  }
+  else {
+    switchSpray(true);
+    mSprayChangeTransition = true;
+  }
+  switchCirc(false);  // prevent circulation during transition
+}
+
+void Automat::startSprayChangeSearch() noexcept {
+  mSprayChangeTransition = true;
+  mSprayCalibration.startSearch();
+  mTimerManager.schedule(Config::cSprayChangeSearch, cTimerFinishSearchSprayChangePosition);
+  switchSpray(true);
+}
+
+Automat::SprayChangeState Automat::getSprayPosition() const noexcept {
+  int32_t segment = mSprayCalibration.getSegment();
+  // the position changes on entering the odd segments, where the contact turns on
+  return segment == SprayCalibration::cInvalidSegment ? SprayChangeState::Invalid
+    : static_cast<SprayChangeState>((segment + SprayCalibration::cSegmentCount - 1) % SprayCalibration::cSegmentCount / 2);
+}
+
 void Automat::process(Event const &aEvent) noexcept {
-  if(mErrorSoFar.load() == static_cast<int32_t>(Error::None)) {
+  if(mErrorSoFar != static_cast<int32_t>(Error::None)) {
     return;
   }
   EventType type = aEvent.getType();
-  if(type == EventType::DesiredResinWash || mDesiredResinWash == OnOffState::On) {
+  if(type == EventType::MeasuredDoor || type == EventType::MeasuredCircCurrent || type == EventType::MeasuredDrainCurrent) {
+    doPumps(aEvent);
+  }
+  else if(type == EventType::DesiredResinWash || mDesiredResinWash == OnOffState::On) {
     doResinWash(aEvent);
   }
-  else if(type == EventType::DesiredWaterLevel || type == EventType::MeasuredWaterLevel || type == EventType::MeasuredDrainCurrent) {
+  else if(type == EventType::DesiredWaterLevel || type == EventType::MeasuredWaterLevel) {
     doWaterLevel(aEvent);
   }
   else if(type == EventType::DesiredTemperature || type == EventType::MeasuredTemperature) {
     doTemperature(aEvent);
   }
-  else if(type == EventType::DesiredCirc || type == EventType::MeasuredCircCurrent) {
+  else if(type == EventType::DesiredCirc) {
     doCirculate(aEvent);
   }
   else if(type == EventType::DesiredSpray || type == EventType::MeasuredSpray) {
@@ -257,77 +370,53 @@ void Automat::process(Event const &aEvent) noexcept {
 }
 
 void Automat::process(int32_t const aTimerEvent) noexcept {
-  if(aTimerEvent == cTimerSprayChangeStop) {
+  if(aTimerEvent == cTimerHeatPeriod) {
+    startHeatPeriod();
+  }
+  else if(aTimerEvent == cTimerHeatPeriodOff) {
+    switchHeat(false);
+  }
+  else if(aTimerEvent == cTimerSprayChangeStop) {
     mSprayChangeTransition = false;
-    send(Actuate::Spray0);
+    switchSpray(false);
     if(mDesiredCirculate == OnOffState::On) {
-      send(Actuate::Circ1);
+      switchCirc(true);
     }
     else { // nothing to do
     }
     if(mDesiredSprayChange == OnOffState::On) {
-      mTimerManager.schedule(Config::cSprayChangeKeepPosition, cTimerSprayChangePause);
+      mTimerManager.schedule(mTuning.sprayChangeKeepPosition, cTimerSprayChangePause);
     }
-    else { // nothing to do
+    else {
+      mSprayCalibration.save(true);
     }
   }
   else if(aTimerEvent == cTimerSprayChangePause) {
     if(mDesiredSprayChange == OnOffState::On) {
-      ensure(((mSprayPosition == SprayChangeState::Upper ||
-               mSprayPosition == SprayChangeState::Lower ||
-               mSprayPosition == SprayChangeState::Both) &&
-               mSprayContact == OnOffState::On));
-      send(Actuate::Spray1);
-      send(Actuate::Circ0);  // prevent circulation during transition
-      mSprayChangeTransition = true;
+      startSprayChange();
     }
     else { // nothing to do
     }
   }
   else if(aTimerEvent == cTimerFinishSearchSprayChangePosition) {
+    switchSpray(false);
     mTimerManager.schedule(Config::cSprayChangeDeceleration, cTimerDecelerateSearchSprayChangePosition);
   }
   else if(aTimerEvent == cTimerDecelerateSearchSprayChangePosition) {
-    if(mMeasuredTimeCount < cExpectedSprayChangeTimeCount) {
-      raise(Error::SpraySelect, "spray change timeout");
-    }
-    else { // nothing to do
-    }
-    int shortPos = 0;
-    while(shortPos < mMeasuredTimeCount) {
-      if(mSprayChangeTimes[shortPos] < Config::cSprayChangeUpOn + Config::cSprayChangeTolerance) {
-        break;
-      }
-      else { // nothing to do
-      }
-      shortPos++;
-    }
-    int i;
-    for(i = 0; shortPos < mMeasuredTimeCount; ++i, ++shortPos) {
-      mSprayChangeTimes[i] = mSprayChangeTimes[shortPos];
-    }
-    mMeasuredTimeCount = i;
-    if(mMeasuredTimeCount >= cSprayChangeCycle * 2) {
-      for(i = 0; i < cSprayChangeCycle; i++) {
-        mSprayChangeTimes[i] = (mSprayChangeTimes[i] + mSprayChangeTimes[i + cSprayChangeCycle]) / 2;
-      }
+    if(!mSprayCalibration.fit()) {
+      raise(Error::SpraySelect, "spray change calibration failed");
     }
     else { // nothing to do
     }
-    int rawPositionIndex = (mMeasuredTimeCount - 1) % cSprayChangeCycle;
-    ensure(1 - rawPositionIndex % 2 == static_cast<int>(mSprayContact));
-    if(rawPositionIndex == 0 || rawPositionIndex == 1) {
-      mSprayPosition = SprayChangeState::Upper;
-    }
-    else if(rawPositionIndex == 2 || rawPositionIndex == 3) {
-      mSprayPosition = SprayChangeState::Lower;
+    mSprayChangeTransition = false;
+    if(mDesiredSprayChange == OnOffState::On) {
+      startSprayChange();
     }
-    else if(rawPositionIndex == 4 || rawPositionIndex == 5) {
-      mSprayPosition = SprayChangeState::Both;
+    else if(mDesiredCirculate == OnOffState::On) {
+      switchCirc(true);
     }
     else { // nothing to do
     }
-    mSprayChangeTransition = false;
   }
   else { // nothing to do
   }
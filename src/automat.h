@@ -2,20 +2,23 @@
 #define DISHWASHER_AUTOMAT_INCLUDED
 
 #include "base.h"
+#include "tuning.h"
+#include "heatcontroller.h"
+#include "watercontroller.h"
+#include "spraycalibration.h"
+#include "pumpmonitor.h"
 
 /** Manages water level, temperature, circulation and spray selector
  * based on measured values and desired values. */
 class Automat final : public Component {
   enum class SprayChangeState : int32_t { Invalid = -1, Upper, Lower, Both };
 
-  static constexpr int32_t cSprayChangeMaxMeasuredTimeCount          = 30;
-  static constexpr int32_t cExpectedSprayChangeTimeCount             = 18;
-  static constexpr int32_t cSprayChangeCycle                         =  6;
-
   static constexpr int32_t cTimerFinishSearchSprayChangePosition     =  0;
   static constexpr int32_t cTimerDecelerateSearchSprayChangePosition =  1;
   static constexpr int32_t cTimerSprayChangeStop                     =  2;
   static constexpr int32_t cTimerSprayChangePause                    =  3;
+  static constexpr int32_t cTimerHeatPeriod                          =  4;
+  static constexpr int32_t cTimerHeatPeriodOff                       =  5;
 
   OnOffState mDesiredResinWash   = OnOffState::Off;
   int16_t    mDesiredTemperature = 0;
@@ -26,13 +29,30 @@ class Automat final : public Component {
   uint16_t         mWaterLevel = 0;
   uint16_t         mTemperature = 0;
   OnOffState       mSprayContact = OnOffState::Invalid;
-  /** Valid if sprayContact is on. Signs the previous state if it is off. */
-  SprayChangeState mSprayPosition = SprayChangeState::Invalid;
   bool             mSprayChangeTransition = false;
 
-  int              mMeasuredTimeCount = 0;
-  int64_t          mSprayChangeTimes[cSprayChangeMaxMeasuredTimeCount];
-  int64_t          mMeasureStart;
+  Tuning const     mTuning;
+
+  HeatController   mHeatController;
+  bool             mHeat = false;
+  TimerManager::Handle mHeatPeriod    = TimerManager::cInvalidHandle;
+  TimerManager::Handle mHeatPeriodOff = TimerManager::cInvalidHandle;
+
+  WaterController  mWaterController;
+  bool             mFill  = false;
+  bool             mDrain = false;
+
+  SprayCalibration mSprayCalibration;
+  bool             mSpray = false;
+
+  bool             mCirc     = false;
+  bool             mDoorOpen = false;
+  PumpMonitor      mCircMonitor  = PumpMonitor(Config::cCirculateCurrentMin, Error::CircConnector, Error::CircRelayStuck);
+  PumpMonitor      mDrainMonitor = PumpMonitor(Config::cDrainCurrentMin, Error::DrainConnector, Error::DrainRelayStuck);
+
+public:
+  /// @param aSprayModelFilename optional file persisting the spray cam model between runs, see SprayCalibration
+  Automat(char const * const aSprayModelFilename = nullptr, Tuning const &aTuning = Tuning());
 
 protected:
   virtual char const * getTaskName() const noexcept override {
@@ -43,7 +63,10 @@ protected:
     return true;
   }
 
-  virtual bool shouldBeQueued(const Event &e) const noexcept override;
+  virtual bool shouldBeQueued(EventType const aType) const noexcept override;
+
+  /// Analog measurements only. Spray contact changes are all needed for timing.
+  virtual bool shouldCoalesce(EventType const aType) const noexcept override;
 
 private:
   void doResinWashSwitch(OnOffState const aDesired) noexcept;
@@ -54,11 +77,40 @@ private:
    * controllable parameter off so that if resin wash finishes, other parts make anything unexpected.
    * Meanwhile it calibrates the spray change system. */
   void doResinWash(Event const &aEvent) noexcept;
+  /// Fills or drains according to mWaterController, see WaterController.
   void doWaterLevel(Event const &aEvent) noexcept;
+
+  /// These send the valve and pump commands only on change.
+  void switchFill(bool const aOn) noexcept;
+  void switchDrain(bool const aOn) noexcept;
+  void switchCirc(bool const aOn) noexcept;
+  void switchFlow(WaterController::Flow const aFlow) noexcept;
+
+  /// Checks the pump currents against the commands, see PumpMonitor.
+  void doPumps(Event const &aEvent) noexcept;
+
+  /// Switches the heater according to mHeatController, see HeatController.
   void doTemperature(Event const &aEvent) noexcept;
+
+  /// Sends the heater command only on change.
+  void switchHeat(bool const aOn) noexcept;
+
+  /// Switches the heater on for the on-time of the PWM period, and schedules the next period.
+  void startHeatPeriod() noexcept;
+
   void doCirculate(Event const &event) noexcept;
   void doSpray(Event const &event) noexcept;
 
+  /// Sends the spray motor command only on change.
+  void switchSpray(bool const aOn) noexcept;
+
+  /// Searches first if the cam position is unknown.
+  void startSprayChange() noexcept;
+  void startSprayChangeSearch() noexcept;
+
+  /// Valid if sprayContact is on. Signs the previous state if it is off.
+  SprayChangeState getSprayPosition() const noexcept;
+
   /** Won't continuously adjust for DesiredWaterLevel. Once the wish arrives,
    * drains / fills water until it is fulfilled, and then abandons it,
    * because circulation will schrink the water level in the sump.
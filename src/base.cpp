@@ -1,6 +1,5 @@
 ﻿#include "base.h"
 #include "dishwash.h"
-#include <mutex>
 
 
 constexpr char Event::cStrInvalid[Event::cStringSize];
@@ -13,115 +12,72 @@ constexpr char Event::cStrMachineState[][Event::cStringSize];
 constexpr char Event::cStrError[][Event::cStringSize];
 constexpr char Event::cStrEventType[][Event::cStringSize];
 constexpr char Event::cStrInt[];
-
-Event::Event(EventType const aType, OnOffState const aArg) noexcept : mType(aType), mOnOff(aArg) {
-  if(aType != EventType::MeasuredSalt &&
-     aType != EventType::MeasuredSpray &&
-     aType != EventType::MeasuredLeak &&
-     mType != EventType::DesiredSpray &&
-     aType != EventType::DesiredCirc &&
-     aType != EventType::DesiredResinWash) {
-    mType = EventType::Error;
-    mError = Error::Programmer;
-    Log::i(nowtech::LogApp::cError) << "Event not OnOffState" << Log::end;
-  }
-  else { // nothing to do
-  }
-}
-
-Event::Event(EventType const aType, int32_t const aArg) noexcept : mType(aType), mIntValue(aArg) {
-  if(aType != EventType::MeasuredCircCurrent &&
-     aType != EventType::MeasuredDrainCurrent &&
-     aType != EventType::MeasuredWaterLevel &&
-     aType != EventType::MeasuredTemperature &&
-     aType != EventType::DesiredWaterLevel &&
-     aType != EventType::DesiredTemperature &&
-     aType != EventType::RemainingTime &&
-     aType != EventType::TimeFactorChanged &&
-     mType != EventType::KeyPressed) {
-    mType = EventType::Error;
-    mError = Error::Programmer;
-    Log::i(nowtech::LogApp::cError) << "Event not int" << Log::end;
-  }
-  else { // nothing to do
-  }
-}
-
-OnOffState Event::getOnOff() const noexcept {
-  OnOffState ret;
-  if(mType != EventType::MeasuredSalt &&
-     mType != EventType::MeasuredSpray &&
-     mType != EventType::MeasuredLeak &&
-     mType != EventType::DesiredSpray &&
-     mType != EventType::DesiredCirc &&
-     mType != EventType::DesiredResinWash) {
-    ret = OnOffState::Invalid;
-  }
-  else {
-    ret = mOnOff;
-  }
-  return ret;
-}
-
-int32_t Event::getIntValue() const noexcept {
-  int32_t ret;
-  if(mType != EventType::MeasuredCircCurrent &&
-     mType != EventType::MeasuredDrainCurrent &&
-     mType != EventType::MeasuredWaterLevel &&
-     mType != EventType::MeasuredTemperature &&
-     mType != EventType::DesiredWaterLevel &&
-     mType != EventType::DesiredTemperature &&
-     mType != EventType::RemainingTime &&
-     mType != EventType::TimeFactorChanged &&
-     mType != EventType::KeyPressed) {
-    ret = cInvalid;
-  }
-  else {
-    ret = mIntValue;
-  }
-  return ret;
-}
+constexpr Event::PayloadKind Event::cPayloadKinds[];
 
 char const * Event::getValueConstStr() const noexcept {
-  char const * result = cStrInvalid;
-  if(mType == EventType::MeasuredDoor) {
+  char const * result;
+  switch(getPayloadKind(mType)) {
+  case PayloadKind::Door:
     result = cStrDoorState[mIntValue + 1];
-  }
-  else if(mType == EventType::MeasuredSalt ||
-          mType == EventType::MeasuredSpray ||
-          mType == EventType::MeasuredLeak ||
-          mType == EventType::DesiredCirc ||
-          mType == EventType::DesiredResinWash) {
+    break;
+  case PayloadKind::OnOff:
     result = cStrOnOffState[mIntValue + 1];
-  }
-  else if(mType == EventType::Error) {
+    break;
+  case PayloadKind::Int:
+    result = cStrInt;
+    break;
+  case PayloadKind::Error:
     result = cStrError[getErrorStrIndex()];
-  }
-  else if(mType == EventType::DesiredSpray) {
-    result = cStrSprayChangeState[mIntValue + 1];
-  }
-  else if(mType == EventType::Actuate) {
+    break;
+  case PayloadKind::Actuate:
     result = cStrActuate[mIntValue + 1];
-  }
-  else if(mType == EventType::Program) {
+    break;
+  case PayloadKind::Program:
     result = cStrProgram[mIntValue + 1];
-  }
-  else if(mType == EventType::MachineState) {
+    break;
+  case PayloadKind::MachineState:
     result = cStrMachineState[mIntValue + 1];
+    break;
+  default:
+    result = cStrInvalid;
+    break;
   }
-  else if(mType == EventType::KeyPressed ||
-          mType == EventType::MeasuredCircCurrent ||
-          mType == EventType::MeasuredDrainCurrent ||
-          mType == EventType::MeasuredWaterLevel ||
-          mType == EventType::MeasuredTemperature ||
-          mType == EventType::DesiredWaterLevel ||
-          mType == EventType::DesiredTemperature ||
-          mType == EventType::DesiredResinWash ||
-          mType == EventType::RemainingTime ||
-          mType == EventType::TimeFactorChanged) {
-    result = cStrInt;
+  return result;
+}
+
+bool Event::isValid() const noexcept {
+  bool result;
+  if(mType < EventType::MeasuredDoor || mType >= EventType::Count) {
+    result = false;
   }
-  else { // nothing to do
+  else {
+    switch(getPayloadKind(mType)) {
+    case PayloadKind::Door:
+      result = mDoor == DoorState::Open || mDoor == DoorState::Closed;
+      break;
+    case PayloadKind::OnOff:
+      result = mOnOff == OnOffState::Off || mOnOff == OnOffState::On;
+      break;
+    case PayloadKind::Int:
+      result = true;
+      break;
+    case PayloadKind::Error:
+      // a single error each time
+      result = mIntValue >= 0 && mIntValue <= static_cast<int32_t>(Error::SpraySelect) && (mIntValue & (mIntValue - 1)) == 0;
+      break;
+    case PayloadKind::Actuate:
+      result = mActuate >= Actuate::Shutdown0 && mActuate <= Actuate::Spray1;
+      break;
+    case PayloadKind::Program:
+      result = mProgram >= Program::None && mProgram < Program::Count;
+      break;
+    case PayloadKind::MachineState:
+      result = mMachineState >= MachineState::Idle && mMachineState < MachineState::Count;
+      break;
+    default:
+      result = false;
+      break;
+    }
   }
   return result;
 }
@@ -141,20 +97,74 @@ int32_t Event::getErrorStrIndex() const noexcept {
 }
 
 
-void Component::queueEvent(const Event &aEvent) noexcept {
-  if(aEvent.getType() == EventType::Error) {
-    mErrorSoFar |= static_cast<int32_t>(aEvent.getError());
+void Component::prepareQueues(int32_t const aIndex, int32_t const aSenderCount) {
+  mIndex = aIndex;
+  mPriorityTypes = 0u;
+  for(int32_t type = 0; type < static_cast<int32_t>(EventType::Count); ++type) {
+    if((cPriorityTypes & 1u << type) != 0u && shouldOvertake(static_cast<EventType>(type))) {
+      mPriorityTypes |= 1u << type;
+    }
+    else { // nothing to do
+    }
   }
-  else { // nothing to do
+  for(Lane *lane : { &mRoutine, &mPriority }) {
+    lane->rings.clear();
+    for(int32_t i = 0; i < aSenderCount; ++i) {
+      lane->rings.push_back(std::make_unique<Ring>(lane->capacity));
+    }
+  }
+}
+
+void Component::attach(Dishwasher * const aDishwasher) noexcept {
+  mDishwasher = aDishwasher;
+  mSharedError = &aDishwasher->getSharedError();
+  mErrorEpoch = SharedError::getEpoch(mSharedError->load());
+  mCoalescedTypes = 0u;
+  for(int32_t type = 0; type < static_cast<int32_t>(EventType::Count); ++type) {
+    EventType eventType = static_cast<EventType>(type);
+    if(eventType != EventType::Error && eventType != EventType::TimeFactorChanged && shouldCoalesce(eventType)) {
+      mCoalescedTypes |= 1u << type;
+    }
+    else { // nothing to do
+    }
   }
-  if(aEvent.getType() == EventType::Error ||
-     (mErrorSoFar.load() == cNoError &&
-        (aEvent.getType() == EventType::TimeFactorChanged || shouldBeQueued(aEvent)))) {
-    if(!mQueue.bounded_push(aEvent)) {
-      raise(Error::Queue);
+}
+
+void Component::queueEvent(int32_t const aSender, uint64_t const aSequence, Event const &aEvent) noexcept {
+  // called from the sender thread, so only the shared word may be read here
+  if(aEvent.getType() == EventType::Error || SharedError::getErrors(mSharedError->load()) == cNoError) {
+    QueuedEvent queued{aSequence, TimerManager::now(), aEvent};
+    Lane &lane = ((mPriorityTypes & 1u << static_cast<int32_t>(aEvent.getType())) != 0u ? mPriority : mRoutine);
+    bool pushed;
+    if(!lane.rings.empty()) {
+      pushed = lane.rings[aSender]->push(queued);
+      if(!pushed) {
+        mRingOverflow.store(true);
+        mNotifier.signal();
+      }
+      else { // nothing to do
+      }
+    }
+    else {
+      pushed = lane.queue.bounded_push(queued);
+      if(!pushed) {
+        // this thread picks it up by pollErrors
+        mDishwasher->send(this, Event(Error::Queue));
+      }
+      else { // nothing to do
+      }
+    }
+    if(pushed) {
+      int32_t previous = mQueuedCount.fetch_add(1);
+      updateMax(mStatistics.queueHighWater, previous + 1);
+      if(previous == 0) {
+        mNotifier.signal();
+      }
+      else { // nothing to do, already signalled
+      }
     }
     else {
-      mConditionVariable.notify_one();
+      ++mStatistics.droppedEvents;
     }
   }
   else { // nothing to do
@@ -174,34 +184,15 @@ void Component::run() noexcept {
   Log::registerCurrentTask(getTaskName());
   Log::i(nowtech::LogApp::cSystem) << "task started." << Log::end;
 
-  std::mutex mutex;
-  std::unique_lock<std::mutex> lock(mutex);
   while(mKeepRunning.load()) {
     try {
+      pollErrors();
       std::optional<int64_t> nextTimeout = mTimerManager.getEarliestValidTimeoutLength();
       if(nextTimeout) { // should normally succeed, but needed for debugging
-        if(mConditionVariable.wait_for(lock, std::chrono::microseconds(nextTimeout.value())) == std::cv_status::timeout) {
-          std::optional<int32_t> expiredAction = mTimerManager.pop();
-          while(expiredAction) {
-            process(expiredAction.value());
-            expiredAction = mTimerManager.pop();
-          }
-        }
-        else { // nothing to do
-        }
-        Event event;
-        while(mQueue.pop(event)) {
-          if(mErrorSoFar.load() == cNoError || event.getType() == EventType::Error) {
-            if(event.getType() == EventType::TimeFactorChanged) {
-              mTimerManager.setTimeDividor(event.getIntValue());
-            }
-            else { // nothing to do
-            }
-            process(event);
-          }
-          else { // nothing to do
-          }
-        }
+        mNotifier.wait(nextTimeout.value());
+        // Timers may expire while waking up for an event, pop() checks them anyway.
+        processExpiredTimers();
+        processQueuedEvents();
       }
       else { // nothing to do
       }
@@ -218,6 +209,150 @@ void Component::run() noexcept {
   std::this_thread::sleep_for(std::chrono::microseconds(cSleepFinish));
 }
 
+bool Component::step() noexcept {
+  bool result = false;
+  try {
+    pollErrors();
+    result = processExpiredTimers();
+    result = processQueuedEvents() || result;
+  }
+  catch(std::exception &e) {
+    Log::i(nowtech::LogApp::cSystem) << "Exception: " << e.what() << Log::end;
+    raise(Error::Programmer, "exception");
+  }
+  return result;
+}
+
+bool Component::pollErrors() noexcept {
+  uint64_t state = mSharedError->load();
+  uint32_t epoch = SharedError::getEpoch(state);
+  bool result = (epoch != mErrorEpoch);
+  if(result) {
+    mErrorEpoch = epoch;
+    mErrorSoFar |= static_cast<int32_t>(SharedError::getErrors(state));
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
+bool Component::processExpiredTimers() {
+  bool result = false;
+  std::optional<int64_t> expiration = mTimerManager.getEarliestExpiration();
+  std::optional<int32_t> expiredAction = mTimerManager.pop();
+  while(expiredAction) {
+    int64_t start = TimerManager::now();
+    mStatistics.timerLateness.record(start - expiration.value());
+    process(expiredAction.value());
+    mStatistics.processDuration.record(TimerManager::now() - start);
+    ++mStatistics.expiredTimers;
+    result = true;
+    expiration = mTimerManager.getEarliestExpiration();
+    expiredAction = mTimerManager.pop();
+  }
+  return result;
+}
+
+bool Component::popEvent(QueuedEvent &aEvent) noexcept {
+  return popEvent(mPriority, aEvent) || popEvent(mRoutine, aEvent);
+}
+
+bool Component::popEvent(Lane &aLane, QueuedEvent &aEvent) noexcept {
+  bool result;
+  if(aLane.rings.empty()) {
+    result = aLane.queue.pop(aEvent);
+  }
+  else {
+    Ring *earliestRing = nullptr;
+    QueuedEvent const *earliest = nullptr;
+    for(auto &ring : aLane.rings) {
+      QueuedEvent const *front = ring->front();
+      if(front != nullptr && (earliest == nullptr || front->sequence < earliest->sequence)) {
+        earliest = front;
+        earliestRing = ring.get();
+      }
+      else { // nothing to do
+      }
+    }
+    result = earliest != nullptr;
+    if(result) {
+      aEvent = *earliest;
+      earliestRing->pop();
+    }
+    else { // nothing to do
+    }
+  }
+  return result;
+}
+
+bool Component::processQueuedEvents() {
+  if(mRingOverflow.exchange(false)) {
+    raise(Error::Queue);
+  }
+  else { // nothing to do
+  }
+  bool result = false;
+  QueuedEvent event;
+  while(popEvent(event)) {
+    mBatch.clear();
+    mBatch.push_back(event);
+    while(mBatch.size() < static_cast<size_t>(cMessageQueueSize) && popEvent(event)) {
+      mBatch.push_back(event);
+    }
+    mQueuedCount.fetch_sub(static_cast<int32_t>(mBatch.size()));
+    // Walk backwards and move the survivors to the end, so the latest event of each coalesced type is kept in place.
+    size_t first = mBatch.size();
+    uint32_t seen = 0u;
+    for(size_t i = mBatch.size(); i > 0u; --i) {
+      uint32_t bit = 1u << static_cast<int32_t>(mBatch[i - 1u].event.getType());
+      if((mCoalescedTypes & seen & bit) == 0u) {
+        seen |= bit;
+        mBatch[--first] = mBatch[i - 1u];
+      }
+      else { // nothing to do
+      }
+    }
+    mStatistics.coalescedEvents += first;
+    for(size_t i = first; i < mBatch.size(); ++i) {
+      Event const &current = mBatch[i].event;
+      // an error raised meanwhile stops the rest of the batch like it stops the queueing
+      pollErrors();
+      if(mErrorSoFar == cNoError || current.getType() == EventType::Error) {
+        if(current.getType() == EventType::TimeFactorChanged) {
+          mTimerManager.setTimeDividor(current.getIntValue());
+        }
+        else { // nothing to do
+        }
+        int64_t start = TimerManager::now();
+        mStatistics.queueLatency.record(start - mBatch[i].enqueued);
+        process(current);
+        mStatistics.processDuration.record(TimerManager::now() - start);
+        ++mStatistics.processedEvents;
+      }
+      else { // nothing to do
+      }
+    }
+    result = true;
+  }
+  return result;
+}
+
+void Component::logStatistics() const noexcept {
+  static constexpr char const * cHistogramNames[] = { "queue latency  ", "process time   ", "timer lateness " };
+  LatencyHistogram const * histograms[] = { &mStatistics.queueLatency, &mStatistics.processDuration, &mStatistics.timerLateness };
+  Log::i(nowtech::LogApp::cSystem) << getTaskName() << " events: " << mStatistics.processedEvents.load()
+                                   << " coalesced: " << mStatistics.coalescedEvents.load()
+                                   << " dropped: " << mStatistics.droppedEvents.load()
+                                   << " queue high water: " << mStatistics.queueHighWater.load()
+                                   << " timers: " << mStatistics.expiredTimers.load() << Log::end;
+  for(int32_t i = 0; i < 3; ++i) {
+    LatencyHistogram::Snapshot snapshot = histograms[i]->snapshot();
+    Log::i(nowtech::LogApp::cSystem) << getTaskName() << ' ' << cHistogramNames[i] << "us n: " << snapshot.count
+                                     << " mean: " << snapshot.mean << " p50: " << snapshot.p50 << " p90: " << snapshot.p90
+                                     << " p99: " << snapshot.p99 << " p99.9: " << snapshot.p999 << " max: " << snapshot.max << Log::end;
+  }
+}
+
 void Component::raise(Error const aError) noexcept {
   mErrorSoFar |= static_cast<int32_t>(aError);
   mDishwasher->send(this, Event(aError));
@@ -4,13 +4,18 @@
 #include "dishwash-config.h"
 #include "bancopymove.h"
 #include "timer.h"
+#include "notifier.h"
+#include "spscring.h"
+#include "sharederror.h"
+#include "statistics.h"
 #include "Log.h"
 
 #include <chrono>
 #include <atomic>
 #include <thread>
 #include <functional>
-#include <condition_variable>
+#include <vector>
+#include <type_traits>
 #include <boost/lockfree/queue.hpp>
 
 enum class DoorState : int32_t { Invalid = -1, Open, Closed };
@@ -29,7 +34,7 @@ enum class Error : int32_t {     // raised in
   NoDrain         =  1 <<  5u, // Automat
   Leak            =  1 <<  6u, // StaticError
   NoSignal        =  1 <<  7u, // Input
-  InvalidSignal   =  1 <<  8u, // Input
+  InvalidSignal   =  1 <<  8u, // Input, StaticError
   UnstableSignal  =  1 <<  9u, // Input
   CircOverload    =  1 << 10u, // StaticError
   CircConnector   =  1 << 11u, // Automat
@@ -39,7 +44,7 @@ enum class Error : int32_t {     // raised in
   DrainRelayStuck =  1 << 15u, // Automat
   NoHeat          =  1 << 16u, // Automat
   Overheat        =  1 << 17u, // StaticError
-  InvalidTemp     =  1 << 18u, // Input
+  InvalidTemp     =  1 << 18u, // Input, StaticError
   SpraySelect     =  1 << 19u  // Automat
 };
 
@@ -82,9 +87,10 @@ enum class EventType : int32_t {
   Actuate,              // Logic, Automat (see above)    Actuate
   Program,              // Input                         Program
   MachineState,         // Logic                         MachineState
-  RemainingTime,        // Logic only on program start   int32_t
+  RemainingTime,        // Logic on progress, minutes    int32_t
   TimeFactorChanged,    // Dishwasher                    int32_t
-  KeyPressed            // Output (only test)            int32_t
+  KeyPressed,           // Output (only test)            int32_t
+  Count
 };
 
 class Event final {
@@ -92,6 +98,41 @@ public:
   static constexpr int32_t cStringSize = 16;
   static constexpr int32_t cInvalid    = -1;
 
+  /// Which union member holds the value.
+  enum class PayloadKind : int32_t {
+    Invalid = -1, None, Door, OnOff, Int, Error, Actuate, Program, MachineState
+  };
+
+  /// Payload kind for each EventType, indexed by EventType + 1 like the string tables.
+  static constexpr PayloadKind cPayloadKinds[] = { PayloadKind::None,          // Invalid
+                                                   PayloadKind::Door,          // MeasuredDoor
+                                                   PayloadKind::OnOff,         // MeasuredSalt
+                                                   PayloadKind::OnOff,         // MeasuredSpray
+                                                   PayloadKind::OnOff,         // MeasuredLeak
+                                                   PayloadKind::Int,           // MeasuredCircCurrent
+                                                   PayloadKind::Int,           // MeasuredDrainCurrent
+                                                   PayloadKind::Int,           // MeasuredWaterLevel
+                                                   PayloadKind::Int,           // MeasuredTemperature
+                                                   PayloadKind::Error,         // Error
+                                                   PayloadKind::OnOff,         // DesiredSpray
+                                                   PayloadKind::OnOff,         // DesiredCirc
+                                                   PayloadKind::Int,           // DesiredWaterLevel
+                                                   PayloadKind::Int,           // DesiredTemperature
+                                                   PayloadKind::OnOff,         // DesiredResinWash
+                                                   PayloadKind::Actuate,       // Actuate
+                                                   PayloadKind::Program,       // Program
+                                                   PayloadKind::MachineState,  // MachineState
+                                                   PayloadKind::Int,           // RemainingTime
+                                                   PayloadKind::Int,           // TimeFactorChanged
+                                                   PayloadKind::Int,           // KeyPressed
+                                                   PayloadKind::None };        // Count
+  static_assert(sizeof(cPayloadKinds) / sizeof(cPayloadKinds[0]) == static_cast<size_t>(EventType::Count) + 2u,
+                "cPayloadKinds must have an entry for each EventType.");
+
+  static constexpr PayloadKind getPayloadKind(EventType const aType) noexcept {
+    return cPayloadKinds[static_cast<int32_t>(aType) + 1];
+  }
+
   static constexpr char cStrInvalid[cStringSize] = "Invalid";
   static constexpr char cStrDoorState[][cStringSize] = {"Invalid", "Open", "Closed"};
   static constexpr char cStrSprayChangeState[][cStringSize] = { "Invalid", "Upper", "Lower", "Both" };
@@ -167,7 +208,8 @@ public:
                                                          "MachineState   ",
                                                          "RemainingTime  ",
                                                          "TimeFactChanged",
-                                                         "KeyPressed     " };
+                                                         "KeyPressed     ",
+                                                         "Count          " };
   static constexpr char cStrInt[] = "";
 
 private:
@@ -184,14 +226,38 @@ private:
     MachineState     mMachineState;
   };
 
+  static constexpr PayloadKind getKindOf(DoorState) noexcept    { return PayloadKind::Door; }
+  static constexpr PayloadKind getKindOf(OnOffState) noexcept   { return PayloadKind::OnOff; }
+  static constexpr PayloadKind getKindOf(int32_t) noexcept      { return PayloadKind::Int; }
+  static constexpr PayloadKind getKindOf(Error) noexcept        { return PayloadKind::Error; }
+  static constexpr PayloadKind getKindOf(Actuate) noexcept      { return PayloadKind::Actuate; }
+  static constexpr PayloadKind getKindOf(Program) noexcept      { return PayloadKind::Program; }
+  static constexpr PayloadKind getKindOf(MachineState) noexcept { return PayloadKind::MachineState; }
+
+  void set(DoorState const aArg) noexcept    { mDoor = aArg; }
+  void set(OnOffState const aArg) noexcept   { mOnOff = aArg; }
+  void set(int32_t const aArg) noexcept      { mIntValue = aArg; }
+  void set(Error const aArg) noexcept        { mError = aArg; }
+  void set(Actuate const aArg) noexcept      { mActuate = aArg; }
+  void set(Program const aArg) noexcept      { mProgram = aArg; }
+  void set(MachineState const aArg) noexcept { mMachineState = aArg; }
+
 public:
   Event() noexcept {}
     // if possible, allow calls like Component::send(DoorState::Open)
   Event(DoorState const aArg) noexcept : mType(EventType::MeasuredDoor), mDoor(aArg) {
   }
 
-  Event(EventType const aType, OnOffState const aArg) noexcept;
-  Event(EventType const aType, int32_t const aArg) noexcept;
+  /// Creates an event whose value type is checked against cPayloadKinds at compile time,
+  /// like Event::make<EventType::DesiredCirc>(OnOffState::On).
+  template<EventType tType, typename tValue>
+  static Event make(tValue const aValue) noexcept {
+    static_assert(getPayloadKind(tType) == getKindOf(tValue{}), "Value type does not match the EventType.");
+    Event result;
+    result.mType = tType;
+    result.set(aValue);
+    return result;
+  }
 
   Event(Error const aArg) noexcept : mType(EventType::Error), mError(aArg) {
   }
@@ -213,8 +279,13 @@ public:
     return mType == EventType::MeasuredDoor ? mDoor : DoorState::Invalid;
   }
 
-  OnOffState getOnOff() const noexcept;
-  int32_t getIntValue() const noexcept;
+  OnOffState getOnOff() const noexcept {
+    return getPayloadKind(mType) == PayloadKind::OnOff ? mOnOff : OnOffState::Invalid;
+  }
+
+  int32_t getIntValue() const noexcept {
+    return getPayloadKind(mType) == PayloadKind::Int ? mIntValue : cInvalid;
+  }
 
   Error getError() const noexcept {
     return mType == EventType::Error ? mError : Error::Invalid;
@@ -232,6 +303,10 @@ public:
     return mType == EventType::MachineState ? mMachineState : MachineState::Invalid;
   }
 
+  /// False for a type or a value no component sends, like the ones of a corrupted journal.
+  /// The string getters and the components may index tables only with valid events.
+  bool isValid() const noexcept;
+
   char const * getValueConstStr() const noexcept;
 
   char const * getTypeConstStr() const noexcept {
@@ -242,6 +317,9 @@ private:
   int32_t getErrorStrIndex() const noexcept;
 };
 
+static_assert(sizeof(Event) == 8u, "Event should fit in a machine word.");
+static_assert(std::is_trivially_copyable<Event>::value, "Event is copied around by the lock-free queues.");
+
 
 class Dishwasher;
 
@@ -253,24 +331,86 @@ protected:
   static constexpr int32_t cMsInSecond          =      1000;
 
 private:
-  static constexpr int32_t cWatchdogPatInterval =    100000;  // 0.1s
-  static constexpr int32_t cSleepFinish         =    100000;
-  static constexpr int32_t cMessageQueueSize    =       128;
-  static constexpr int32_t cNoError             =         0;
-  static constexpr int32_t cTimerCount          =        20;
+  static constexpr int32_t cWatchdogPatInterval  =    100000;  // 0.1s
+  static constexpr int32_t cSleepFinish          =    100000;
+  static constexpr int32_t cMessageQueueSize     =       128;
+  /// Reserved for the safety events, so a backlog of measurements can not fill it.
+  static constexpr int32_t cPriorityQueueSize    =        16;
+  static constexpr int32_t cNoError              =         0;
+  static constexpr int32_t cTimerInitialCapacity =        20;
+
+  /// Queue entry. The sequence numbers come from the Dishwasher and are used to merge the rings
+  /// in sending order in the per sender mode. The enqueue time is used for statistics.
+  struct QueuedEvent final {
+    uint64_t sequence;
+    int64_t  enqueued;  /// us
+    Event    event;
+  };
+
+  typedef SpscRing<QueuedEvent> Ring;
+
+  /// One level of the queue. Uses either the shared queue or the per sender rings.
+  struct Lane final {
+    int32_t const capacity;
+
+    /// Used in the shared queue mode.
+    boost::lockfree::queue<QueuedEvent> queue;
+
+    /// Used in the per sender mode, one for each sender. Empty in the shared mode.
+    std::vector<std::unique_ptr<Ring>> rings;
+
+    Lane(int32_t const aCapacity) : capacity(aCapacity), queue(aCapacity) {
+    }
+  };
+
+  /// The safety events may bypass the routine lane, and are popped before any routine event.
+  /// This reordering is intended, their order is kept within the lane only. See shouldOvertake.
+  static constexpr uint32_t cPriorityTypes = 1u << static_cast<int32_t>(EventType::MeasuredDoor)
+                                           | 1u << static_cast<int32_t>(EventType::MeasuredLeak)
+                                           | 1u << static_cast<int32_t>(EventType::Error);
 
   std::thread mThread;
 
-  boost::lockfree::queue<Event> mQueue;
+  /// Position in the Dishwasher component list, identifies this as a sender.
+  int32_t mIndex = 0;
+
+  Lane mRoutine;
+  Lane mPriority;
+
+  /// Set by the sender thread when a ring is full, raised by this thread, because it has to
+  /// send the error as the only producer of its own rings.
+  std::atomic<bool> mRingOverflow = false;
+
+  /// The queue is drained into this before processing, so superseded measurements can be dropped.
+  std::vector<QueuedEvent> mBatch;
+
+  /// Bit n is set if events of EventType n may be coalesced, see shouldCoalesce.
+  uint32_t mCoalescedTypes = 0u;
+
+  /// Bit n is set if events of EventType n go to the priority lane, see shouldOvertake.
+  uint32_t mPriorityTypes = 0u;
+  static_assert(static_cast<int32_t>(EventType::Count) <= 32, "mCoalescedTypes needs more bits.");
 
   /// A MachineState::Shutdown fill set it false if needed
   std::atomic<bool> mKeepRunning = true;
 
-  std::condition_variable mConditionVariable;
+  /// Number of queued but not yet popped events. The producer making it non-zero signals mNotifier.
+  std::atomic<int32_t> mQueuedCount = 0;
+
+  Notifier mNotifier;
+
+  ComponentStatistics mStatistics;
+
+  /// Owned by the Dishwasher, set on attach.
+  SharedError const *mSharedError = nullptr;
+
+  /// Epoch of the shared error word when mErrorSoFar was last updated from it.
+  uint32_t mErrorEpoch = 0u;
 
 protected:
-  /** All errors are ORed together here. */
-  std::atomic<int32_t> mErrorSoFar = 0;
+  /** All errors are ORed together here. Updated from the shared error word by pollErrors
+  on each loop iteration, and by raise immediately. Accessed only from the own thread. */
+  int32_t mErrorSoFar = cNoError;
 
   TimerManager mTimerManager;
 
@@ -278,8 +418,9 @@ protected:
 
   /** This and derived constructors may throw exception if some library or hardware component fails.
   This and derived constructors will initialize all the needed libraries and hardware. */
-  Component() : mQueue(cMessageQueueSize), mTimerManager(cTimerCount, cWatchdogPatInterval) {
-    mKeepRunning.store(mQueue.is_lock_free() && mTimerManager);
+  Component() : mRoutine(cMessageQueueSize), mPriority(cPriorityQueueSize), mTimerManager(cTimerInitialCapacity, cWatchdogPatInterval) {
+    mBatch.reserve(cMessageQueueSize);
+    mKeepRunning.store(mRoutine.queue.is_lock_free() && mPriority.queue.is_lock_free() && mTimerManager && mNotifier);
   }
 
 public:
@@ -290,18 +431,61 @@ public:
   Component& operator=(Component const &) = delete;
   Component& operator=(Component &&) = default;
 
+  /// Called by the Dishwasher on construction, before any event is sent.
+  /// @param aIndex position in the component list.
+  /// @param aSenderCount number of per sender rings to create, 0 to use the shared queue.
+  /// May throw std::bad_alloc.
+  void prepareQueues(int32_t const aIndex, int32_t const aSenderCount);
+
+  int32_t getIndex() const noexcept {
+    return mIndex;
+  }
+
+  char const * getName() const noexcept {
+    return getTaskName();
+  }
+
+  /// May be read from any thread while running.
+  ComponentStatistics const & getStatistics() const noexcept {
+    return mStatistics;
+  }
+
+  /// Logs the snapshot of the statistics.
+  void logStatistics() const noexcept;
+
+  void attach(Dishwasher * const aDishwasher) noexcept;
+
   void start(Dishwasher * const aDishwasher) {
-    mDishwasher = aDishwasher;
+    attach(aDishwasher);
     mThread = std::thread(&Component::run, this);
   }
 
   void stop() {
     mKeepRunning.store(false);
+    mNotifier.signal();
     mThread.join();
   }
 
-  /// Queues the event if it is interesting for this class.
-  void queueEvent(Event const &) noexcept;
+  /// Returns true if events of this type should be delivered here.
+  /// Time factor changes are always delivered. Errors are delivered only if shouldBeQueued
+  /// wants them in order with the other events, otherwise pollErrors picks them up.
+  bool isSubscribed(EventType const aType) const noexcept {
+    return aType == EventType::TimeFactorChanged || shouldBeQueued(aType);
+  }
+
+  /// Queues the event. The Dishwasher calls it only for subscribed event types.
+  /// @param aSender index of the sending component, used only in the per sender mode.
+  /// @param aSequence position in the global sending order, used only in the per sender mode.
+  void queueEvent(int32_t const aSender, uint64_t const aSequence, Event const &aEvent) noexcept;
+
+  /// Used by the simulator instead of run() to process the expired timers and the queued events once.
+  /// @return true if anything was processed.
+  bool step() noexcept;
+
+  /// Absolute expiration time of the next timer in us, if any.
+  std::optional<int64_t> getNextExpiration() const noexcept {
+    return mTimerManager.getEarliestExpiration();
+  }
 
 protected:
   virtual char const * getTaskName() const noexcept = 0;
@@ -309,18 +493,56 @@ protected:
   /// Returns true if the thread should exit on error, false otherwise.
   virtual bool shouldHaltOnError() const noexcept = 0;
 
-  /// Does not have to check for errors or timed events, since they are handle independently.
-  virtual bool shouldBeQueued(Event const &) const noexcept = 0;
+  /// Does not have to check for timed events, since they are handle independently. Errors are
+  /// needed only if they must be processed in order with the other events.
+  /// Called only once for each EventType on Dishwasher construction to build the subscriber table.
+  virtual bool shouldBeQueued(EventType const aType) const noexcept = 0;
+
+  /// Returns true if only the latest queued event of this type is interesting, so the earlier
+  /// ones waiting in the same batch may be dropped. Called only once for each EventType on attach.
+  /// Errors and time factor changes are never coalesced.
+  virtual bool shouldCoalesce(EventType const) const noexcept {
+    return false;
+  }
+
+  /// Returns true if events of this safety type may overtake the routine events queued before
+  /// them, so the reaction time is bounded regardless of the measurement load. Components which
+  /// need all their events in sending order return false. Called only once for each EventType
+  /// in cPriorityTypes on Dishwasher construction.
+  virtual bool shouldOvertake(EventType const) const noexcept {
+    return true;
+  }
 
   void send(Event const &) noexcept;
 
-  void send(EventType const aType, int32_t const aValue) noexcept {
-    send(Event(aType, aValue));
+  template<EventType tType, typename tValue>
+  void send(tValue const aValue) noexcept {
+    send(Event::make<tType>(aValue));
   }
 
   /// By the time we get here, all other components are initialized and ready to start.
   void run() noexcept;
 
+  /// Updates mErrorSoFar from the shared error word.
+  /// @return true if new errors were raised since the last call.
+  bool pollErrors() noexcept;
+
+  /// @return true if any timer expired.
+  bool processExpiredTimers();
+
+  /// Pops the earliest event of the priority lane, or of the routine lane if that is empty.
+  /// @return false if there was nothing to pop.
+  bool popEvent(QueuedEvent &aEvent) noexcept;
+
+  /// Pops the earliest event from the shared queue or from the front of the rings of the lane.
+  /// @return false if there was nothing to pop.
+  static bool popEvent(Lane &aLane, QueuedEvent &aEvent) noexcept;
+
+  /// Drains the queue into mBatch, drops the superseded events of the coalesced types
+  /// and processes the rest in arrival order. Repeats until the queue is empty.
+  /// @return true if any event was processed.
+  bool processQueuedEvents();
+
   /// Used only in Display to update LCD or Curses.
   virtual void refresh() noexcept {
   }
@@ -331,7 +553,8 @@ protected:
   /// Processes a timer event. Implementation will cast it to the actual enum class.
   virtual void process(int32_t const) noexcept = 0;
 
-  /// Handles it here and sends to other components.
+  /// Handles it here and in the shared error word. The Dishwasher sends it to the subscribers
+  /// only if it was not raised before, so a flapping signal does not flood the queues.
   void raise(Error const aError) noexcept;
 
   /// Handles it here and sends to other components.
@@ -340,9 +563,11 @@ protected:
     raise(aError);
   }
 
-  void ensure(bool const aCondition) {
-    if(aCondition) {
-      throw std::logic_error("ensure");
+  /// Raises Error::Programmer if the condition does not hold. Does not throw,
+  /// because it is called from the noexcept process functions.
+  void ensure(bool const aCondition) noexcept {
+    if(!aCondition) {
+      raise(Error::Programmer, "ensure");
     }
     else { // nothing to do
     }
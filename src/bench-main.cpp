@@ -0,0 +1,596 @@
+#include "logic.h"
+#include "automat.h"
+#include "staticerror.h"
+#include "plant.h"
+#include "accounting.h"
+#include "dishwash.h"
+#include "LogStdThreadOstream.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Micro benchmarks of the event path, printed as CSV. The components are replaced by sinks
+ * subscribed to the same event types as the real ones, so only the routing and the queues are
+ * measured. Usage:
+ *   route [events]  events/s through Dishwasher::send under the virtual clock, with the subscriber
+ *                   table and with the former loop over all components asking each one
+ *   queue [events]  deliveries/s and queue latency between sender and receiver threads, in both
+ *                   Dishwasher::QueueMode with the same topology, events per sender
+ *   format [calls]  ns per number conversion of the Log and of its former division loop for all
+ *                   the LogFormat presets, calls per measurement. Fails if the integers differ. */
+
+/// Counts the events, subscribed like the component it was made from.
+class Sink final : public Component {
+  uint32_t mSubscribed = 0u;
+  uint64_t mProcessedCount = 0u;
+
+public:
+  Sink(Component const &aModel) noexcept {
+    for(int32_t type = 0; type < static_cast<int32_t>(EventType::Count); ++type) {
+      if(aModel.isSubscribed(static_cast<EventType>(type))) {
+        mSubscribed |= 1u << type;
+      }
+      else { // nothing to do
+      }
+    }
+  }
+
+  virtual ~Sink() noexcept {
+  }
+
+  uint64_t getProcessedCount() const noexcept {
+    return mProcessedCount;
+  }
+
+protected:
+  virtual char const * getTaskName() const noexcept override {
+    return "sink   ";
+  }
+
+  virtual bool shouldHaltOnError() const noexcept override {
+    return false;
+  }
+
+  virtual bool shouldBeQueued(EventType const aType) const noexcept override {
+    return (mSubscribed & 1u << static_cast<int32_t>(aType)) != 0u;
+  }
+
+private:
+  virtual void process(Event const &) noexcept override {
+    ++mProcessedCount;
+  }
+
+  virtual void process(int32_t const) noexcept override {
+  }
+};
+
+class RouteBenchmark final {
+  static constexpr int64_t cDefaultEventCount = 4000000;
+  /// The queues are drained so often, well below their capacity.
+  static constexpr int32_t cDrainInterval     = 32;
+
+  int64_t const mEventCount;
+  /// Measurements dominate, like while a program runs.
+  std::vector<Event> const mEvents;
+  std::vector<std::unique_ptr<Sink>> mSinks;
+  std::unique_ptr<Dishwasher> mDishwasher;
+
+public:
+  RouteBenchmark(int64_t const aEventCount)
+  : mEventCount(aEventCount > 0 ? aEventCount : cDefaultEventCount)
+  , mEvents({ Event::make<EventType::MeasuredWaterLevel>(120),
+              Event::make<EventType::MeasuredTemperature>(45),
+              Event::make<EventType::MeasuredCircCurrent>(900),
+              Event::make<EventType::MeasuredWaterLevel>(121),
+              Event::make<EventType::MeasuredTemperature>(46),
+              Event::make<EventType::MeasuredDrainCurrent>(0),
+              Event::make<EventType::MeasuredSpray>(OnOffState::On),
+              Event::make<EventType::RemainingTime>(42) }) {
+    TimerManager::useVirtualClock(0);
+    Logic logic;
+    Automat automat;
+    StaticError staticError;
+    Plant plant;
+    Accounting accounting;
+    for(Component const *model : std::initializer_list<Component const*>{ &logic, &automat, &staticError, &plant, &accounting }) {
+      mSinks.push_back(std::make_unique<Sink>(*model));
+    }
+    mDishwasher = std::make_unique<Dishwasher>(std::initializer_list<Component*>{ mSinks[0].get(), mSinks[1].get(), mSinks[2].get(), mSinks[3].get(), mSinks[4].get() });
+    for(auto &sink : mSinks) {
+      sink->attach(mDishwasher.get());
+    }
+  }
+
+  void run() {
+    std::printf("routing,events,processed,events_per_s\n");
+    measure("table", [this](Event const &aEvent){
+      mDishwasher->send(nullptr, aEvent);
+    });
+    measure("broadcast", [this](Event const &aEvent){
+      broadcast(aEvent);
+    });
+  }
+
+private:
+  /// Dishwasher::send before the subscriber table: every component is asked for every event.
+  void broadcast(Event const &aEvent) noexcept {
+    Log::i(nowtech::LogApp::cEvent) << aEvent.getTypeConstStr() << ':' << aEvent.getValueConstStr() << " (" << aEvent.getIntValue() << ')' << Log::end;
+    for(auto &sink : mSinks) {
+      if(sink->isSubscribed(aEvent.getType())) {
+        sink->queueEvent(0, 0u, aEvent);
+      }
+      else { // nothing to do
+      }
+    }
+  }
+
+  template<typename tSend>
+  void measure(char const * const aName, tSend const &aSend) {
+    uint64_t processedBefore = getProcessedCount();
+    auto start = std::chrono::steady_clock::now();
+    for(int64_t i = 0; i < mEventCount; ++i) {
+      aSend(mEvents[i % mEvents.size()]);
+      if(i % cDrainInterval == cDrainInterval - 1) {
+        drain();
+      }
+      else { // nothing to do
+      }
+    }
+    drain();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%s,%lld,%llu,%.0f\n", aName, static_cast<long long>(mEventCount),
+      static_cast<unsigned long long>(getProcessedCount() - processedBefore), mEventCount / seconds);
+  }
+
+  void drain() noexcept {
+    for(auto &sink : mSinks) {
+      sink->step();
+    }
+  }
+
+  uint64_t getProcessedCount() const noexcept {
+    uint64_t result = 0u;
+    for(auto const &sink : mSinks) {
+      result += sink->getProcessedCount();
+    }
+    return result;
+  }
+};
+
+/// Receives the events of the senders on its own thread and counts them for each sender.
+class Peer final : public Component {
+public:
+  static constexpr int32_t cMaxSenders = 8;
+
+private:
+  bool const mReceiving;
+  std::array<std::atomic<uint64_t>, cMaxSenders> mProcessedCounts;
+
+public:
+  /// @param aReceiving if false, it only serves as the origin of the events of a sender thread.
+  Peer(bool const aReceiving) noexcept : mReceiving(aReceiving) {
+    for(auto &count : mProcessedCounts) {
+      count.store(0u);
+    }
+  }
+
+  virtual ~Peer() noexcept {
+  }
+
+  uint64_t getProcessedCount(int32_t const aSender) const noexcept {
+    return mProcessedCounts[aSender].load(std::memory_order_acquire);
+  }
+
+protected:
+  virtual char const * getTaskName() const noexcept override {
+    return "peer   ";
+  }
+
+  virtual bool shouldHaltOnError() const noexcept override {
+    return false;
+  }
+
+  virtual bool shouldBeQueued(EventType const aType) const noexcept override {
+    return mReceiving && aType == EventType::MeasuredWaterLevel;
+  }
+
+private:
+  /// The value is the index of the sender.
+  virtual void process(Event const &aEvent) noexcept override {
+    mProcessedCounts[aEvent.getIntValue()].fetch_add(1u, std::memory_order_release);
+  }
+
+  virtual void process(int32_t const) noexcept override {
+  }
+};
+
+class QueueBenchmark final {
+  static constexpr int64_t cDefaultEventCount = 200000;
+  static constexpr int32_t cSenderCount       = 3;
+  static constexpr int32_t cReceiverCount     = 3;
+  /// Events of a sender not yet processed by all the receivers. Together they fit in the shared queue.
+  static constexpr uint64_t cWindow           = 32u;
+  static_assert(cSenderCount <= Peer::cMaxSenders, "Peer counts too few senders.");
+
+  int64_t const mEventCount;
+
+public:
+  QueueBenchmark(int64_t const aEventCount) : mEventCount(aEventCount > 0 ? aEventCount : cDefaultEventCount) {
+  }
+
+  void run() {
+    std::printf("queue_mode,senders,receivers,deliveries,deliveries_per_s,dropped,p50_us,p99_us,p999_us,max_us\n");
+    measure("shared", Dishwasher::QueueMode::Shared);
+    measure("per_sender", Dishwasher::QueueMode::PerSender);
+  }
+
+private:
+  void measure(char const * const aName, Dishwasher::QueueMode const aQueueMode) {
+    std::vector<std::unique_ptr<Peer>> peers;
+    for(int32_t i = 0; i < cSenderCount + cReceiverCount; ++i) {
+      peers.push_back(std::make_unique<Peer>(i >= cSenderCount));
+    }
+    Dishwasher dishwasher({ peers[0].get(), peers[1].get(), peers[2].get(), peers[3].get(), peers[4].get(), peers[5].get() }, aQueueMode);
+    static_assert(cSenderCount + cReceiverCount == 6, "The component list above must hold all the peers.");
+    for(int32_t i = 0; i < cSenderCount; ++i) {
+      peers[i]->attach(&dishwasher);
+    }
+    for(int32_t i = cSenderCount; i < cSenderCount + cReceiverCount; ++i) {
+      peers[i]->start(&dishwasher);
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> senders;
+    for(int32_t i = 0; i < cSenderCount; ++i) {
+      senders.emplace_back(&QueueBenchmark::send, this, std::ref(dishwasher), std::ref(peers), i);
+    }
+    for(auto &sender : senders) {
+      sender.join();
+    }
+    for(int32_t i = 0; i < cSenderCount; ++i) {
+      waitForReceivers(peers, i, mEventCount);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t dropped = 0u;
+    LatencyHistogram::Snapshot worst{};
+    for(int32_t i = cSenderCount; i < cSenderCount + cReceiverCount; ++i) {
+      peers[i]->stop();
+      ComponentStatistics const &statistics = peers[i]->getStatistics();
+      dropped += statistics.droppedEvents.load();
+      LatencyHistogram::Snapshot snapshot = statistics.queueLatency.snapshot();
+      worst.p50 = std::max(worst.p50, snapshot.p50);
+      worst.p99 = std::max(worst.p99, snapshot.p99);
+      worst.p999 = std::max(worst.p999, snapshot.p999);
+      worst.max = std::max(worst.max, snapshot.max);
+    }
+    int64_t deliveries = mEventCount * cSenderCount * cReceiverCount;
+    std::printf("%s,%d,%d,%lld,%.0f,%llu,%lld,%lld,%lld,%lld\n", aName, cSenderCount, cReceiverCount,
+      static_cast<long long>(deliveries), deliveries / seconds, static_cast<unsigned long long>(dropped),
+      static_cast<long long>(worst.p50), static_cast<long long>(worst.p99), static_cast<long long>(worst.p999),
+      static_cast<long long>(worst.max));
+  }
+
+  /// Runs on the thread of the sender, using its peer as the origin.
+  void send(Dishwasher &aDishwasher, std::vector<std::unique_ptr<Peer>> &aPeers, int32_t const aSender) noexcept {
+    for(int64_t sent = 0; sent < mEventCount; ++sent) {
+      if(sent >= static_cast<int64_t>(cWindow)) {
+        waitForReceivers(aPeers, aSender, sent - cWindow + 1);
+      }
+      else { // nothing to do
+      }
+      aDishwasher.send(aPeers[aSender].get(), Event::make<EventType::MeasuredWaterLevel>(aSender));
+    }
+  }
+
+  /// Waits until all the receivers have processed aCount events of the sender.
+  static void waitForReceivers(std::vector<std::unique_ptr<Peer>> const &aPeers, int32_t const aSender, int64_t const aCount) noexcept {
+    for(int32_t i = cSenderCount; i < cSenderCount + cReceiverCount; ++i) {
+      while(static_cast<int64_t>(aPeers[i]->getProcessedCount(aSender)) < aCount) {
+        std::this_thread::yield();
+      }
+    }
+  }
+};
+
+/// Collects the text like a Chunk does.
+struct TextSink final {
+  std::string text;
+
+  void push(char const aCh) {
+    text.push_back(aCh);
+  }
+};
+
+/// Only sums the characters, so the sink costs next to nothing.
+struct SumSink final {
+  uint64_t sum = 0u;
+
+  void push(char const aCh) noexcept {
+    sum += static_cast<uint8_t>(aCh);
+  }
+};
+
+/// The number conversion of the Log before the digit pair table and std::to_chars,
+/// kept as the reference for the output and the speed.
+class ReferenceFormat final {
+  static constexpr char cDigit2char[16] = {
+    '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f'
+  };
+
+  nowtech::LogConfig const &mConfig;
+  std::vector<char> mBuffer;
+
+public:
+  ReferenceFormat(nowtech::LogConfig const &aConfig)
+  : mConfig(aConfig)
+  , mBuffer(aConfig.appendStackBufferLength + 1u) {
+  }
+
+  /// One division per digit.
+  template<typename tSink, typename T>
+  void convert(tSink &aSink, nowtech::LogFormat const aFormat, T const aValue) noexcept {
+    T const base = static_cast<T>(aFormat.base);
+    if(base != 2 && base != 10 && base != 16) {
+      aSink.push('#');
+      return;
+    }
+    else { // nothing to do
+    }
+    if(mConfig.appendBasePrefix && base == 2) {
+      aSink.push('0');
+      aSink.push('b');
+    }
+    else { // nothing to do
+    }
+    if(mConfig.appendBasePrefix && base == 16) {
+      aSink.push('0');
+      aSink.push('x');
+    }
+    else { // nothing to do
+    }
+    T tmpValue = aValue;
+    uint32_t where = 0u;
+    do {
+      T mod = tmpValue % base;
+      if(mod < 0) {
+        mod = -mod;
+      }
+      else { // nothing to do
+      }
+      mBuffer[where] = cDigit2char[mod];
+      ++where;
+      tmpValue /= base;
+    }
+    while(tmpValue != 0 && where <= mConfig.appendStackBufferLength);
+    if(where > mConfig.appendStackBufferLength) {
+      aSink.push('#');
+      return;
+    }
+    else { // nothing to do
+    }
+    if(aValue < 0) {
+      aSink.push('-');
+    }
+    else if(mConfig.alignSigned && aFormat.fill > 0) {
+      aSink.push(' ');
+    }
+    else { // nothing to do
+    }
+    for(uint32_t fill = aFormat.fill; fill > where; --fill) {
+      aSink.push('0');
+    }
+    for(--where; where > 0; --where) {
+      aSink.push(mBuffer[where]);
+    }
+    aSink.push(mBuffer[0]);
+  }
+
+  /// Truncates all the digits but the last one.
+  template<typename tSink>
+  void convert(tSink &aSink, nowtech::LogFormat const aFormat, double const aValue) noexcept {
+    if(std::isnan(aValue)) {
+      push(aSink, "nan");
+    }
+    else if(std::isinf(aValue)) {
+      push(aSink, "inf");
+    }
+    else if(aValue == 0.0) {
+      aSink.push('0');
+    }
+    else {
+      double value = aValue;
+      if(value < 0) {
+        value = -value;
+        aSink.push('-');
+      }
+      else if(mConfig.alignSigned) {
+        aSink.push(' ');
+      }
+      else { // nothing to do
+      }
+      double mantissa = floor(log10(value));
+      double normalized = value / pow(10.0, mantissa);
+      int firstDigit;
+      for(uint8_t i = 1; i < aFormat.fill; i++) {
+        firstDigit = std::min(static_cast<int>(normalized), 9);
+        aSink.push(cDigit2char[firstDigit]);
+        normalized = 10.0 * (normalized - firstDigit);
+        if(i == 1) {
+          aSink.push('.');
+        }
+        else { // nothing to do
+        }
+      }
+      firstDigit = std::min(static_cast<int>(round(normalized)), 9);
+      aSink.push(cDigit2char[firstDigit]);
+      aSink.push('e');
+      if(mantissa >= 0) {
+        aSink.push('+');
+      }
+      else { // nothing to do
+      }
+      convert(aSink, nowtech::LogConfig::cDefault, static_cast<int32_t>(mantissa));
+    }
+  }
+
+private:
+  template<typename tSink>
+  static void push(tSink &aSink, char const *aText) noexcept {
+    while(*aText != 0) {
+      aSink.push(*aText);
+      ++aText;
+    }
+  }
+};
+
+constexpr char ReferenceFormat::cDigit2char[16];
+
+class FormatBenchmark final {
+  static constexpr int64_t cDefaultCallCount = 200000;
+  static constexpr size_t  cValueCount       = 4096u;
+
+  struct Preset {
+    char const        *name;
+    nowtech::LogFormat format;
+  };
+
+  /// All the presets of LogConfig. Doubles use only the fill, so for them the decimal ones are enough.
+  static constexpr Preset cPresets[] = {
+    { "cDefault", nowtech::LogConfig::cDefault }, { "cNone", nowtech::LogConfig::cNone },
+    { "cB4", nowtech::LogConfig::cB4 }, { "cB8", nowtech::LogConfig::cB8 }, { "cB12", nowtech::LogConfig::cB12 },
+    { "cB16", nowtech::LogConfig::cB16 }, { "cB24", nowtech::LogConfig::cB24 }, { "cB32", nowtech::LogConfig::cB32 },
+    { "cD1", nowtech::LogConfig::cD1 }, { "cD2", nowtech::LogConfig::cD2 }, { "cD3", nowtech::LogConfig::cD3 },
+    { "cD4", nowtech::LogConfig::cD4 }, { "cD5", nowtech::LogConfig::cD5 }, { "cD6", nowtech::LogConfig::cD6 },
+    { "cD7", nowtech::LogConfig::cD7 }, { "cD8", nowtech::LogConfig::cD8 },
+    { "cX1", nowtech::LogConfig::cX1 }, { "cX2", nowtech::LogConfig::cX2 }, { "cX3", nowtech::LogConfig::cX3 },
+    { "cX4", nowtech::LogConfig::cX4 }, { "cX6", nowtech::LogConfig::cX6 }, { "cX8", nowtech::LogConfig::cX8 }
+  };
+
+  int64_t const mCallCount;
+  ReferenceFormat mReference;
+  /// Random lengths, so every digit count is measured.
+  std::vector<int32_t>  mInt32s;
+  std::vector<uint32_t> mUint32s;
+  std::vector<int64_t>  mInt64s;
+  std::vector<uint64_t> mUint64s;
+  std::vector<double>   mDoubles;
+  int64_t mIntegerMismatches = 0;
+  /// Written with the sums of the sinks, so the loops are not optimized away.
+  static volatile uint64_t sChecksum;
+
+public:
+  FormatBenchmark(int64_t const aCallCount, nowtech::LogConfig const &aConfig)
+  : mCallCount(aCallCount > 0 ? aCallCount : cDefaultCallCount)
+  , mReference(aConfig) {
+    std::mt19937_64 random(1u);
+    for(size_t i = 0u; i < cValueCount; ++i) {
+      mInt32s.push_back(static_cast<int32_t>(random()) >> random() % 32u);
+      mUint32s.push_back(static_cast<uint32_t>(random()) >> random() % 32u);
+      mInt64s.push_back(static_cast<int64_t>(random()) >> random() % 64u);
+      mUint64s.push_back(random() >> random() % 64u);
+      mDoubles.push_back(static_cast<double>(static_cast<int64_t>(random())) / std::pow(10.0, static_cast<double>(random() % 40u)));
+    }
+    mInt32s[0] = std::numeric_limits<int32_t>::min();
+    mInt32s[1] = std::numeric_limits<int32_t>::max();
+    mUint32s[0] = std::numeric_limits<uint32_t>::max();
+    mInt64s[0] = std::numeric_limits<int64_t>::min();
+    mInt64s[1] = std::numeric_limits<int64_t>::max();
+    mUint64s[0] = std::numeric_limits<uint64_t>::max();
+    mDoubles[0] = -0.1;
+  }
+
+  /// @return false if an integer conversion differs from the reference.
+  bool run() {
+    std::printf("type,preset,values,mismatches,old_ns,new_ns\n");
+    for(Preset const &preset : cPresets) {
+      measure("int32", preset, mInt32s);
+      measure("uint32", preset, mUint32s);
+      measure("int64", preset, mInt64s);
+      measure("uint64", preset, mUint64s);
+    }
+    for(Preset const &preset : cPresets) {
+      if(preset.format.base == 10u) {
+        measure("double", preset, mDoubles);
+      }
+      else { // nothing to do
+      }
+    }
+    return mIntegerMismatches == 0;
+  }
+
+private:
+  template<typename T>
+  void measure(char const * const aType, Preset const &aPreset, std::vector<T> const &aValues) {
+    int64_t mismatches = 0;
+    for(T const value : aValues) {
+      TextSink old;
+      mReference.convert(old, aPreset.format, value);
+      TextSink current;
+      Log::convert(current, aPreset.format, value);
+      if(old.text != current.text) {
+        ++mismatches;
+      }
+      else { // nothing to do
+      }
+    }
+    if(std::is_integral<T>::value) {
+      mIntegerMismatches += mismatches;
+    }
+    else { // nothing to do
+    }
+    SumSink sink;
+    auto start = std::chrono::steady_clock::now();
+    for(int64_t i = 0; i < mCallCount; ++i) {
+      mReference.convert(sink, aPreset.format, aValues[i % aValues.size()]);
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for(int64_t i = 0; i < mCallCount; ++i) {
+      Log::convert(sink, aPreset.format, aValues[i % aValues.size()]);
+    }
+    auto end = std::chrono::steady_clock::now();
+    sChecksum = sink.sum;
+    std::printf("%s,%s,%zu,%lld,%.1f,%.1f\n", aType, aPreset.name, aValues.size(), static_cast<long long>(mismatches),
+      std::chrono::duration<double, std::nano>(middle - start).count() / mCallCount,
+      std::chrono::duration<double, std::nano>(end - middle).count() / mCallCount);
+  }
+};
+
+constexpr FormatBenchmark::Preset FormatBenchmark::cPresets[];
+volatile uint64_t FormatBenchmark::sChecksum;
+
+int main(int argc, char **argv) {
+  int result = 0;
+  // Nothing is registered, like in the sweep, so the event log costs only the check.
+  nowtech::LogConfig logConfig;
+  logConfig.allowRegistrationLog = false;
+  nowtech::LogStdThreadOstream osInterface(std::cerr, logConfig);
+  nowtech::Log log(osInterface, logConfig);
+  int64_t count = (argc > 2 ? atoll(argv[2]) : 0);
+  if(argc > 1 && strcmp(argv[1], "route") == 0) {
+    RouteBenchmark benchmark(count);
+    benchmark.run();
+  }
+  else if(argc > 1 && strcmp(argv[1], "queue") == 0) {
+    QueueBenchmark benchmark(count);
+    benchmark.run();
+  }
+  else if(argc > 1 && strcmp(argv[1], "format") == 0) {
+    FormatBenchmark benchmark(count, logConfig);
+    result = benchmark.run() ? 0 : 1;
+  }
+  else {
+    std::cerr << "Usage: " << argv[0] << " route|queue|format [events|calls]\n";
+    result = 1;
+  }
+  return result;
+}
@@ -0,0 +1,1149 @@
+#include "accounting.h"
+#include "dishwash.h"
+#include "heatcontroller.h"
+#include "journal.h"
+#include "pumpmonitor.h"
+#include "sharederror.h"
+#include "spraycalibration.h"
+#include "staticerror.h"
+#include "timer.h"
+#include "watercontroller.h"
+#include "LogStdThreadOstream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/** Repeatable checks of the components and their parts, each one a ctest test. Usage:
+ *   check-dishwash <check>
+ * A check prints each failed expectation on stderr, and the exit code is 1 if there was any.
+ * The components run on the calling thread under the virtual clock, see Dishwasher::simulate,
+ * so the results do not depend on the machine. */
+
+/// Collects the failed expectations of a check.
+class Check final {
+  char const * const mName;
+  int32_t mFailureCount = 0;
+
+public:
+  Check(char const * const aName) noexcept : mName(aName) {
+  }
+
+  bool expect(bool const aCondition, char const * const aWhat) {
+    if(!aCondition) {
+      std::cerr << mName << ": " << aWhat << '\n';
+      ++mFailureCount;
+    }
+    else { // nothing to do
+    }
+    return aCondition;
+  }
+
+  /// Prints the values too on failure.
+  bool expectNear(double const aActual, double const aExpected, double const aTolerance, char const * const aWhat) {
+    bool result = std::abs(aActual - aExpected) <= aTolerance;
+    if(!result) {
+      std::cerr << mName << ": " << aWhat << ": " << aActual << " instead of " << aExpected << '\n';
+      ++mFailureCount;
+    }
+    else { // nothing to do
+    }
+    return result;
+  }
+
+  bool hasPassed() const noexcept {
+    return mFailureCount == 0;
+  }
+};
+
+/// Sends external events to the components at the given virtual times, and lets them process
+/// the events at once. TimerManager::useVirtualClock must be called before the components are constructed.
+class Simulation final {
+  Dishwasher mDishwasher;
+
+public:
+  Simulation(std::initializer_list<Component*> aComponents, Dishwasher::QueueMode const aQueueMode = Dishwasher::QueueMode::Shared)
+  : mDishwasher(aComponents, aQueueMode) {
+    // attaches the components
+    mDishwasher.simulate(0);
+  }
+
+  /// @param aTime us, not earlier than the previous one.
+  void send(int64_t const aTime, Event const &aEvent) {
+    TimerManager::advanceVirtualClock(aTime);
+    mDishwasher.send(nullptr, aEvent);
+    mDishwasher.simulate(0);
+  }
+
+  Dishwasher & getDishwasher() noexcept {
+    return mDishwasher;
+  }
+};
+
+namespace {
+
+constexpr int64_t cUsInSecond = 1000000;
+
+/// A completed run with each meter in one state, then a run aborted by an error.
+bool checkAccounting() {
+  Check check("accounting");
+  TimerManager::useVirtualClock(0);
+  Accounting accounting;
+  Simulation simulation({ &accounting });
+  simulation.send(0, Event::make<EventType::Program>(Program::Fast));
+  simulation.send(0, Event::make<EventType::MeasuredTemperature>(20));
+  simulation.send(0, Event::make<EventType::MachineState>(MachineState::Drain));
+  simulation.send(10 * cUsInSecond, Event::make<EventType::Actuate>(Actuate::Drain1));
+  simulation.send(70 * cUsInSecond, Event::make<EventType::Actuate>(Actuate::Drain0));
+  simulation.send(100 * cUsInSecond, Event::make<EventType::MachineState>(MachineState::Wash));
+  simulation.send(100 * cUsInSecond, Event::make<EventType::Actuate>(Actuate::Fill1));
+  simulation.send(130 * cUsInSecond, Event::make<EventType::Actuate>(Actuate::Fill0));
+  simulation.send(200 * cUsInSecond, Event::make<EventType::Actuate>(Actuate::Heat1));
+  simulation.send(300 * cUsInSecond, Event::make<EventType::MeasuredTemperature>(30));
+  // repeated by Automat on each measurement
+  simulation.send(300 * cUsInSecond, Event::make<EventType::Actuate>(Actuate::Heat1));
+  simulation.send(500 * cUsInSecond, Event::make<EventType::MeasuredTemperature>(45));
+  simulation.send(560 * cUsInSecond, Event::make<EventType::Actuate>(Actuate::Heat0));
+  // not heating, no rise
+  simulation.send(580 * cUsInSecond, Event::make<EventType::MeasuredTemperature>(47));
+  simulation.send(600 * cUsInSecond, Event::make<EventType::MachineState>(MachineState::Idle));
+  simulation.send(700 * cUsInSecond, Event::make<EventType::MachineState>(MachineState::Drain));
+  simulation.send(700 * cUsInSecond, Event::make<EventType::Actuate>(Actuate::Circ1));
+  simulation.send(760 * cUsInSecond, Event::make<EventType::Error>(Error::CircOverload));
+
+  if(check.expect(accounting.getRunCount() == 2, "two runs")) {
+    Accounting::Run const &completed = accounting.getRun(1);
+    check.expect(completed.completed, "the first run completed");
+    check.expect(completed.program == Program::Fast, "the first run is Fast");
+    check.expectNear(completed.length, 600000.0, 0.0, "length ms");
+    check.expectNear(completed.onTimes[static_cast<int32_t>(MachineState::Drain)][static_cast<int32_t>(Accounting::Meter::Drain)], 60000.0, 0.0, "drain ms in Drain");
+    check.expectNear(completed.onTimes[static_cast<int32_t>(MachineState::Wash)][static_cast<int32_t>(Accounting::Meter::Fill)], 30000.0, 0.0, "fill ms in Wash");
+    check.expectNear(completed.getOnTime(Accounting::Meter::Heat), 360000.0, 0.0, "heat ms");
+    check.expectNear(completed.getEnergy(), 0.1 * Config::cHeaterPower / 1000.0, 1e-9, "energy kWh");
+    check.expectNear(completed.getWater(), 30.0 * Config::cFillFlowRate / 1000.0, 1e-9, "water l");
+    check.expectNear(completed.getPumpHours(), 60.0 / 3600.0, 1e-9, "pump h");
+    check.expectNear(completed.heatingRise, 25.0, 0.0, "heating rise C");
+    check.expect(completed.errors == 0, "no errors in the first run");
+
+    Accounting::Run const &aborted = accounting.getRun(0);
+    check.expect(!aborted.completed, "the second run aborted");
+    check.expect(aborted.errors == static_cast<int32_t>(Error::CircOverload), "the error of the second run");
+    check.expectNear(aborted.getOnTime(Accounting::Meter::Circ), 60000.0, 0.0, "circulation ms");
+  }
+  else { // nothing to do
+  }
+  return check.hasPassed();
+}
+
+/// Water heated through an element, which starts heating aLag seconds after switch-on and goes on
+/// for aLag seconds after switch-off. So the overshoot is aRate * aLag, as HeatController assumes.
+class Water final {
+  double const mRate;
+  std::vector<bool> mElement;
+  size_t mNext = 0u;
+  double mTemperature;
+
+public:
+  /// @param aRate K/s while on
+  /// @param aLag s
+  Water(double const aRate, int32_t const aLag, double const aTemperature)
+  : mRate(aRate), mElement(aLag, false), mTemperature(aTemperature) {
+  }
+
+  /// One second.
+  void step(bool const aOn) noexcept {
+    if(mElement[mNext]) {
+      mTemperature += mRate;
+    }
+    else { // nothing to do
+    }
+    mElement[mNext] = aOn;
+    mNext = (mNext + 1u) % mElement.size();
+  }
+
+  void setTemperature(double const aTemperature) noexcept {
+    mTemperature = aTemperature;
+  }
+
+  /// The sensor gives whole degrees.
+  int32_t measure() const noexcept {
+    return static_cast<int32_t>(mTemperature);
+  }
+};
+
+/// Heats the water like Automat does in on-off mode, sampling each second.
+/// @return the highest temperature reached.
+int32_t heat(HeatController &aController, Water &aWater, int32_t const aTarget, int64_t &aNow) {
+  bool on = false;
+  int32_t peak = 0;
+  aController.setTarget(aTarget);
+  for(int32_t second = 0; second < 3600; ++second) {
+    int32_t temperature = aWater.measure();
+    peak = std::max(peak, temperature);
+    aController.measure(temperature, aNow);
+    bool decided = aController.decide();
+    if(decided != on) {
+      aController.switched(decided, aNow);
+      on = decided;
+    }
+    else { // nothing to do
+    }
+    aWater.step(on);
+    aNow += cUsInSecond;
+  }
+  aController.setTarget(0);
+  return peak;
+}
+
+/// The overshoot falls as the rate and the lag of the water are learnt, and the PWM on-time is proportional near the target.
+bool checkHeatController() {
+  Check check("heatcontroller");
+  double const rate = 0.08;
+  int32_t const lag = 40;
+  HeatController controller(0);
+  Water water(rate, lag, 20.0);
+  int64_t now = 0;
+  int32_t firstPeak = heat(controller, water, 65, now);
+  check.expect(firstPeak > 65 + 1, "the first heating overshoots with the default lag");
+  int32_t lastPeak = 0;
+  for(int32_t i = 0; i < 4; ++i) {
+    water.setTemperature(20.0);
+    lastPeak = heat(controller, water, 65, now);
+  }
+  check.expect(lastPeak < firstPeak, "learning lowers the overshoot");
+  check.expectNear(lastPeak, 65.0, 1.0, "peak after learning");
+  check.expectNear(controller.getRate(), rate, rate * 0.15, "learnt rate K/s");
+  check.expectNear(controller.getLag(), lag, lag * 0.3, "learnt lag s");
+
+  int32_t const period = 20 * cUsInSecond;
+  HeatController pwm(period);
+  pwm.setTarget(60);
+  pwm.measure(50, 0);
+  check.expectNear(pwm.getPwmOnTime(), period, 0.0, "full period far from the target");
+  pwm.measure(58, cUsInSecond);
+  check.expectNear(pwm.getPwmOnTime(), period / 2.0, 1.0, "half period 2 K below the target");
+  pwm.measure(61, 2 * cUsInSecond);
+  check.expectNear(pwm.getPwmOnTime(), 0.0, 0.0, "no heating over the target");
+  return check.hasPassed();
+}
+
+/// The sump, filled through a pipe which delivers the water aLag seconds after the valve, and
+/// emptied by the drain pump down to the level the pump can not take out.
+class Sump final {
+  double const mFillRate;
+  double const mDrainRate;
+  double const mResidual;
+  std::vector<bool> mPipe;
+  size_t mNext = 0u;
+  double mLevel = 0.0;
+
+public:
+  /// @param aFillRate mm/s
+  /// @param aDrainRate mm/s
+  /// @param aLag s, at least 1
+  /// @param aResidual mm
+  Sump(double const aFillRate, double const aDrainRate, int32_t const aLag, double const aResidual = 0.0)
+  : mFillRate(aFillRate), mDrainRate(aDrainRate), mResidual(aResidual), mPipe(aLag, false), mLevel(aResidual) {
+  }
+
+  /// One second.
+  void step(WaterController::Flow const aFlow) noexcept {
+    if(mPipe[mNext]) {
+      mLevel += mFillRate;
+    }
+    else { // nothing to do
+    }
+    mPipe[mNext] = (aFlow == WaterController::Flow::Fill);
+    mNext = (mNext + 1u) % mPipe.size();
+    if(aFlow == WaterController::Flow::Drain) {
+      mLevel = std::max(mResidual, mLevel - mDrainRate);
+    }
+    else { // nothing to do
+    }
+  }
+
+  /// The sensor gives whole mm.
+  int32_t measure() const noexcept {
+    return static_cast<int32_t>(mLevel);
+  }
+};
+
+/// Controls the level towards aTarget like Automat does, sampling each second for aLength seconds.
+/// @return the flow needed at the end.
+WaterController::Flow control(WaterController &aController, Sump &aSump, int32_t const aTarget, int32_t const aLength, int64_t &aNow) {
+  WaterController::Flow flow = aController.start(aTarget, aSump.measure(), aNow);
+  for(int32_t second = 0; second < aLength; ++second) {
+    aSump.step(flow);
+    aNow += cUsInSecond;
+    flow = aController.measure(aSump.measure(), aNow);
+  }
+  return flow;
+}
+
+/// The fill and drain rates are learnt and the fill stops at the target, a slow or fast flow raises
+/// an error, a new target is compared with the current level, and a residual level within the
+/// hysteresis counts as empty.
+bool checkWaterController() {
+  Check check("watercontroller");
+  double const fillRate = 3.5;
+  double const drainRate = 3.0;
+  WaterController controller;
+  Sump sump(fillRate, drainRate, 2);
+  int64_t now = 0;
+  control(controller, sump, Config::cWaterLevelFull, 120, now);
+  check.expect(sump.measure() > Config::cWaterLevelFull + Config::cWaterLevelHisteresis, "the first fill overshoots with the default lag");
+  for(int32_t i = 0; i < 3; ++i) {
+    control(controller, sump, 0, 120, now);
+    check.expectNear(sump.measure(), 0.0, 0.0, "drained level mm");
+    control(controller, sump, Config::cWaterLevelFull, 120, now);
+    check.expectNear(sump.measure(), Config::cWaterLevelFull + Config::cWaterLevelHisteresis / 2.0, Config::cWaterLevelHisteresis / 2.0, "filled level mm");
+  }
+  check.expect(controller.getError() == Error::None, "no error while the flow follows the model");
+  check.expectNear(controller.getFillRate(), fillRate, fillRate * 0.15, "learnt fill rate mm/s");
+  check.expectNear(controller.getDrainRate(), drainRate, drainRate * 0.15, "learnt drain rate mm/s");
+
+  WaterController fresh;
+  check.expect(fresh.start(0, Config::cWaterLevelHalf, 0) == WaterController::Flow::Drain, "draining the water found at start");
+
+  WaterController residual;
+  Sump puddle(fillRate, drainRate, 2, 2.0);
+  now = 0;
+  check.expect(control(residual, puddle, 0, 30, now) == WaterController::Flow::None, "a puddle is not drained");
+  control(residual, puddle, Config::cWaterLevelFull, 120, now);
+  for(int32_t const level : { 1, Config::cWaterLevelHisteresis }) {
+    Sump leveling(fillRate, drainRate, 2, level);
+    control(residual, leveling, Config::cWaterLevelFull, 120, now);
+    check.expect(control(residual, leveling, 0, 120, now) == WaterController::Flow::None, "draining stops above empty");
+  }
+  check.expect(residual.getError() == Error::None, "no NoDrain on a residual level");
+
+  WaterController noWater;
+  Sump clogged(0.2, drainRate, 1);
+  now = 0;
+  control(noWater, clogged, Config::cWaterLevelFull, 30, now);
+  check.expect(noWater.getError() == Error::NoWater, "NoWater on a clogged inlet");
+
+  // from the default rate the target is reached before a fast flow could be noticed
+  WaterController overFill;
+  Sump slow(1.0, drainRate, 1);
+  now = 0;
+  control(overFill, slow, Config::cWaterLevelFull, 150, now);
+  check.expect(overFill.getError() == Error::None, "no error on a slow inlet");
+  control(overFill, slow, 0, 60, now);
+  Sump burst(5.0, drainRate, 1);
+  control(overFill, burst, Config::cWaterLevelFull, 30, now);
+  check.expect(overFill.getError() == Error::OverFill, "OverFill when the inlet gets much faster than learnt");
+  return check.hasPassed();
+}
+
+/// The spray selector cam, its segments aFactor times the nominal ones. The contact is on in the odd segments.
+class Cam final {
+  static constexpr int64_t cNominal[SprayCalibration::cSegmentCount] = {
+    Config::cSprayChangeUpOn, Config::cSprayChangeUpOff, Config::cSprayChangeDownOn,
+    Config::cSprayChangeDownOff, Config::cSprayChangeBothOn, Config::cSprayChangeBothOff
+  };
+
+  std::array<int64_t, SprayCalibration::cSegmentCount> mSegments;
+  int32_t mSegment = 0;
+  /// us spent in the current segment.
+  int64_t mPosition = 0;
+
+public:
+  Cam(double const aFactor, int32_t const aSegment, int64_t const aPosition) noexcept
+  : mSegment(aSegment), mPosition(aPosition) {
+    setSpeed(aFactor);
+  }
+
+  /// @param aFactor segment length relative to the nominal one.
+  void setSpeed(double const aFactor) noexcept {
+    for(int32_t i = 0; i < SprayCalibration::cSegmentCount; ++i) {
+      mSegments[i] = static_cast<int64_t>(cNominal[i] * aFactor);
+    }
+  }
+
+  void turn(int64_t const aLength) noexcept {
+    mPosition += aLength;
+    while(mPosition >= mSegments[mSegment]) {
+      mPosition -= mSegments[mSegment];
+      mSegment = (mSegment + 1) % SprayCalibration::cSegmentCount;
+    }
+  }
+
+  int32_t getSegment() const noexcept {
+    return mSegment;
+  }
+
+  OnOffState getContact() const noexcept {
+    return mSegment % 2 == 1 ? OnOffState::On : OnOffState::Off;
+  }
+};
+
+constexpr int64_t Cam::cNominal[];
+
+/// Runs the motor for aLength us, measuring the contact each 100 ms.
+void turn(SprayCalibration &aCalibration, Cam &aCam, int64_t const aLength, int64_t &aNow) {
+  int64_t const period = cUsInSecond / 10;
+  aCalibration.motor(true);
+  for(int64_t elapsed = 0; elapsed < aLength; elapsed += period) {
+    aCam.turn(period);
+    aNow += period;
+    aCalibration.contact(aCam.getContact(), aNow);
+  }
+  aCalibration.motor(false);
+}
+
+/// The search finds the position and the speed of a slow cam, the model is persisted and loaded
+/// again, it follows the cam slowing down further, and a contradicting contact invalidates the position.
+bool checkSprayCalibration() {
+  Check check("spraycalibration");
+  char const * const filename = "spraycalibration-check.txt";
+  std::remove(filename);
+  int64_t const nominalCycle = Config::cSprayChangeUpOn + Config::cSprayChangeUpOff + Config::cSprayChangeDownOn
+                             + Config::cSprayChangeDownOff + Config::cSprayChangeBothOn + Config::cSprayChangeBothOff;
+  int64_t now = 0;
+  Cam cam(1.1, 2, 2 * cUsInSecond);
+  {
+    SprayCalibration calibration(filename);
+    check.expect(!calibration.isValid(), "a search is needed without a model");
+    calibration.contact(cam.getContact(), now);
+    calibration.startSearch();
+    turn(calibration, cam, Config::cSprayChangeSearch, now);
+    check.expect(calibration.fit(), "the search fits");
+    check.expect(calibration.isValid(), "valid after the fit");
+    check.expect(calibration.getSegment() == cam.getSegment(), "the segment found by the fit");
+    check.expectNear(calibration.scale(nominalCycle), 1.1 * nominalCycle, 0.02 * nominalCycle, "fitted cycle us");
+    calibration.save(true);
+  }
+  {
+    SprayCalibration calibration(filename);
+    calibration.contact(cam.getContact(), now);
+    check.expect(calibration.isValid(), "valid after loading");
+    check.expect(calibration.getSegment() == cam.getSegment(), "the loaded segment");
+    check.expectNear(calibration.scale(nominalCycle), 1.1 * nominalCycle, 0.02 * nominalCycle, "loaded cycle us");
+    cam.setSpeed(1.2);
+    for(int32_t i = 0; i < 3; ++i) {
+      turn(calibration, cam, 4 * nominalCycle, now);
+    }
+    check.expect(calibration.isValid(), "valid while tracking");
+    check.expect(calibration.getSegment() == cam.getSegment(), "the tracked segment");
+    check.expectNear(calibration.scale(nominalCycle), 1.2 * nominalCycle, 0.03 * nominalCycle, "tracked cycle us");
+    calibration.save(true);
+  }
+  {
+    // the cam was moved by hand to a segment of the other contact state
+    OnOffState const persisted = cam.getContact();
+    while(cam.getContact() == persisted) {
+      cam.turn(cUsInSecond / 10);
+    }
+    SprayCalibration calibration(filename);
+    calibration.contact(cam.getContact(), now);
+    check.expect(!calibration.isValid(), "a contact contradicting the persisted segment needs a search");
+  }
+  std::remove(filename);
+  return check.hasPassed();
+}
+
+/// A timer scheduled in the model of the TimerManager heap.
+struct ModelTimer final {
+  int64_t expiration;
+  int32_t action;
+  TimerManager::Handle handle;
+  bool pending;
+};
+
+/// Schedules aCount timers at random times and lengths, some of them equal, into both.
+void schedule(TimerManager &aTimers, std::vector<ModelTimer> &aModel, int32_t const aCount, uint64_t &aRandom, int64_t &aNow) {
+  for(int32_t i = 0; i < aCount; ++i) {
+    aRandom ^= aRandom << 13u;
+    aRandom ^= aRandom >> 7u;
+    aRandom ^= aRandom << 17u;
+    aNow += static_cast<int64_t>(aRandom % 3u) * cUsInSecond;
+    TimerManager::advanceVirtualClock(aNow);
+    int64_t length = static_cast<int64_t>(aRandom % 50u) * cUsInSecond;
+    int32_t action = static_cast<int32_t>(aModel.size());
+    aModel.push_back(ModelTimer{ aNow + length, action, aTimers.schedule(length, action), true });
+  }
+}
+
+/// Pops the expired timers at aNow.
+/// @return false if one came out of order or was not pending.
+bool pop(TimerManager &aTimers, std::vector<ModelTimer> &aModel, int64_t const aNow) {
+  TimerManager::advanceVirtualClock(aNow);
+  bool result = true;
+  for(std::optional<int32_t> action = aTimers.pop(); action; action = aTimers.pop()) {
+    // the earliest pending one, the earlier scheduled on equal expirations
+    auto expected = std::find_if(aModel.begin(), aModel.end(), [](ModelTimer const &aTimer){ return aTimer.pending; });
+    for(auto i = expected; i != aModel.end(); ++i) {
+      if(i->pending && i->expiration < expected->expiration) {
+        expected = i;
+      }
+      else { // nothing to do
+      }
+    }
+    result = result && expected != aModel.end() && expected->action == action.value() && expected->expiration <= aNow;
+    aModel[action.value()].pending = false;
+  }
+  return result;
+}
+
+/// The timers expire in order after cancelling them from the middle of the heap, a stale handle
+/// does not cancel the timer reusing its slot, and the timers stop while paused.
+bool checkTimer() {
+  Check check("timer");
+  {
+    TimerManager::useVirtualClock(0);
+    // smaller than the timer count, so the heap grows
+    TimerManager timers(4, cUsInSecond);
+    std::vector<ModelTimer> model;
+    uint64_t random = 0x9e3779b97f4a7c15u;
+    int64_t now = 0;
+    schedule(timers, model, 200, random, now);
+    for(size_t i = 0u; i < model.size(); i += 3u) {
+      check.expect(timers.cancel(model[i].handle), "a pending timer is cancelled");
+      model[i].pending = false;
+    }
+    check.expect(pop(timers, model, now), "the expired timers in order");
+    for(size_t i = 1u; i < model.size(); i += 4u) {
+      check.expect(timers.cancel(model[i].handle) == model[i].pending, "only the pending timers are cancelled");
+      model[i].pending = false;
+    }
+    schedule(timers, model, 100, random, now);
+    for(size_t i = 200u; i < model.size(); i += 2u) {
+      timers.cancel(model[i].handle);
+      model[i].pending = false;
+    }
+    for(int64_t until = now; until <= now + 50 * cUsInSecond; until += cUsInSecond) {
+      check.expect(pop(timers, model, until), "the timers in order after cancelling from the middle");
+    }
+    check.expect(std::none_of(model.begin(), model.end(), [](ModelTimer const &aTimer){ return aTimer.pending; }), "all the timers expired");
+    check.expect(!timers.getEarliestExpiration(), "the heap is empty");
+  }
+  {
+    TimerManager::useVirtualClock(0);
+    TimerManager timers(4, cUsInSecond);
+    std::vector<ModelTimer> model;
+    // heap 1, 10, 2, 11, 12, 3, 4: the last one replacing 11 must go above 10
+    for(int64_t length : { 1, 10, 2, 11, 12, 3, 4 }) {
+      int32_t action = static_cast<int32_t>(model.size());
+      model.push_back(ModelTimer{ length * cUsInSecond, action, timers.schedule(length * cUsInSecond, action), true });
+    }
+    check.expect(timers.cancel(model[3].handle), "the timer in the middle is cancelled");
+    model[3].pending = false;
+    // leaves after it, so it is not popped from the end before 10
+    for(int64_t length : { 20, 21, 22, 23 }) {
+      int32_t action = static_cast<int32_t>(model.size());
+      model.push_back(ModelTimer{ length * cUsInSecond, action, timers.schedule(length * cUsInSecond, action), true });
+    }
+    check.expect(pop(timers, model, 30 * cUsInSecond), "the timers in order after the last one moved up");
+  }
+  {
+    TimerManager::useVirtualClock(0);
+    TimerManager timers(4, cUsInSecond);
+    TimerManager::Handle first = timers.schedule(10 * cUsInSecond, 1);
+    check.expect(timers.cancel(first), "the first timer is cancelled");
+    TimerManager::Handle second = timers.schedule(20 * cUsInSecond, 2);
+    check.expect(!timers.cancel(first), "a stale handle does not cancel the timer in its slot");
+    check.expect(!timers.cancel(TimerManager::cInvalidHandle), "the invalid handle cancels nothing");
+    check.expect(!timers.cancel(first + 1000u), "a handle of a slot never used cancels nothing");
+    TimerManager::advanceVirtualClock(20 * cUsInSecond);
+    std::optional<int32_t> action = timers.pop();
+    check.expect(action && action.value() == 2, "the timer in the reused slot expires");
+    check.expect(!timers.cancel(second), "an expired timer is not cancelled");
+  }
+  {
+    TimerManager::useVirtualClock(0);
+    TimerManager timers(4, cUsInSecond);
+    timers.schedule(100 * cUsInSecond, 7);
+    TimerManager::advanceVirtualClock(40 * cUsInSecond);
+    timers.pause();
+    check.expect(!timers.getEarliestExpiration(), "no expiration while paused");
+    TimerManager::advanceVirtualClock(120 * cUsInSecond);
+    check.expect(!timers.pop(), "nothing expires while paused");
+    check.expectNear(timers.getPlanTime(), 40.0 * cUsInSecond, 0.0, "plan time stopped while paused us");
+    timers.resume();
+    check.expectNear(timers.getPlanTime(), 40.0 * cUsInSecond, 0.0, "plan time after resuming us");
+    check.expect(timers.getEarliestExpiration() == 180 * cUsInSecond, "the expiration moved by the pause");
+    TimerManager::advanceVirtualClock(180 * cUsInSecond - 1);
+    check.expect(!timers.pop(), "not expired before the moved expiration");
+    TimerManager::advanceVirtualClock(180 * cUsInSecond);
+    std::optional<int32_t> action = timers.pop();
+    check.expect(action && action.value() == 7, "expired after the pause");
+    check.expectNear(timers.getPlanTime(), 100.0 * cUsInSecond, 0.0, "plan time at the expiration us");
+  }
+  return check.hasPassed();
+}
+
+/// Events sent at their virtual time in us.
+using Script = std::vector<std::pair<int64_t, Event>>;
+
+/// Sends the events to a fresh StaticError. Once an error is raised, the components get only errors.
+/// @return the errors raised.
+int32_t runStaticError(Script const &aScript) {
+  TimerManager::useVirtualClock(0);
+  StaticError staticError;
+  Simulation simulation({ &staticError });
+  for(auto const &item : aScript) {
+    simulation.send(item.first, item.second);
+  }
+  return static_cast<int32_t>(SharedError::getErrors(simulation.getDishwasher().getSharedError().load()));
+}
+
+/// A hard maximum is raised on the first sample over it, an out of range signal only if the whole window is
+/// out of range, and the pump current limits are masked while the inrush current settles.
+bool checkStaticError() {
+  Check check("staticerror");
+  int32_t const tooCold = Config::cTempRangeMin - 2;
+  Script spikes;
+  for(int32_t i = 0; i < 4; ++i) {
+    spikes.emplace_back(i * cUsInSecond, Event::make<EventType::MeasuredTemperature>(20));
+  }
+  spikes.emplace_back(4 * cUsInSecond, Event::make<EventType::MeasuredTemperature>(tooCold));
+  spikes.emplace_back(5 * cUsInSecond, Event::make<EventType::MeasuredWaterLevel>(Config::cWaterLevelRangeMin - 5));
+  spikes.emplace_back(6 * cUsInSecond, Event::make<EventType::MeasuredTemperature>(20));
+  check.expect(runStaticError(spikes) == static_cast<int32_t>(Error::None), "single spikes filtered");
+
+  Script cold = spikes;
+  for(int32_t i = 0; i < 4; ++i) {
+    cold.emplace_back((7 + i) * cUsInSecond, Event::make<EventType::MeasuredTemperature>(tooCold));
+  }
+  check.expect(runStaticError(cold) == static_cast<int32_t>(Error::InvalidTemp), "temperature out of range in the whole window");
+
+  check.expect(runStaticError({ { 0, Event::make<EventType::MeasuredTemperature>(Config::cTempMax + Config::cTempHisteresis + 1) } })
+               == static_cast<int32_t>(Error::Overheat), "overheat on the first sample");
+  check.expect(runStaticError({ { 0, Event::make<EventType::MeasuredWaterLevel>(Config::cWaterLevelMax + 1) } })
+               == static_cast<int32_t>(Error::OverFill), "overfill on the first sample");
+
+  Script inrush = {
+    { 0, Event::make<EventType::Actuate>(Actuate::Circ1) },
+    { Config::cCurrentSettleTime / 2, Event::make<EventType::MeasuredCircCurrent>(Config::cCirculateCurrentMax + 100) },
+    { Config::cCurrentSettleTime - 1, Event::make<EventType::MeasuredCircCurrent>(Config::cCirculateCurrentMax + 100) }
+  };
+  check.expect(runStaticError(inrush) == static_cast<int32_t>(Error::None), "inrush current masked");
+  inrush.emplace_back(Config::cCurrentSettleTime, Event::make<EventType::MeasuredCircCurrent>(Config::cCirculateCurrentMax + 100));
+  check.expect(runStaticError(inrush) == static_cast<int32_t>(Error::CircOverload), "overload after settling");
+  return check.hasPassed();
+}
+
+/// Feeds aCurrent and aCurrent + aSpread alternately to the monitor each 100 ms from aNow for aLength us.
+/// @return the first error, and aNow is its time, or the end if there was none.
+Error sample(PumpMonitor &aMonitor, int32_t const aCurrent, int32_t const aSpread, int64_t const aLength, int64_t &aNow) {
+  int64_t const period = cUsInSecond / 10;
+  int64_t const end = aNow + aLength;
+  Error result = Error::None;
+  for(int32_t i = 0; result == Error::None && aNow < end; ++i) {
+    aNow += period;
+    result = aMonitor.measure(aCurrent + (i % 2) * aSpread, aNow);
+  }
+  return result;
+}
+
+/// A normal pump raises nothing and its statistics are kept, a running pump drawing too little and an off
+/// pump drawing current raise their errors within two blocks after the settle time.
+bool checkPumpMonitor() {
+  Check check("pumpmonitor");
+  int64_t const latency = Config::cCurrentSettleTime + 10 * cUsInSecond / 10;
+  int64_t now = 0;
+  PumpMonitor normal(Config::cCirculateCurrentMin, Error::CircConnector, Error::CircRelayStuck);
+  normal.expect(true, now);
+  check.expect(sample(normal, 240, 20, 31 * cUsInSecond / 10, now) == Error::None, "a running pump");
+  check.expectNear(normal.getLifetime().getCount(), 22.0, 0.0, "settled samples");
+  check.expectNear(normal.getLifetime().getMean(), 250.0, 1e-9, "mean mA");
+  check.expectNear(normal.getLifetime().getStdDev(), std::sqrt(22.0 / 21.0) * 10.0, 1e-9, "standard deviation mA");
+  normal.expect(false, now);
+  // spinning down
+  check.expect(sample(normal, 0, 0, 3 * cUsInSecond, now) == Error::None, "a stopped pump");
+  check.expectNear(normal.getLifetime().getCount(), 22.0, 0.0, "settled samples while stopped");
+
+  now = 0;
+  PumpMonitor connector(Config::cCirculateCurrentMin, Error::CircConnector, Error::CircRelayStuck);
+  connector.expect(true, now);
+  check.expect(sample(connector, 0, 0, Config::cCurrentSettleTime - 1, now) == Error::None, "no decision before settling");
+  check.expect(sample(connector, 20, 10, 3 * cUsInSecond, now) == Error::CircConnector, "a bad connector");
+  check.expect(now <= latency, "bad connector latency");
+
+  now = 0;
+  PumpMonitor stuck(Config::cDrainCurrentMin, Error::DrainConnector, Error::DrainRelayStuck);
+  stuck.expect(true, now);
+  check.expect(sample(stuck, 90, 0, 2 * cUsInSecond, now) == Error::None, "a running drain pump");
+  int64_t const stopped = now;
+  stuck.expect(false, now);
+  check.expect(sample(stuck, 90, 0, 3 * cUsInSecond, now) == Error::DrainRelayStuck, "a stuck relay");
+  check.expect(now - stopped <= latency, "stuck relay latency");
+  return check.hasPassed();
+}
+
+/// Only the fresh bits are returned and advance the epoch, also when threads race on overlapping bits.
+bool checkSharedError() {
+  Check check("sharederror");
+  {
+    SharedError error;
+    check.expect(error.raise(0x5) == 0x5, "fresh bits");
+    check.expect(error.raise(0x6) == 0x2, "only the fresh bit");
+    check.expect(error.raise(0x4) == 0, "no fresh bit");
+    uint64_t state = error.load();
+    check.expect(SharedError::getErrors(state) == 0x7u, "all the bits");
+    check.expect(SharedError::getEpoch(state) == 2u, "the epoch advanced on the fresh bits only");
+  }
+  {
+    // each thread raises its own bit and its neighbour's many times
+    constexpr int32_t cThreadCount = 16;
+    constexpr int32_t cRepeat = 1000;
+    SharedError error;
+    std::atomic<int32_t> fresh = 0;
+    std::atomic<int32_t> overlap = 0;
+    std::atomic<uint32_t> freshCalls = 0u;
+    std::vector<std::thread> threads;
+    for(int32_t i = 0; i < cThreadCount; ++i) {
+      threads.emplace_back([&error, &fresh, &overlap, &freshCalls, i](){
+        int32_t const bits = (1 << i) | (1 << (i + 1) % cThreadCount);
+        for(int32_t j = 0; j < cRepeat; ++j) {
+          int32_t raised = error.raise(bits);
+          if(raised != 0) {
+            overlap |= fresh.fetch_or(raised) & raised;
+            ++freshCalls;
+          }
+          else { // nothing to do
+          }
+        }
+      });
+    }
+    for(auto &thread : threads) {
+      thread.join();
+    }
+    uint64_t state = error.load();
+    check.expect(SharedError::getErrors(state) == (1u << cThreadCount) - 1u, "every bit raised");
+    check.expect(fresh.load() == (1 << cThreadCount) - 1, "every bit returned as fresh");
+    check.expect(overlap.load() == 0, "each bit returned as fresh once");
+    check.expect(SharedError::getEpoch(state) == freshCalls.load(), "one epoch per raise with fresh bits");
+  }
+  return check.hasPassed();
+}
+
+/// Records the types of the measurement events in the order of processing.
+class Recorder final : public Component {
+  bool const             mOvertake;
+  std::vector<EventType> mTypes;
+
+public:
+  Recorder(bool const aOvertake) noexcept : Component(), mOvertake(aOvertake) {
+  }
+
+  virtual ~Recorder() noexcept {
+  }
+
+  std::vector<EventType> const & getTypes() const noexcept {
+    return mTypes;
+  }
+
+protected:
+  virtual char const * getTaskName() const noexcept override {
+    return "recorder";
+  }
+
+  virtual bool shouldHaltOnError() const noexcept override {
+    return false;
+  }
+
+  virtual bool shouldBeQueued(EventType const aType) const noexcept override {
+    return aType >= EventType::MeasuredDoor && aType <= EventType::MeasuredTemperature;
+  }
+
+  virtual bool shouldOvertake(EventType const) const noexcept override {
+    return mOvertake;
+  }
+
+private:
+  virtual void process(Event const &aEvent) noexcept override {
+    mTypes.push_back(aEvent.getType());
+  }
+
+  virtual void process(int32_t const) noexcept override {
+  }
+};
+
+/// @return the order in which a Recorder processes a door event sent after two routine measurements.
+std::vector<EventType> overtake(bool const aOvertake, Dishwasher::QueueMode const aQueueMode) {
+  TimerManager::useVirtualClock(0);
+  Recorder recorder(aOvertake);
+  Simulation simulation({ &recorder }, aQueueMode);
+  simulation.getDishwasher().send(nullptr, Event::make<EventType::MeasuredTemperature>(20));
+  simulation.getDishwasher().send(nullptr, Event::make<EventType::MeasuredWaterLevel>(50));
+  simulation.send(0, Event::make<EventType::MeasuredDoor>(DoorState::Open));
+  return recorder.getTypes();
+}
+
+/// The safety events overtake the routine ones queued before them, unless the component asks for
+/// the sending order, in both queue modes.
+bool checkPriorityLanes() {
+  Check check("prioritylanes");
+  std::vector<EventType> const overtaken = { EventType::MeasuredDoor, EventType::MeasuredTemperature, EventType::MeasuredWaterLevel };
+  std::vector<EventType> const sent = { EventType::MeasuredTemperature, EventType::MeasuredWaterLevel, EventType::MeasuredDoor };
+  check.expect(overtake(true, Dishwasher::QueueMode::Shared) == overtaken, "the door overtakes in the shared queue");
+  check.expect(overtake(true, Dishwasher::QueueMode::PerSender) == overtaken, "the door overtakes in the per sender rings");
+  check.expect(overtake(false, Dishwasher::QueueMode::Shared) == sent, "sending order kept in the shared queue");
+  check.expect(overtake(false, Dishwasher::QueueMode::PerSender) == sent, "sending order kept in the per sender rings");
+  return check.hasPassed();
+}
+
+/// Short-lived threads, many more than the log rings, each log one message, and all of them arrive.
+bool checkLogRings() {
+  Check check("logrings");
+  constexpr int32_t cBatchCount = 30;
+  constexpr int32_t cBatchSize = 20;
+  // the transmitter writes the collected messages on refresh
+  constexpr uint32_t cRefreshPeriod = 50u;  // ms
+  std::ostringstream out;
+  {
+    nowtech::LogConfig logConfig;
+    logConfig.allowRegistrationLog = false;
+    logConfig.refreshPeriod = cRefreshPeriod;
+    // The threads over the registrable tasks share a task id, so longer messages of them would interleave.
+    logConfig.chunkSize = 32u;
+    nowtech::LogStdThreadOstream osInterface(out, logConfig);
+    nowtech::Log log(osInterface, logConfig);
+    for(int32_t batch = 0; batch < cBatchCount; ++batch) {
+      std::vector<std::thread> threads;
+      for(int32_t i = 0; i < cBatchSize; ++i) {
+        threads.emplace_back([batch, i](){
+          Log::registerCurrentTask("worker");
+          Log::i() << "message " << batch * cBatchSize + i << Log::end;
+        });
+      }
+      for(auto &thread : threads) {
+        thread.join();
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(3u * cRefreshPeriod));
+  }
+  std::string const text = out.str();
+  std::vector<bool> arrived(cBatchCount * cBatchSize, false);
+  std::istringstream lines(text);
+  std::string line;
+  while(std::getline(lines, line)) {
+    size_t position = line.find("message ");
+    if(position != std::string::npos) {
+      int32_t index = std::stoi(line.substr(position + 8u));
+      if(index >= 0 && index < cBatchCount * cBatchSize) {
+        arrived[index] = true;
+      }
+      else { // nothing to do
+      }
+    }
+    else { // nothing to do
+    }
+  }
+  check.expect(std::count(arrived.begin(), arrived.end(), true) == cBatchCount * cBatchSize, "every message arrived");
+  check.expect(text.find("Lost chunks") == std::string::npos, "no lost chunks");
+  return check.hasPassed();
+}
+
+/// @return what a Log writes for a fixed set of numbers, without the tick counts.
+std::string logNumbers(bool const aDeferred) {
+  constexpr uint32_t cRefreshPeriod = 50u;  // ms
+  std::ostringstream out;
+  {
+    nowtech::LogConfig logConfig;
+    logConfig.allowRegistrationLog = false;
+    logConfig.refreshPeriod = cRefreshPeriod;
+    logConfig.tickFormat = LC::cNone;
+    logConfig.deferredFormatting = aDeferred;
+    nowtech::LogStdThreadOstream osInterface(out, logConfig);
+    nowtech::Log log(osInterface, logConfig);
+    Log::registerCurrentTask("check");
+    Log::i() << int32_t(0) << ' ' << int32_t(-1) << ' ' << std::numeric_limits<int32_t>::min() << ' '
+             << std::numeric_limits<int32_t>::max() << ' ' << std::numeric_limits<uint32_t>::max() << Log::end;
+    Log::i() << std::numeric_limits<int64_t>::min() << ' ' << std::numeric_limits<int64_t>::max() << ' '
+             << std::numeric_limits<uint64_t>::max() << Log::end;
+    Log::i() << LC::cX4 << int32_t(255) << ' ' << LC::cB8 << uint32_t(5) << ' ' << LC::cD3 << int32_t(-7) << ' '
+             << LC::cX8 << int64_t(-2) << ' ' << LC::cB32 << uint64_t(0x80000001u) << Log::end;
+    Log::i() << int16_t(-300) << ' ' << uint8_t(200) << ' ' << 'c' << ' ' << true << " text" << Log::end;
+    Log::i() << 0.0 << ' ' << -1.5 << ' ' << 3.14159265358979 << ' ' << 1e-20 << ' ' << 6.02e23 << ' '
+             << std::numeric_limits<double>::infinity() << ' ' << std::nan("") << ' ' << 2.5f << Log::end;
+    Log::i() << LC::cD3 << 2.0 / 3.0 << ' ' << LC::cD1 << -0.05 << ' ' << LC::cD8 << 123456.789 << Log::end;
+    Log::send(int32_t(42), ' ', uint64_t(43), ' ', -4.25);
+    std::this_thread::sleep_for(std::chrono::milliseconds(3u * cRefreshPeriod));
+  }
+  return out.str();
+}
+
+/// The numbers recorded in binary and converted on the transmitter thread read the same as the ones
+/// converted on the logging thread.
+bool checkDeferredFormatting() {
+  Check check("deferredformatting");
+  std::string const immediate = logNumbers(false);
+  std::string const deferred = logNumbers(true);
+  check.expect(std::count(immediate.begin(), immediate.end(), '\n') == 7, "all the messages written");
+  if(!check.expect(deferred == immediate, "the same text when deferred")) {
+    std::cerr << "immediate:\n" << immediate << "deferred:\n" << deferred;
+  }
+  else { // nothing to do
+  }
+  return check.hasPassed();
+}
+
+/// The bytes of an Event, to write any type and value into a journal.
+struct RawEvent final {
+  int32_t type;
+  int32_t value;
+};
+
+/// JournalFormat::Record with a RawEvent.
+struct RawRecord final {
+  int64_t  timestamp;
+  int32_t  origin;
+  int32_t  reserved;
+  RawEvent event;
+};
+
+static_assert(sizeof(RawEvent) == sizeof(Event), "RawEvent must have the layout of Event.");
+static_assert(sizeof(RawRecord) == sizeof(JournalFormat::Record), "RawRecord must have the layout of JournalFormat::Record.");
+
+/// Writes a journal of external events at one second intervals.
+void writeJournal(char const * const aFilename, std::vector<RawEvent> const &aEvents, char const * const aName) {
+  JournalFormat::Header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, JournalFormat::cMagic, JournalFormat::cMagicSize);
+  header.recordSize = sizeof(JournalFormat::Record);
+  header.componentCount = 1;
+  std::memcpy(header.names[0], aName, std::min<size_t>(std::strlen(aName) + 1u, JournalFormat::cNameSize));
+  FILE *file = std::fopen(aFilename, "wb");
+  std::fwrite(&header, sizeof(header), 1u, file);
+  for(size_t i = 0u; i < aEvents.size(); ++i) {
+    RawRecord record{ static_cast<int64_t>(i) * cUsInSecond, JournalFormat::cExternalOrigin, 0, aEvents[i] };
+    std::fwrite(&record, sizeof(record), 1u, file);
+  }
+  std::fclose(file);
+}
+
+/// The records of a corrupted journal with types or values no component sends are counted and
+/// skipped on replay, and a header with a broken component name is rejected.
+bool checkJournal() {
+  Check check("journal");
+  char const * const filename = "journal-check.bin";
+  auto raw = [](EventType const aType, int32_t const aValue){
+    return RawEvent{ static_cast<int32_t>(aType), aValue };
+  };
+  std::vector<RawEvent> const events = {
+    raw(EventType::Program, static_cast<int32_t>(Program::Fast)),
+    raw(EventType::MachineState, static_cast<int32_t>(MachineState::Drain)),
+    raw(EventType::Program, 100000000),
+    raw(EventType::Count, 0),
+    { 999, 0 },
+    raw(EventType::Invalid, 0),
+    raw(EventType::MeasuredDoor, 7),
+    raw(EventType::Error, 1 << 25u),
+    raw(EventType::Error, static_cast<int32_t>(Error::NoDrain) | static_cast<int32_t>(Error::Leak)),
+    raw(EventType::Actuate, static_cast<int32_t>(Actuate::Spray1) + 1),
+    raw(EventType::MachineState, 77),
+    raw(EventType::MachineState, static_cast<int32_t>(MachineState::Idle))
+  };
+  writeJournal(filename, events, "recorder");
+  {
+    JournalReader journal(filename);
+    if(check.expect(journal, "the journal is read")) {
+      check.expect(journal.size() == events.size(), "all the records are read");
+      check.expect(journal.getInvalidCount() == 9u, "the invalid records are counted");
+      TimerManager::useVirtualClock(0);
+      Accounting accounting;
+      Simulation simulation({ &accounting });
+      simulation.getDishwasher().replay(journal);
+      if(check.expect(accounting.getRunCount() == 1, "the valid records are replayed")) {
+        check.expect(accounting.getRun(0).program == Program::Fast, "the program of the run");
+        check.expect(accounting.getRun(0).completed, "the run completed");
+      }
+      else { // nothing to do
+      }
+    }
+    else { // nothing to do
+    }
+  }
+  writeJournal(filename, events, "a component name without end");
+  check.expect(!JournalReader(filename), "a name without terminating zero is rejected");
+  std::remove(filename);
+  return check.hasPassed();
+}
+
+/// Collects the text like a Chunk does.
+struct TextSink final {
+  std::string text;
+
+  void push(char const aCh) {
+    text.push_back(aCh);
+  }
+};
+
+/// The conversion of the default LogConfig of main by the C library.
+template<typename T>
+std::string printNumber(nowtech::LogFormat const aFormat, T const aValue) {
+  bool const negative = aValue < 0;
+  uint64_t const magnitude = negative ? 0u - static_cast<uint64_t>(aValue) : static_cast<uint64_t>(aValue);
+  char buffer[80];
+  if(aFormat.base == 2) {
+    int32_t length = 0;
+    uint64_t rest = magnitude;
+    do {
+      buffer[length++] = static_cast<char>('0' + (rest & 1u));
+      rest >>= 1u;
+    } while(rest != 0u);
+    std::reverse(buffer, buffer + length);
+    buffer[length] = 0;
+  }
+  else {
+    snprintf(buffer, sizeof(buffer), aFormat.base == 16 ? "%llx" : "%llu", static_cast<unsigned long long>(magnitude));
+  }
+  std::string digits(buffer);
+  std::string result;
+  if(digits.size() > nowtech::LogConfig().appendStackBufferLength) {
+    result = "#";
+  }
+  else {
+    result = std::string(negative ? "-" : "") + std::string(std::max<int32_t>(0, aFormat.fill - static_cast<int32_t>(digits.size())), '0') + digits;
+  }
+  return result;
+}
+
+/// @return the number of values of type T converted differently by the Log and the C library.
+template<typename T>
+int32_t compareNumbers() {
+  static constexpr nowtech::LogFormat cFormats[] = {
+    LC::cDefault, LC::cB4, LC::cB8, LC::cB12, LC::cB16, LC::cB24, LC::cB32,
+    LC::cD1, LC::cD2, LC::cD3, LC::cD4, LC::cD5, LC::cD6, LC::cD7, LC::cD8,
+    LC::cX1, LC::cX2, LC::cX3, LC::cX4, LC::cX6, LC::cX8
+  };
+  std::vector<T> values = { 0, 1, 9, 10, 99, 100, 101, std::numeric_limits<T>::min(), std::numeric_limits<T>::max() };
+  for(T power = 10; power <= std::numeric_limits<T>::max() / 10; power *= 10) {
+    values.push_back(power - 1);
+    values.push_back(power);
+    values.push_back(static_cast<T>(0) - power);
+  }
+  // xorshift, shifted so that all the lengths appear
+  uint64_t random = 0x9e3779b97f4a7c15u;
+  for(int32_t i = 0; i < 10000; ++i) {
+    random ^= random << 13u;
+    random ^= random >> 7u;
+    random ^= random << 17u;
+    values.push_back(static_cast<T>(random >> (random % 64u)));
+  }
+  int32_t result = 0;
+  for(auto const format : cFormats) {
+    for(auto const value : values) {
+      TextSink sink;
+      Log::convert(sink, format, value);
+      if(sink.text != printNumber(format, value)) {
+        std::cerr << "numberformat: base " << static_cast<int32_t>(format.base) << " fill " << static_cast<int32_t>(format.fill) << ": " << sink.text << " instead of " << printNumber(format, value) << '\n';
+        ++result;
+      }
+      else { // nothing to do
+      }
+    }
+  }
+  return result;
+}
+
+/// The integers are converted like the C library does in all the preset formats, and the doubles are
+/// correctly rounded where std::to_chars is available.
+bool checkNumberFormat() {
+  Check check("numberformat");
+  check.expect(compareNumbers<int32_t>() == 0, "int32_t");
+  check.expect(compareNumbers<uint32_t>() == 0, "uint32_t");
+  check.expect(compareNumbers<int64_t>() == 0, "int64_t");
+  check.expect(compareNumbers<uint64_t>() == 0, "uint64_t");
+  struct Expected final {
+    nowtech::LogFormat format;
+    double value;
+    char const *text;
+  };
+  Expected const doubles[] = {
+    { LC::cD8, 0.0,                "0" },
+    { LC::cD8, -1.5,               "-1.5000000e+0" },
+    { LC::cD5, 2.5,                "2.5000e+0" },
+    { LC::cD3, 2.0 / 3.0,          "6.67e-1" },
+    { LC::cD1, -0.05,              "-5e-2" },
+    { LC::cD8, 123456.789,         "1.2345679e+5" },
+    { LC::cD8, 6.02e23,            "6.0200000e+23" },
+    { LC::cD8, 1e-300,             "1.0000000e-300" },
+    { LC::cD4, 9.9996,             "1.000e+1" },
+    { LC::cD8, std::numeric_limits<double>::infinity(), "inf" },
+    { LC::cD8, std::nan(""),       "nan" }
+  };
+  for(auto const &expected : doubles) {
+    TextSink sink;
+    Log::convert(sink, expected.format, expected.value);
+#if defined(__cpp_lib_to_chars)
+    if(!check.expect(sink.text == expected.text, "double")) {
+      std::cerr << "numberformat: " << sink.text << " instead of " << expected.text << '\n';
+    }
+    else { // nothing to do
+    }
+#else
+    // the digit by digit loop may differ in the last digit
+    check.expect(sink.text.size() == std::strlen(expected.text), "double length");
+#endif
+  }
+  return check.hasPassed();
+}
+
+struct CheckEntry final {
+  char const *name;
+  bool (*run)();
+  /// Creates its own Log, otherwise one writing to std::cerr is created for the check.
+  bool ownLog;
+};
+
+CheckEntry const cChecks[] = {
+  { "accounting",         checkAccounting,         false },
+  { "deferredformatting", checkDeferredFormatting, true  },
+  { "heatcontroller",     checkHeatController,     false },
+  { "journal",            checkJournal,            false },
+  { "logrings",           checkLogRings,           true  },
+  { "numberformat",       checkNumberFormat,       false },
+  { "prioritylanes",      checkPriorityLanes,      false },
+  { "pumpmonitor",        checkPumpMonitor,        false },
+  { "sharederror",        checkSharedError,        false },
+  { "spraycalibration",   checkSprayCalibration,   false },
+  { "staticerror",        checkStaticError,        false },
+  { "timer",              checkTimer,              false },
+  { "watercontroller",    checkWaterController,    false }
+};
+
+}
+
+int main(int argc, char **argv) {
+  int result = 1;
+  CheckEntry const *found = nullptr;
+  for(CheckEntry const &entry : cChecks) {
+    if(argc > 1 && strcmp(argv[1], entry.name) == 0) {
+      found = &entry;
+    }
+    else { // nothing to do
+    }
+  }
+  if(found != nullptr && found->ownLog) {
+    result = found->run() ? 0 : 1;
+  }
+  else if(found != nullptr) {
+    nowtech::LogConfig logConfig;
+    logConfig.allowRegistrationLog = false;
+    nowtech::LogStdThreadOstream osInterface(std::cerr, logConfig);
+    nowtech::Log log(osInterface, logConfig);
+    result = found->run() ? 0 : 1;
+  }
+  else {
+    std::cerr << "Usage: " << argv[0] << " <check>, one of";
+    for(CheckEntry const &entry : cChecks) {
+      std::cerr << ' ' << entry.name;
+    }
+    std::cerr << '\n';
+  }
+  return result;
+}
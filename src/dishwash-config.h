@@ -10,6 +10,8 @@
 // times are in us
 // heights in mm,
 // currents in mA
+// flows in ml/s
+// power in W
 
 class Config final {
 public:
@@ -38,6 +40,7 @@ public:
   static constexpr int32_t cTempHisteresis         =      2;
   static constexpr int32_t cTempRangeMin           =      5;
   static constexpr int32_t cTempRangeMax           =    100;
+  static constexpr int32_t cHeaterPwmPeriod        =      0; // 0 for on-off control
 
   static constexpr int32_t cSprayChangeUpOn        =   1000 * 1000;
   static constexpr int32_t cSprayChangeUpOff       =   6500 * 1000;
@@ -54,11 +57,16 @@ public:
   static constexpr int32_t cCirculateOnTime        =   2000 * 1000;
 
   static constexpr int32_t cSleepBeforeNextStep    =   5000 * 1000;
-  static constexpr int32_t cAverageFillDrainSeconds =   100;
   static constexpr int32_t cRegenerateValveTime    = 180000 * 1000;
-  static constexpr int32_t cResinWashTime          = 120000 * 1000; // ms must be longer than cSprayChangeSearch
+  static constexpr int32_t cResinWashTime          = 120000 * 1000;
   static constexpr int32_t cWashDetergentOpenTime  =    200 * 1000;
   static constexpr int32_t cShutdownRelayOnTime    =     50 * 1000;
+
+  // machine properties
+  static constexpr int32_t cHeaterPower            =   2000;
+  static constexpr int32_t cFillFlowRate           =    100;
+  static constexpr int32_t cDrainFlowRate          =    150;
+  static constexpr int32_t cWaterPerLevel          =     40; // ml/mm
 };
 
 #endif // DISHWASHER_DISHWASH_CONFIG_INCLUDED
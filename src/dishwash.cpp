@@ -1,5 +1,6 @@
 #include "dishwash.h"
 #include <signal.h>
+#include <cstring>
 
 void signalHandler(int s) {
   Dishwasher::stop();
@@ -7,8 +8,23 @@ void signalHandler(int s) {
 
 std::atomic<bool> Dishwasher::sKeepRunning;
 
-Dishwasher::Dishwasher(std::initializer_list<Component*> aComponents)
-  : mComponents(aComponents) {
+Dishwasher::Dishwasher(std::initializer_list<Component*> aComponents, QueueMode const aQueueMode)
+  : mComponents(aComponents)
+  , mQueueMode(aQueueMode)
+  , mExternalSender(static_cast<int32_t>(aComponents.size())) {
+  int32_t senderCount = (mQueueMode == QueueMode::PerSender ? mExternalSender + 1 : 0);
+  for(int32_t i = 0; i < mExternalSender; ++i) {
+    mComponents[i]->prepareQueues(i, senderCount);
+  }
+  for(int32_t type = 0; type < cEventTypeCount; ++type) {
+    for(auto i : mComponents) {
+      if(i->isSubscribed(static_cast<EventType>(type))) {
+        mSubscribers[type].push_back(i);
+      }
+      else { // nothing to do
+      }
+    }
+  }
   sKeepRunning.store(true);
   signal(SIGTERM, signalHandler);
   signal(SIGINT, signalHandler);
@@ -30,21 +46,131 @@ void Dishwasher::run() {
   while(startCount > 0) {
     mComponents[--startCount]->stop();
   }
+  logStatistics();
   std::this_thread::sleep_for(std::chrono::microseconds(cSleepFinish));
 }
 
+void Dishwasher::logStatistics() const noexcept {
+  for(auto i : mComponents) {
+    i->logStatistics();
+  }
+}
+
+bool Dishwasher::simulate(int64_t const aLength, std::function<bool()> const &aDone) noexcept {
+  int64_t end = TimerManager::now() + aLength;
+  for(auto i : mComponents) {
+    i->attach(this);
+  }
+  bool result = true;
+  bool done = false;
+  while(!done) {
+    bool worked;
+    do {
+      worked = false;
+      for(auto i : mComponents) {
+        worked = i->step() || worked;
+      }
+    } while(worked);
+    std::optional<int64_t> next;
+    for(auto i : mComponents) {
+      std::optional<int64_t> expiration = i->getNextExpiration();
+      if(expiration && (!next || expiration.value() < next.value())) {
+        next = expiration;
+      }
+      else { // nothing to do
+      }
+    }
+    if(!next) {
+      result = false;
+      done = true;
+    }
+    else if(next.value() > end) {
+      TimerManager::advanceVirtualClock(end);
+      done = true;
+    }
+    else {
+      TimerManager::advanceVirtualClock(next.value());
+      done = !sKeepRunning.load() || (aDone && aDone());
+    }
+  }
+  return result;
+}
+
+void Dishwasher::setJournal(Journal &aJournal) noexcept {
+  std::vector<std::string> names;
+  for(auto i : mComponents) {
+    names.push_back(i->getName());
+  }
+  aJournal.writeHeader(names);
+  mJournal = &aJournal;
+}
+
+bool Dishwasher::replay(JournalReader const &aJournal, std::function<bool()> const &aDone) noexcept {
+  std::vector<bool> regenerated(aJournal.getComponentCount(), false);
+  for(int32_t origin = 0; origin < aJournal.getComponentCount(); ++origin) {
+    for(auto i : mComponents) {
+      regenerated[origin] = regenerated[origin] || strcmp(aJournal.getName(origin), i->getName()) == 0;
+    }
+  }
+  int64_t offset = TimerManager::now() - aJournal.getStart();
+  bool result = true;
+  for(size_t i = 0u; result && i < aJournal.size(); ++i) {
+    JournalFormat::Record const &record = aJournal[i];
+    if(!record.event.isValid()) {
+      // nothing to do, counted by the reader
+    }
+    else if(record.origin < 0 || record.origin >= aJournal.getComponentCount() || !regenerated[record.origin]) {
+      int64_t at = record.timestamp + offset;
+      if(at > TimerManager::now()) {
+        simulate(at - TimerManager::now(), aDone);
+        result = sKeepRunning.load() && !(aDone && aDone());
+        // simulate does not move the clock if no timer is pending
+        TimerManager::advanceVirtualClock(at);
+      }
+      else { // nothing to do
+      }
+      send(nullptr, record.event);
+    }
+    else { // nothing to do
+    }
+  }
+  if(result && aJournal.size() > 0u) {
+    // the recorded components go on until the end of the recording
+    int64_t end = aJournal[aJournal.size() - 1u].timestamp + offset;
+    simulate(end > TimerManager::now() ? end - TimerManager::now() : 0, aDone);
+    result = sKeepRunning.load() && !(aDone && aDone());
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
 void Dishwasher::send(Component *aOrigin, Event const &aEvent) noexcept {
-  if(aEvent.getType() == EventType::KeyPressed) {
+  bool fresh = (aEvent.getType() != EventType::Error || mSharedError.raise(static_cast<int32_t>(aEvent.getError())) != 0);
+  if(!fresh) {
+    // nothing to do, already raised and sent
+  }
+  else if(mJournal != nullptr) {
+    mJournal->record(aOrigin == nullptr ? JournalFormat::cExternalOrigin : aOrigin->getIndex(), aEvent);
+  }
+  else if(aEvent.getType() == EventType::KeyPressed) {
     Log::i(nowtech::LogApp::cEvent) << aEvent.getTypeConstStr() << ':' << aEvent.getValueConstStr() << " (" << static_cast<char>(aEvent.getIntValue()) << ')' << Log::end;
   }
   else {
     Log::i(nowtech::LogApp::cEvent) << aEvent.getTypeConstStr() << ':' << aEvent.getValueConstStr() << " (" << aEvent.getIntValue() << ')' << Log::end;
   }
-  for(auto i : mComponents) {
-    if(i != aOrigin) {
-      i->queueEvent(aEvent);
-    }
-    else { // nothing to do
+  int32_t type = static_cast<int32_t>(aEvent.getType());
+  if(fresh && type >= 0 && type < cEventTypeCount) {
+    int32_t sender = (aOrigin == nullptr ? mExternalSender : aOrigin->getIndex());
+    uint64_t sequence = (mQueueMode == QueueMode::PerSender ? mNextSequence.fetch_add(1u, std::memory_order_relaxed) : 0u);
+    for(auto i : mSubscribers[type]) {
+      if(i != aOrigin) {
+        i->queueEvent(sender, sequence, aEvent);
+      }
+      else { // nothing to do
+      }
     }
   }
+  else { // nothing to do
+  }
 }
@@ -2,21 +2,51 @@
 #define DISHWASHER_DISHWASH_INCLUDED
 
 #include "base.h"
+#include "journal.h"
+#include <array>
 #include <vector>
 
 extern std::atomic<bool> keepRunning;
 
 class Dishwasher final : public BanCopyMove {
+public:
+  enum class QueueMode : int32_t {
+    Invalid   = -1,
+    Shared    =  0, /// One multi-producer queue for each component.
+    PerSender =  1  /// One single-producer ring for each (sender, receiver, lane), merged in sending order per lane.
+  };
+
+private:
   // us
   static constexpr int32_t cSleepWait   = 1000000;
   static constexpr int32_t cSleepFinish = 1000000;
 
+  static constexpr int32_t cEventTypeCount = static_cast<int32_t>(EventType::Count);
+
   static std::atomic<bool> sKeepRunning;
   std::vector<Component*> mComponents;
 
+  /// Components interested in each EventType, built once on construction.
+  std::array<std::vector<Component*>, cEventTypeCount> mSubscribers;
+
+  QueueMode const mQueueMode;
+
+  /// Sender index of the events without origin component.
+  int32_t const mExternalSender;
+
+  /// Orders the events in the per sender mode.
+  std::atomic<uint64_t> mNextSequence = 0u;
+
+  /// Replaces the textual event log if set.
+  Journal *mJournal = nullptr;
+
+  /// Errors of all the components, polled by them.
+  SharedError mSharedError;
+
 public:
-  /** This may throw exception if some library or hardware component fails. */
-  Dishwasher(std::initializer_list<Component*>);
+  /** This may throw exception if some library or hardware component fails.
+  In QueueMode::PerSender the external events (without origin) must come from a single thread. */
+  Dishwasher(std::initializer_list<Component*>, QueueMode const aQueueMode = QueueMode::Shared);
 
   ~Dishwasher() {
   }
@@ -30,7 +60,38 @@ public:
   all the subsequent functions have no-throw guarantee. */
   void run();
 
-  /** Sends the event to all components except for the originating one. */
+  /** Runs all components on the calling thread instead of starting their threads. The thread must use
+  the virtual clock, see TimerManager::useVirtualClock. All queued events are processed before the clock
+  jumps to the earliest timer expiration, so the order only depends on the components and their inputs.
+  Can be called repeatedly to continue the simulation.
+  @param aLength simulated time in us to run at most.
+  @param aDone optional predicate checked after each clock step, returning true stops the simulation.
+  @return false if the simulation stopped because there was nothing left to do. */
+  bool simulate(int64_t const aLength, std::function<bool()> const &aDone = nullptr) noexcept;
+
+  /** Logs the statistics of all components. run() calls it on shutdown. */
+  void logStatistics() const noexcept;
+
+  /** Records all subsequent events into the journal instead of the textual event log.
+  Must be called before run or simulate. */
+  void setJournal(Journal &aJournal) noexcept;
+
+  /** Replays a journal under the virtual clock, see simulate. Events of the recorded components
+  present here (matched by task name) are skipped, because these components send them again.
+  Invalid events are skipped too, see JournalReader::getInvalidCount. The others are injected as
+  external events at their recorded time relative to the start of the recording.
+  The simulation goes on until the time of the last record.
+  @param aDone optional predicate checked after each clock step, returning true stops the replay.
+  @return false if the replay was stopped by aDone or by stop(). */
+  bool replay(JournalReader const &aJournal, std::function<bool()> const &aDone = nullptr) noexcept;
+
+  SharedError const & getSharedError() const noexcept {
+    return mSharedError;
+  }
+
+  /** Sends the event to all subscribed components except for the originating one.
+  The origin may be nullptr to inject an external event, like a simulated program selection.
+  An error is set in the shared error word first, and is sent only if it was not raised before. */
   void send(Component *aOrigin, Event const &aEvent) noexcept;
 };
 
@@ -5,9 +5,11 @@
 
 /** Displays all interesting information including program, current step, error,
  * door and salt state, actuator switch states, pump currents, water level and temperature.
- * Calculates the remaining time itself. */
+ * Counts the remaining time down between the updates from Logic. */
 class Display final : public Component {
 private:
+  static constexpr int32_t cTimerCountdown = 0;
+  static constexpr int64_t cCountdownInterval = 60000000; // us
   static constexpr int32_t cStrLengthLong = 12;
   static constexpr int32_t cStrLengthShort = 6;
   static constexpr char errorMessages[][cStrLengthLong] = {
@@ -92,10 +94,17 @@ protected:
     return false;
   }
 
-  virtual bool shouldBeQueued(Event const &aEvent) const noexcept override {
+  virtual bool shouldBeQueued(EventType const) const noexcept override {
     return true;
   }
 
+  /// Only the latest values are shown.
+  virtual bool shouldCoalesce(EventType const aType) const noexcept override {
+    return aType == EventType::MeasuredCircCurrent || aType == EventType::MeasuredDrainCurrent
+        || aType == EventType::MeasuredWaterLevel || aType == EventType::MeasuredTemperature
+        || aType == EventType::RemainingTime;
+  }
+
 private:
   virtual void refresh() noexcept override;
 
@@ -147,13 +156,27 @@ private:
     }
     else if(type == EventType::RemainingTime) {
       mRemainingTime = aEvent.getIntValue();
+      mTimerManager.cancelAll();
+      if(mRemainingTime > 0) {
+        mTimerManager.schedule(cCountdownInterval, cTimerCountdown);
+      }
+      else { // nothing to do
+      }
     }
     else { // nothing to do
     }
     mNeedsRefresh = true;
   }
 
+  /// Stops at 1, because only Logic knows when the program ends.
   virtual void process(int32_t const aExpired) noexcept override {
+    if(aExpired == cTimerCountdown && mRemainingTime > 1) {
+      --mRemainingTime;
+      mNeedsRefresh = true;
+      mTimerManager.schedule(cCountdownInterval, cTimerCountdown);
+    }
+    else { // nothing to do
+    }
   }
 };
 
@@ -0,0 +1,86 @@
+#include "heatcontroller.h"
+#include <algorithm>
+
+using namespace std;
+
+void HeatController::measure(int32_t const aTemperature, int64_t const aNow) noexcept {
+  mTemperature = aTemperature;
+  if(mOn) {
+    // the element warms up first
+    if(aNow - mSwitchedOn >= static_cast<int64_t>(mLag * cUsInSecond)) {
+      if(mAnchorTime == cNever || aTemperature < mAnchorTemperature) {
+        mAnchorTemperature = aTemperature;
+        mAnchorTime = aNow;
+      }
+      else if(aTemperature - mAnchorTemperature >= cMinRateRise && aNow > mAnchorTime) {
+        double rate = (aTemperature - mAnchorTemperature) * cUsInSecond / (aNow - mAnchorTime);
+        mRate += cWeight * (rate - mRate);
+        mAnchorTemperature = aTemperature;
+        mAnchorTime = aNow;
+      }
+      else { // nothing to do, wait for more rise
+      }
+    }
+    else { // nothing to do
+    }
+  }
+  else if(mSwitchedOff != cNever) {
+    mPeak = std::max(mPeak, aTemperature);
+    if(aTemperature < mPeak || aNow - mSwitchedOff > static_cast<int64_t>(cMaxLag * cUsInSecond)) {
+      // the peak has passed
+      double lag = std::min((mPeak - mOffTemperature) / mRate, cMaxLag);
+      mLag += cWeight * (lag - mLag);
+      mSwitchedOff = cNever;
+    }
+    else { // nothing to do
+    }
+  }
+  else { // nothing to do
+  }
+}
+
+bool HeatController::decide() const noexcept {
+  bool result;
+  if(mTarget == 0) {
+    result = false;
+  }
+  else if(mOn) {
+    result = predict() < mTarget;
+  }
+  else {
+    result = mTemperature < mTarget - Config::cTempHisteresis;
+  }
+  return result;
+}
+
+int32_t HeatController::getPwmOnTime() const noexcept {
+  int32_t result;
+  double gap = mTarget - predict();
+  if(mTarget == 0 || gap <= 0.0) {
+    result = 0;
+  }
+  else if(gap >= cPwmBand) {
+    result = mPwmPeriod;
+  }
+  else {
+    result = static_cast<int32_t>(mPwmPeriod * gap / cPwmBand);
+  }
+  return result;
+}
+
+void HeatController::switched(bool const aOn, int64_t const aNow) noexcept {
+  if(aOn) {
+    mSwitchedOn = aNow;
+    mAnchorTime = cNever;
+    mSwitchedOff = cNever;
+  }
+  else if(mOn && aNow - mSwitchedOn >= static_cast<int64_t>(2.0 * mLag * cUsInSecond)) {
+    // short PWM pulses do not heat the element through, so they tell nothing about the lag
+    mOffTemperature = mTemperature;
+    mPeak = mTemperature;
+    mSwitchedOff = aNow;
+  }
+  else { // nothing to do
+  }
+  mOn = aOn;
+}
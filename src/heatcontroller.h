@@ -0,0 +1,92 @@
+#ifndef DISHWASHER_HEATCONTROLLER_INCLUDED
+#define DISHWASHER_HEATCONTROLLER_INCLUDED
+
+#include "dishwash-config.h"
+
+/** Heater control for Automat. Learns the heat-up rate of the water, which depends on its mass,
+ * and the lag of the element, which keeps heating the water after switch-off. The heater is
+ * switched off when the predicted final temperature reaches the target, so there is no overshoot.
+ * With a PWM period the relay is time-proportioned near the target instead of switched on every
+ * measurement. The times are plan times in us, see TimerManager::getPlanTime. */
+class HeatController final {
+  static constexpr double  cWaterHeatCapacity = 4.186;    // J/(ml K)
+  static constexpr double  cUsInSecond        = 1000000.0;
+  /// K/s, the nominal power heating full water.
+  static constexpr double  cDefaultRate       = Config::cHeaterPower / (Config::cWaterLevelFull * Config::cWaterPerLevel * cWaterHeatCapacity);
+  static constexpr double  cDefaultLag        = 20.0;     // s
+  static constexpr double  cMaxLag            = 120.0;    // s
+  /// Smaller rises give too noisy rate measurements.
+  static constexpr int32_t cMinRateRise       = 2;        // Celsius
+  /// EWMA weight of a new measurement.
+  static constexpr double  cWeight            = 0.3;
+  /// The PWM is proportional within this distance below the target, and full below.
+  static constexpr int32_t cPwmBand           = 4;        // Celsius
+  static constexpr int64_t cNever             = -1;
+
+  int32_t const mPwmPeriod;
+  int32_t mTarget            = 0;
+  int32_t mTemperature       = 0;
+  bool    mOn                = false;
+  int64_t mSwitchedOn        = cNever;
+
+  /// K/s while heating.
+  double  mRate              = cDefaultRate;
+  /// s, the overshoot after switch-off divided by the rate.
+  double  mLag               = cDefaultLag;
+
+  /// Start of the current rate measurement.
+  int32_t mAnchorTemperature = 0;
+  int64_t mAnchorTime        = cNever;
+
+  /// Overshoot measurement after switch-off.
+  int32_t mOffTemperature    = 0;
+  int32_t mPeak              = 0;
+  int64_t mSwitchedOff       = cNever;
+
+public:
+  /// @param aPwmPeriod us, 0 for on-off control
+  HeatController(int32_t const aPwmPeriod) noexcept : mPwmPeriod(aPwmPeriod) {
+  }
+
+  bool isPwm() const noexcept {
+    return mPwmPeriod > 0;
+  }
+
+  int32_t getPwmPeriod() const noexcept {
+    return mPwmPeriod;
+  }
+
+  /// Celsius, 0 for no heating.
+  void setTarget(int32_t const aTarget) noexcept {
+    mTarget = aTarget;
+  }
+
+  void measure(int32_t const aTemperature, int64_t const aNow) noexcept;
+
+  /// @return the heater state needed now in on-off mode.
+  bool decide() const noexcept;
+
+  /// @return us to keep the heater on from the start of a PWM period.
+  int32_t getPwmOnTime() const noexcept;
+
+  /// Must be called on each heater switching.
+  void switched(bool const aOn, int64_t const aNow) noexcept;
+
+  /// K/s
+  double getRate() const noexcept {
+    return mRate;
+  }
+
+  /// s
+  double getLag() const noexcept {
+    return mLag;
+  }
+
+private:
+  /// Celsius the water will reach if the heater is switched off now.
+  double predict() const noexcept {
+    return mTemperature + (mOn ? mRate * mLag : 0.0);
+  }
+};
+
+#endif // DISHWASHER_HEATCONTROLLER_INCLUDED
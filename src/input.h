@@ -20,7 +20,7 @@ protected:
     return true;
   }
 
-  virtual bool shouldBeQueued(Event const &aEvent) const noexcept override;
+  virtual bool shouldBeQueued(EventType const aType) const noexcept override;
 
 private:
   virtual void process(Event const &aEvent) noexcept override;
@@ -0,0 +1,152 @@
+#include "journal.h"
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+constexpr char JournalFormat::cMagic[];
+
+Journal::Journal(char const * const aFilename, bool const aLossless)
+  : mLossless(aLossless)
+  , mFile(fopen(aFilename, "wb"))
+  , mQueue(cQueueSize) {
+  mBatch.resize(cBatchSize);
+  if(mFile != nullptr) {
+    mThread = std::thread(&Journal::run, this);
+  }
+  else {
+    Log::i(nowtech::LogApp::cSystem) << "Could not open journal " << aFilename << Log::end;
+  }
+}
+
+Journal::~Journal() noexcept {
+  if(mFile != nullptr) {
+    mKeepRunning.store(false);
+    mNotifier.signal();
+    mThread.join();
+    fclose(mFile);
+  }
+  else { // nothing to do
+  }
+}
+
+void Journal::writeHeader(std::vector<std::string> const &aNames) noexcept {
+  JournalFormat::Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, JournalFormat::cMagic, JournalFormat::cMagicSize);
+  header.recordSize = sizeof(JournalFormat::Record);
+  header.start = TimerManager::now();
+  header.componentCount = std::min<int32_t>(aNames.size(), JournalFormat::cMaxComponents);
+  for(int32_t i = 0; i < header.componentCount; ++i) {
+    strncpy(header.names[i], aNames[i].c_str(), JournalFormat::cNameSize - 1);
+  }
+  if(mFile != nullptr) {
+    fwrite(&header, sizeof(header), 1u, mFile);
+  }
+  else { // nothing to do
+  }
+}
+
+void Journal::record(int32_t const aOrigin, Event const &aEvent) noexcept {
+  if(mFile != nullptr) {
+    JournalFormat::Record record{TimerManager::now(), aOrigin, 0, aEvent};
+    bool pushed = mQueue.bounded_push(record);
+    while(!pushed && mLossless) {
+      mNotifier.signal();
+      std::this_thread::yield();
+      pushed = mQueue.bounded_push(record);
+    }
+    if(!pushed) {
+      ++mDropped;
+    }
+    else if(mQueuedCount.fetch_add(1) == 0) {
+      mNotifier.signal();
+    }
+    else { // nothing to do, already signalled
+    }
+  }
+  else {
+    // there is no writer thread to wait for
+    ++mDropped;
+  }
+}
+
+void Journal::run() noexcept {
+  while(mKeepRunning.load()) {
+    mNotifier.wait(cFlushInterval);
+    drain();
+    fflush(mFile);
+  }
+  drain();
+  fflush(mFile);
+}
+
+void Journal::drain() noexcept {
+  size_t count;
+  do {
+    count = 0u;
+    while(count < mBatch.size() && mQueue.pop(mBatch[count])) {
+      ++count;
+    }
+    mQueuedCount.fetch_sub(static_cast<int32_t>(count));
+    fwrite(mBatch.data(), sizeof(JournalFormat::Record), count, mFile);
+  } while(count == mBatch.size());
+}
+
+JournalReader::JournalReader(char const * const aFilename) noexcept {
+  int descriptor = open(aFilename, O_RDONLY | O_CLOEXEC);
+  struct stat status;
+  if(descriptor >= 0 && fstat(descriptor, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(JournalFormat::Header)) {
+    mLength = status.st_size;
+    mMapped = mmap(nullptr, mLength, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    if(mMapped != MAP_FAILED) {
+      JournalFormat::Header const *header = static_cast<JournalFormat::Header const*>(mMapped);
+      bool valid = memcmp(header->magic, JournalFormat::cMagic, JournalFormat::cMagicSize) == 0 &&
+                   header->recordSize == sizeof(JournalFormat::Record) &&
+                   header->componentCount >= 0 && header->componentCount <= JournalFormat::cMaxComponents;
+      for(int32_t i = 0; valid && i < header->componentCount; ++i) {
+        valid = memchr(header->names[i], 0, JournalFormat::cNameSize) != nullptr;
+      }
+      if(valid) {
+        mHeader = header;
+        mRecords = reinterpret_cast<JournalFormat::Record const*>(static_cast<char const*>(mMapped) + sizeof(JournalFormat::Header));
+        // a partially written last record is ignored
+        mRecordCount = (mLength - sizeof(JournalFormat::Header)) / sizeof(JournalFormat::Record);
+        madvise(mMapped, mLength, MADV_SEQUENTIAL);
+        for(size_t i = 0u; i < mRecordCount; ++i) {
+          mInvalidCount += (mRecords[i].event.isValid() ? 0u : 1u);
+        }
+        if(mInvalidCount > 0u) {
+          Log::i(nowtech::LogApp::cSystem) << "Journal " << aFilename << " has " << static_cast<uint32_t>(mInvalidCount) << " invalid records, skipped on replay" << Log::end;
+        }
+        else { // nothing to do
+        }
+      }
+      else {
+        Log::i(nowtech::LogApp::cSystem) << "Invalid journal " << aFilename << Log::end;
+      }
+    }
+    else {
+      mMapped = nullptr;
+    }
+  }
+  else { // nothing to do
+  }
+  if(descriptor >= 0) {
+    close(descriptor);
+  }
+  else { // nothing to do
+  }
+}
+
+JournalReader::~JournalReader() noexcept {
+  if(mMapped != nullptr) {
+    munmap(mMapped, mLength);
+  }
+  else { // nothing to do
+  }
+}
@@ -0,0 +1,131 @@
+#ifndef DISHWASHER_JOURNAL_INCLUDED
+#define DISHWASHER_JOURNAL_INCLUDED
+
+#include "base.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/// Binary event journal file layout, shared by the writer and the reader.
+class JournalFormat final {
+public:
+  static constexpr char     cMagic[]             = "DWJRNL1";
+  static constexpr int32_t  cMagicSize           = sizeof(cMagic);
+  static constexpr int32_t  cMaxComponents       = 16;
+  static constexpr int32_t  cNameSize            = 16;
+  /// Origin of events without sender component.
+  static constexpr int32_t  cExternalOrigin      = -1;
+
+  struct Header final {
+    char    magic[cMagicSize];
+    int32_t recordSize;
+    int32_t componentCount;
+    /// us, TimerManager::now() when the recording started
+    int64_t start;
+    /// Task names of the recording Dishwasher components in their index order.
+    char    names[cMaxComponents][cNameSize];
+  };
+
+  struct Record final {
+    int64_t timestamp; /// us, TimerManager::now() of the sender
+    int32_t origin;    /// sender component index or cExternalOrigin
+    int32_t reserved;
+    Event   event;
+  };
+
+  static_assert(sizeof(Record) == 24u, "Record layout is part of the file format.");
+  static_assert(std::is_trivially_copyable<Record>::value, "Records are written and mapped as raw bytes.");
+};
+
+/// Records events into an append-only binary file. Senders only push into a preallocated
+/// lock-free queue, a dedicated thread writes the records to the file in batches.
+/// When the queue is full, the record is dropped and counted, unless the journal is lossless.
+class Journal final : public BanCopyMove {
+  static constexpr int32_t cQueueSize     = 4096;
+  static constexpr int32_t cBatchSize     =  256;
+  static constexpr int64_t cFlushInterval = 1000000; // us
+
+  bool const mLossless;
+  FILE *mFile;
+  boost::lockfree::queue<JournalFormat::Record, boost::lockfree::fixed_sized<true>> mQueue;
+  std::vector<JournalFormat::Record> mBatch;
+  std::atomic<int32_t> mQueuedCount = 0;
+  std::atomic<uint32_t> mDropped = 0u;
+  std::atomic<bool> mKeepRunning = true;
+  Notifier mNotifier;
+  std::thread mThread;
+
+public:
+  /// Truncates the file. Check operator bool for success.
+  /// @param aLossless if true, senders wait for the writer thread instead of dropping records.
+  /// Meant for simulations, which produce events much faster than real hardware.
+  Journal(char const * const aFilename, bool const aLossless = false);
+  ~Journal() noexcept;
+
+  operator bool() const noexcept {
+    return mFile != nullptr && mNotifier;
+  }
+
+  /// Called once by Dishwasher::setJournal before any record.
+  void writeHeader(std::vector<std::string> const &aNames) noexcept;
+
+  /// May be called from any thread. Only counts the record as dropped if the file could not be opened.
+  void record(int32_t const aOrigin, Event const &aEvent) noexcept;
+
+  uint32_t getDroppedCount() const noexcept {
+    return mDropped.load();
+  }
+
+private:
+  void run() noexcept;
+  void drain() noexcept;
+};
+
+/// Maps a journal file into memory for replay, see Dishwasher::replay. The file may come from the
+/// field, so the header is checked and the records with invalid events are counted.
+class JournalReader final : public BanCopyMove {
+  void   *mMapped = nullptr;
+  size_t  mLength = 0u;
+  JournalFormat::Header const *mHeader = nullptr;
+  JournalFormat::Record const *mRecords = nullptr;
+  size_t  mRecordCount = 0u;
+  /// Records with an invalid event, see Event::isValid.
+  size_t  mInvalidCount = 0u;
+
+public:
+  /// Check operator bool for success.
+  JournalReader(char const * const aFilename) noexcept;
+  ~JournalReader() noexcept;
+
+  operator bool() const noexcept {
+    return mHeader != nullptr;
+  }
+
+  int64_t getStart() const noexcept {
+    return mHeader->start;
+  }
+
+  int32_t getComponentCount() const noexcept {
+    return mHeader->componentCount;
+  }
+
+  /// @return the recorded task name of the component or nullptr for the external origin.
+  char const * getName(int32_t const aOrigin) const noexcept {
+    return aOrigin >= 0 && aOrigin < mHeader->componentCount ? mHeader->names[aOrigin] : nullptr;
+  }
+
+  size_t size() const noexcept {
+    return mRecordCount;
+  }
+
+  /// These are skipped on replay.
+  size_t getInvalidCount() const noexcept {
+    return mInvalidCount;
+  }
+
+  JournalFormat::Record const & operator[](size_t const aIndex) const noexcept {
+    return mRecords[aIndex];
+  }
+};
+
+#endif // DISHWASHER_JOURNAL_INCLUDED
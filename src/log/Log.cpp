@@ -28,7 +28,7 @@ void nowtech::Chunk::push(char const mChar) noexcept {
   mChunk[mIndex++] = mChar;
   if(mIndex == mChunkSize) {
     mOsInterface->push(mChunk, mBlocks);
-    mIndex = 1u;
+    reserve();
   }
 }
 
@@ -56,6 +56,7 @@ constexpr nowtech::LogFormat nowtech::LogConfig::cX8;
 
 constexpr char nowtech::Log::cUnknownApplicationName[8];
 constexpr char nowtech::Log::cDigit2char[16];
+constexpr char nowtech::Log::cDigitPairs[201];
 
 nowtech::Log *nowtech::Log::sInstance;
 
@@ -362,7 +363,9 @@ nowtech::Chunk nowtech::Log::startSend(char * const aChunkBuffer, TaskIdType con
 nowtech::Chunk nowtech::Log::startSendNoHeader(char * const aChunkBuffer, TaskIdType const aTaskId) noexcept {
   if(!mOsInterface.isInterrupt() || mConfig.logFromIsr) {
     TaskIdType taskId = aTaskId == Chunk::cInvalidTaskId ? getCurrentTaskId() : aTaskId;
-    return nowtech::Chunk(&mOsInterface, aChunkBuffer, 1u, taskId, mConfig.blocks);
+    nowtech::Chunk appender(&mOsInterface, aChunkBuffer, 1u, taskId, mConfig.blocks);
+    appender.reserve();
+    return appender;
   }
   else {
     return nowtech::Chunk();
@@ -377,60 +380,3 @@ nowtech::Chunk nowtech::Log::startSendNoHeader(char * const aChunkBuffer, TaskId
     return nowtech::Chunk();
   }
 }
-
-void nowtech::Log::append(nowtech::Chunk &aChunk, double const aValue, uint8_t const aDigitsNeeded) noexcept {
-  if(std::isnan(aValue)) {
-    append(aChunk, "nan");
-    return;
-  } else if(std::isinf(aValue)) {
-    append(aChunk, "inf");
-    return;
-  } else if(aValue == 0.0) {
-    aChunk.push('0');
-    return;
-  }
-  else {
-    double value = aValue;
-    if(value < 0) {
-        value = -value;
-        aChunk.push('-');
-    }
-    else if(mConfig.alignSigned) {
-      aChunk.push(' ');
-    }
-    else { // nothing to do
-    }
-    double mantissa = floor(log10(value));
-    double normalized = value / pow(10.0, mantissa);
-    int firstDigit;
-    for(uint8_t i = 1; i < aDigitsNeeded; i++) {
-      firstDigit = static_cast<int>(normalized);
-      if(firstDigit > 9) {
-        firstDigit = 9;
-      }
-      else { // nothing to do
-      }
-      aChunk.push(cDigit2char[firstDigit]);
-      normalized = 10.0 * (normalized - firstDigit);
-      if(i == 1) {
-        aChunk.push('.');
-      }
-      else { // nothing to do
-      }
-    }
-    firstDigit = static_cast<int>(round(normalized));
-    if(firstDigit > 9) {
-      firstDigit = 9;
-    }
-    else { // nothing to do
-    }
-    aChunk.push(cDigit2char[firstDigit]);
-    aChunk.push('e');
-    if(mantissa >= 0) {
-      aChunk.push('+');
-    }
-    else { // nothing to do
-    }
-    append(aChunk, static_cast<int32_t>(mantissa), static_cast<int32_t>(10), 0u);
-  }
-}
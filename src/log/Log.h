@@ -30,6 +30,11 @@
 #include <atomic>
 #include <limits>
 #include <cmath>
+#include <cstring>
+#include <algorithm>
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
 #include <map>
 
 namespace nowtech {
@@ -140,7 +145,8 @@ namespace nowtech {
     /// in characters os as a string, but as chunks. \n signs the end of a message.
     LogSizeType chunkSize = 8u;
 
-    /// Length of a FreeRTOS queue in chunks.
+    /// Length of a FreeRTOS queue in chunks. LogStdThreadOstream uses it as the
+    /// length of the ring of each logging thread.
     LogSizeType queueLength = 64u;
 
     /// Length of the circular buffer used for message sorting, measured also in
@@ -150,8 +156,8 @@ namespace nowtech {
     /// Length of a buffer in the transmission double-buffer pair, in chunks.
     LogSizeType transmitBufferLength = 32u;
 
-    /// Length of stack-reserved buffer for number to string conversion. Can be
-    /// reduced if no binary output is used.
+    /// Maximal number of digits of a converted number, longer ones are written
+    /// as the numeric error character. Can be reduced if no binary output is used.
     LogSizeType appendStackBufferLength = 34u;
 
     /// Length of a pause in ms during waiting for transmission of the other
@@ -198,6 +204,11 @@ namespace nowtech {
     /// If true, positive numbers will be prepended with a space to let them align negatives.
     bool alignSigned = false;
 
+    /// If true, the numbers are recorded in binary by the logging thread, and the
+    /// LogOsInterface converts them to text on the transmitter thread using LogDecoder.
+    /// Numbers with formats not fitting in a record are converted immediately.
+    bool deferredFormatting = false;
+
     LogConfig() noexcept = default;
   };
 
@@ -284,8 +295,16 @@ namespace nowtech {
     };
 
     /// Enqueues the chunks, possibly blocking if the queue is full.
+    /// If aChunkStart is the one returned by reserve, it is published without copying.
     virtual void push(char const * const aChunkStart, bool const aBlocks) noexcept = 0;
 
+    /// Returns a chunk in the queue for the calling thread to write in place,
+    /// possibly blocking if the queue is full. Calling it again before push returns the same one.
+    /// @return nullptr if not supported or not available, then the caller writes its own buffer.
+    virtual char * reserve(bool const) noexcept {
+      return nullptr;
+    }
+
     /// Removes the oldest chunk from the queue.
     virtual bool pop(char * const aChunkStart) noexcept = 0;
 
@@ -422,6 +441,16 @@ namespace nowtech {
       mChunk[0] = cInvalidTaskId;
     }
 
+    /// Continues in a chunk reserved by the OsInterface if it has one, or in the own buffer
+    /// otherwise. Keeps the task ID.
+    void reserve() noexcept {
+      char * reserved = mOsInterface->reserve(mBlocks);
+      char * next = (reserved != nullptr ? reserved : mOrigin);
+      next[0] = mChunk[0];
+      mChunk = next;
+      mIndex = 1;
+    }
+
     /// defined in .cpp to allow stub.
     void push(char const mChar) noexcept;
 
@@ -429,6 +458,7 @@ namespace nowtech {
       mChunk[mIndex++] = '\n';
       mOsInterface->push(mChunk, mBlocks);
       mIndex = 1;
+      mChunk = mOrigin;
     }
 
     void pop() noexcept {
@@ -507,6 +537,7 @@ namespace nowtech {
   /// number of parameters.
   class Log final : public BanCopyMove {
     friend class LogShiftChainHelper;
+    friend class LogDecoder;
   public:
     /// Will be used as Log << something << to << log << Log::end;
     static constexpr LogShiftChainMarker end = LogShiftChainMarker::cEnd;
@@ -538,6 +569,38 @@ namespace nowtech {
       '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f'
     };
 
+    /// Used to convert two decimal digits at a time.
+    static constexpr char cDigitPairs[201] =
+      "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+      "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+      "8081828384858687888990919293949596979899";
+
+    /// Binary digits of a 64 bit number.
+    static constexpr uint8_t cMaxDigits = 64u;
+
+    /// More significant digits are not stored in a double.
+    static constexpr int cMaxDoubleDigits = 17;
+
+    /// The sign is written separately.
+    static constexpr int cMaxDoubleLength = 32;
+
+    /// A deferred record is cDeferredMarker, the kind, the base or 0, the fill, all
+    /// offset by cDeferredOffset, the number of groups offset by '0', and then
+    /// the value in 7-bit groups from the lowest, each with the highest bit set.
+    /// The signed values are zigzag encoded to keep the small negatives short.
+    /// So no byte of a record can be taken for a newline.
+    static constexpr char     cDeferredMarker    = '\x1b';
+    static constexpr char     cDeferredInt32     = 'i';
+    static constexpr char     cDeferredUint32    = 'u';
+    static constexpr char     cDeferredInt64     = 'l';
+    static constexpr char     cDeferredUint64    = 'q';
+    static constexpr char     cDeferredDouble    = 'd';
+    static constexpr uint8_t  cDeferredOffset    = 0x20u;
+    static constexpr uint8_t  cDeferredLimit     = 0x5fu;
+    static constexpr uint8_t  cDeferredGroupBit  = 0x80u;
+    static constexpr uint8_t  cDeferredGroupMask = 0x7fu;
+    static constexpr uint8_t  cDeferredMaxGroups = 10u;
+
     /// The subclass object used as interface to the OS, which also handles
     /// locking, time and thread management.
     LogOsInterface &mOsInterface;
@@ -624,6 +687,22 @@ namespace nowtech {
     /// Starts a << operator chain with no argument, without printing header.
     static LogShiftChainHelper n() noexcept;
 
+    /// Converts an integer into text as the << chain does after aFormat, but never deferred.
+    /// For checking and measuring the conversion.
+    /// @param aSink anything with push(char).
+    template<typename tSink, typename T>
+    static void convert(tSink &aSink, LogFormat const aFormat, T const aValue) noexcept {
+      static_assert(std::is_integral<T>::value, "Doubles have their own overload.");
+      sInstance->format(aSink, aValue, static_cast<T>(aFormat.base), aFormat.fill);
+    }
+
+    /// Converts a double into text with aFormat.fill significant digits, see format.
+    /// @param aSink anything with push(char).
+    template<typename tSink>
+    static void convert(tSink &aSink, LogFormat const aFormat, double const aValue) noexcept {
+      sInstance->format(aSink, aValue, aFormat.fill);
+    }
+
     /// Starts a << operator chain with the specified app, without printing header.
     static LogShiftChainHelper n(LogApp const aApp) noexcept;
 
@@ -786,6 +865,14 @@ private:
       append(aChunk, aValue);
     }
 
+    void append(Chunk &aChunk, LogFormat& aFormat, char const aValue) noexcept {
+      append(aChunk, aValue);
+    }
+
+    void append(Chunk &aChunk, LogFormat& aFormat, bool const aValue) noexcept {
+      append(aChunk, aValue);
+    }
+
     void append(Chunk &aChunk, LogFormat& aFormat, int8_t const aValue) noexcept {
       append(aChunk, static_cast<int32_t>(aValue), static_cast<int32_t>(aFormat.base), aFormat.fill);
     }
@@ -794,7 +881,7 @@ private:
       append(aChunk, static_cast<int32_t>(aValue), static_cast<int32_t>(aFormat.base), aFormat.fill);
     }
 
-    void yappend(Chunk &aChunk, LogFormat& aFormat, int32_t const aValue) noexcept {
+    void append(Chunk &aChunk, LogFormat& aFormat, int32_t const aValue) noexcept {
       append(aChunk, aValue, static_cast<int32_t>(aFormat.base), aFormat.fill);
     }
 
@@ -940,8 +1027,71 @@ private:
     /// @return the return value of the last append(char const ch) call.
     template<typename T>
     void append(Chunk &aChunk, T const value, T const base, uint8_t const fill) noexcept {
-      T tmpValue = value;
-      uint8_t tmpFill = fill;
+      static_assert(std::is_integral<T>::value && sizeof(T) <= 8u, "Only integers up to 64 bits are expected here.");
+      // the narrower ones give the same text as 32 bit ones
+      char const kind = std::is_signed<T>::value ? (sizeof(T) <= 4u ? cDeferredInt32 : cDeferredInt64)
+                                                 : (sizeof(T) <= 4u ? cDeferredUint32 : cDeferredUint64);
+      uint64_t const bits = std::is_signed<T>::value ? zigzag(static_cast<int64_t>(value)) : static_cast<uint64_t>(value);
+      if(!mConfig.deferredFormatting || static_cast<uint64_t>(base) > cDeferredLimit
+        || !appendDeferred(aChunk, kind, bits, static_cast<uint8_t>(base), fill)) {
+        format(aChunk, value, base, fill);
+      }
+      else { // nothing to do
+      }
+    }
+
+    void append(Chunk &aChunk, double const aValue, uint8_t const aDigitsNeeded) noexcept {
+      uint64_t bits;
+      std::memcpy(&bits, &aValue, sizeof(bits));
+      if(!mConfig.deferredFormatting || !appendDeferred(aChunk, cDeferredDouble, bits, 0u, aDigitsNeeded)) {
+        format(aChunk, aValue, aDigitsNeeded);
+      }
+      else { // nothing to do
+      }
+    }
+
+    /// Writes the record, see cDeferredMarker.
+    /// @return false if the arguments do not fit in it.
+    bool appendDeferred(Chunk &aChunk, char const aKind, uint64_t const aBits, uint8_t const aBase, uint8_t const aFill) noexcept {
+      bool result = aBase <= cDeferredLimit && aFill <= cDeferredLimit;
+      if(result) {
+        char groups[cDeferredMaxGroups];
+        uint8_t count = 0u;
+        uint64_t bits = aBits;
+        do {
+          groups[count] = static_cast<char>(cDeferredGroupBit | (bits & cDeferredGroupMask));
+          ++count;
+          bits >>= 7u;
+        } while(bits != 0u);
+        aChunk.push(cDeferredMarker);
+        aChunk.push(aKind);
+        aChunk.push(static_cast<char>(cDeferredOffset + aBase));
+        aChunk.push(static_cast<char>(cDeferredOffset + aFill));
+        aChunk.push(static_cast<char>('0' + count));
+        for(uint8_t i = 0u; i < count; ++i) {
+          aChunk.push(groups[i]);
+        }
+      }
+      else { // nothing to do
+      }
+      return result;
+    }
+
+    static uint64_t zigzag(int64_t const aValue) noexcept {
+      return (static_cast<uint64_t>(aValue) << 1u) ^ static_cast<uint64_t>(aValue >> 63u);
+    }
+
+    static int64_t unzigzag(uint64_t const aBits) noexcept {
+      return static_cast<int64_t>(aBits >> 1u) ^ -static_cast<int64_t>(aBits & 1u);
+    }
+
+    /// The conversion itself, into a Chunk or into the LogDecoder output.
+    /// Decimal numbers are converted two digits at a time from a table, so
+    /// there is one division by 100 per two digits instead of one per digit.
+    /// Hexadecimal and binary ones are converted by shifting and masking.
+    template<typename tSink, typename T>
+    void format(tSink &aChunk, T const value, T const base, uint8_t const fill) noexcept {
+      typedef typename std::make_unsigned<T>::type Unsigned;
       if(base != 2 && base != 10 && base != 16) {
         aChunk.push(cNumericError);
         return;
@@ -960,21 +1110,17 @@ private:
       }
       else { // nothing to do
       }
-      char tmpBuffer[mConfig.appendStackBufferLength];
-      uint8_t where = 0;
+      char tmpBuffer[cMaxDigits];
+      char * const end = tmpBuffer + cMaxDigits;
       bool negative = value < 0;
-      do {
-        T mod = tmpValue % base;
-        if(mod < 0) {
-          mod = -mod;
-        }
-        else { // nothing to do
-        }
-        tmpBuffer[where] = cDigit2char[mod];
-        ++where;
-        tmpValue /= base;
+      Unsigned magnitude = negative ? static_cast<Unsigned>(0u) - static_cast<Unsigned>(value) : static_cast<Unsigned>(value);
+      uint8_t where;
+      if(base == 10) {
+        where = toDecimal(magnitude, end);
+      }
+      else {
+        where = toPowerOfTwo(magnitude, base == 16 ? 4u : 1u, end);
       }
-      while(tmpValue != 0 && where <= mConfig.appendStackBufferLength);
       if(where > mConfig.appendStackBufferLength) {
         aChunk.push(cNumericError);
         return;
@@ -989,20 +1135,149 @@ private:
       }
       else { // nothing to do
       }
-      if(tmpFill > where) {
-        tmpFill -= where;
-        while(tmpFill > 0) {
-          aChunk.push(cNumericFill);
-          --tmpFill;
-        }
+      for(uint8_t tmpFill = fill; tmpFill > where; --tmpFill) {
+        aChunk.push(cNumericFill);
+      }
+      for(char const *digit = end - where; digit != end; ++digit) {
+        aChunk.push(*digit);
+      }
+    }
+
+    /// Writes the digits backwards ending at aEnd.
+    /// @return the number of digits.
+    template<typename tUnsigned>
+    static uint8_t toDecimal(tUnsigned aValue, char * const aEnd) noexcept {
+      char *digit = aEnd;
+      while(aValue >= 100u) {
+        uint32_t pair = static_cast<uint32_t>(aValue % 100u) * 2u;
+        aValue /= 100u;
+        *--digit = cDigitPairs[pair + 1u];
+        *--digit = cDigitPairs[pair];
       }
-      for(--where; where > 0; --where) {
-        aChunk.push(tmpBuffer[where]);
+      if(aValue >= 10u) {
+        uint32_t pair = static_cast<uint32_t>(aValue) * 2u;
+        *--digit = cDigitPairs[pair + 1u];
+        *--digit = cDigitPairs[pair];
       }
-      aChunk.push(tmpBuffer[0]);
+      else {
+        *--digit = cDigit2char[aValue];
+      }
+      return static_cast<uint8_t>(aEnd - digit);
+    }
+
+    /// Writes the digits backwards ending at aEnd.
+    /// @param aShift bits per digit.
+    /// @return the number of digits.
+    template<typename tUnsigned>
+    static uint8_t toPowerOfTwo(tUnsigned aValue, uint8_t const aShift, char * const aEnd) noexcept {
+      tUnsigned const mask = (static_cast<tUnsigned>(1u) << aShift) - 1u;
+      char *digit = aEnd;
+      do {
+        *--digit = cDigit2char[aValue & mask];
+        aValue >>= aShift;
+      } while(aValue != 0u);
+      return static_cast<uint8_t>(aEnd - digit);
     }
 
-    void append(Chunk &aChunk, double const aValue, uint8_t const aDigitsNeeded) noexcept;
+    template<typename tSink>
+    void format(tSink &aChunk, char const * const aString) noexcept {
+      for(int i = 0; aString[i] != 0; ++i) {
+        aChunk.push(aString[i]);
+      }
+    }
+
+    /// Writes aDigitsNeeded significant digits in scientific notation, or the shortest
+    /// one reading back the same value if aDigitsNeeded is 0. Uses the correctly rounded
+    /// std::to_chars if the library has it, the slower digit by digit loop otherwise.
+    template<typename tSink>
+    void format(tSink &aChunk, double const aValue, uint8_t const aDigitsNeeded) noexcept {
+      if(std::isnan(aValue)) {
+        format(aChunk, "nan");
+        return;
+      } else if(std::isinf(aValue)) {
+        format(aChunk, "inf");
+        return;
+      } else if(aValue == 0.0) {
+        aChunk.push('0');
+        return;
+      }
+      else {
+        double value = aValue;
+        if(value < 0) {
+            value = -value;
+            aChunk.push('-');
+        }
+        else if(mConfig.alignSigned) {
+          aChunk.push(' ');
+        }
+        else { // nothing to do
+        }
+#if defined(__cpp_lib_to_chars)
+        char tmpBuffer[cMaxDoubleLength];
+        std::to_chars_result converted = aDigitsNeeded == 0u
+          ? std::to_chars(tmpBuffer, tmpBuffer + cMaxDoubleLength, value, std::chars_format::scientific)
+          : std::to_chars(tmpBuffer, tmpBuffer + cMaxDoubleLength, value, std::chars_format::scientific,
+                          std::min<int>(aDigitsNeeded, cMaxDoubleDigits) - 1);
+        char const *character = tmpBuffer;
+        while(*character != 'e') {
+          aChunk.push(*character);
+          ++character;
+        }
+        aChunk.push('e');
+        ++character;
+        if(*character == '+') {
+          aChunk.push('+');
+        }
+        else {
+          aChunk.push('-');
+        }
+        // to_chars writes at least two exponent digits
+        ++character;
+        if(*character == '0' && character + 1 != converted.ptr) {
+          ++character;
+        }
+        else { // nothing to do
+        }
+        while(character != converted.ptr) {
+          aChunk.push(*character);
+          ++character;
+        }
+#else
+        double mantissa = floor(log10(value));
+        double normalized = value / pow(10.0, mantissa);
+        int firstDigit;
+        for(uint8_t i = 1; i < aDigitsNeeded; i++) {
+          firstDigit = static_cast<int>(normalized);
+          if(firstDigit > 9) {
+            firstDigit = 9;
+          }
+          else { // nothing to do
+          }
+          aChunk.push(cDigit2char[firstDigit]);
+          normalized = 10.0 * (normalized - firstDigit);
+          if(i == 1) {
+            aChunk.push('.');
+          }
+          else { // nothing to do
+          }
+        }
+        firstDigit = static_cast<int>(round(normalized));
+        if(firstDigit > 9) {
+          firstDigit = 9;
+        }
+        else { // nothing to do
+        }
+        aChunk.push(cDigit2char[firstDigit]);
+        aChunk.push('e');
+        if(mantissa >= 0) {
+          aChunk.push('+');
+        }
+        else { // nothing to do
+        }
+        format(aChunk, static_cast<int32_t>(mantissa), static_cast<int32_t>(10), 0u);
+#endif
+      }
+    }
   };// class Log
 
   template<typename ArgumentType>
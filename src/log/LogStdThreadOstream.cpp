@@ -23,48 +23,152 @@
 
 #include "LogStdThreadOstream.h"
 
-constexpr uint32_t nowtech::LogStdThreadOstream::cEnqueuePollDelay;
+constexpr size_t nowtech::LogStdThreadOstream::cMaxRingCount;
 
-void nowtech::LogStdThreadOstream::FreeRtosQueue::send(char const * const aChunkStart, bool const aBlocks) noexcept {
-  bool success;
-  do {
-    char *payload;
-    success = mFreeList.pop(payload);
-    if(success) {
-      std::copy(aChunkStart, aChunkStart + mBlockSize, payload);
-      mQueue.bounded_push(payload); // this should always succeed here
-      mConditionVariable.notify_one();
+thread_local nowtech::LogStdThreadOstream::ThreadRing nowtech::LogStdThreadOstream::tThreadRing;
+
+std::atomic<uint32_t> nowtech::LogStdThreadOstream::sNextGeneration(0u);
+
+void nowtech::LogStdThreadOstream::push(char const * const aChunkStart, bool const aBlocks) noexcept {
+  ChunkRing *ring = getThreadRing();
+  if(ring == nullptr) {
+    mLostChunks.fetch_add(1u, std::memory_order_relaxed);
+  }
+  else if(ring->isReserved(aChunkStart)) {
+    commit(ring);
+  }
+  else {
+    char *chunk = reserve(ring, aBlocks);
+    if(chunk != nullptr) {
+      std::copy(aChunkStart, aChunkStart + mChunkSize, chunk);
+      commit(ring);
     }
     else {
-      std::this_thread::sleep_for(std::chrono::milliseconds(cEnqueuePollDelay));
+      mLostChunks.fetch_add(1u, std::memory_order_relaxed);
     }
-  } while(aBlocks && !success);
+  }
 }
 
-bool nowtech::LogStdThreadOstream::FreeRtosQueue::receive(char * const aChunkStart, uint32_t const mPauseLength) noexcept {
-  bool result;
-  // Safe to call empty because there will be only one consumer.
-  if(mQueue.empty() && mConditionVariable.wait_for(mLock, std::chrono::milliseconds(mPauseLength)) == std::cv_status::timeout) {
-    result = false;
+char * nowtech::LogStdThreadOstream::reserve(bool const aBlocks) noexcept {
+  ChunkRing *ring = getThreadRing();
+  return ring == nullptr ? nullptr : reserve(ring, aBlocks);
+}
+
+bool nowtech::LogStdThreadOstream::pop(char * const aChunkStart) noexcept {
+  bool result = popAny(aChunkStart);
+  if(!result) {
+    std::unique_lock<std::mutex> lock(mWaitMutex);
+    mTransmitterWaiting.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // a producer committing meanwhile either sees the flag or its chunk is found here
+    result = popAny(aChunkStart);
+    if(!result) {
+      mTransmitterCondition.wait_for(lock, std::chrono::milliseconds(mPauseLength));
+      result = popAny(aChunkStart);
+    }
+    else { // nothing to do
+    }
+    mTransmitterWaiting.store(false);
   }
-  else {
-    char *payload;
-    result = mQueue.pop(payload);
-    if(result) {
-      std::copy(payload, payload + mBlockSize, aChunkStart);
-      mFreeList.bounded_push(payload); // this should always succeed here
+  else { // nothing to do
+  }
+  if(result) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(mProducersWaiting.load() > 0u) {
+      std::lock_guard<std::mutex> lock(mWaitMutex);
+      mProducerCondition.notify_all();
     }
     else { // nothing to do
     }
   }
+  else { // nothing to do
+  }
   return result;
 }
 
+nowtech::LogStdThreadOstream::ChunkRing * nowtech::LogStdThreadOstream::getThreadRing() noexcept {
+  if(tThreadRing.generation != mGeneration) {
+    if(tThreadRing.ring) {
+      // of an earlier instance
+      tThreadRing.ring->release();
+      tThreadRing.ring.reset();
+    }
+    else { // nothing to do
+    }
+    std::lock_guard<std::mutex> lock(mRingMutex);
+    size_t count = mRingCount.load();
+    for(size_t i = 0u; !tThreadRing.ring && i < count; ++i) {
+      if(mRings[i]->acquire()) {
+        tThreadRing.ring = mRings[i];
+      }
+      else { // nothing to do
+      }
+    }
+    if(!tThreadRing.ring && count < cMaxRingCount) {
+      mRings[count] = std::make_shared<ChunkRing>(mRingLength, mChunkSize);
+      mRings[count]->acquire();
+      tThreadRing.ring = mRings[count];
+      mRingCount.store(count + 1u);
+    }
+    else { // nothing to do
+    }
+    // a thread without ring tries again next time, some may have been released meanwhile
+    tThreadRing.generation = (tThreadRing.ring ? mGeneration : 0u);
+  }
+  else { // nothing to do
+  }
+  return tThreadRing.ring.get();
+}
+
+char * nowtech::LogStdThreadOstream::reserve(ChunkRing * const aRing, bool const aBlocks) noexcept {
+  char *result = aRing->reserve();
+  while(result == nullptr && aBlocks) {
+    std::unique_lock<std::mutex> lock(mWaitMutex);
+    mProducersWaiting.fetch_add(1u);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    result = aRing->reserve();
+    if(result == nullptr) {
+      mProducerCondition.wait_for(lock, std::chrono::milliseconds(mPauseLength));
+      result = aRing->reserve();
+    }
+    else { // nothing to do
+    }
+    mProducersWaiting.fetch_sub(1u);
+  }
+  return result;
+}
+
+void nowtech::LogStdThreadOstream::commit(ChunkRing * const aRing) noexcept {
+  aRing->commit();
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(mTransmitterWaiting.load()) {
+    std::lock_guard<std::mutex> lock(mWaitMutex);
+    mTransmitterCondition.notify_one();
+  }
+  else { // nothing to do
+  }
+}
+
+bool nowtech::LogStdThreadOstream::popAny(char * const aChunkStart) noexcept {
+  bool result = false;
+  size_t count = mRingCount.load();
+  for(size_t i = 0u; !result && i < count; ++i) {
+    size_t index = (mNextRing + i) % count;
+    result = mRings[index]->pop(aChunkStart);
+    if(result) {
+      mNextRing = index + 1u;
+    }
+    else { // nothing to do
+    }
+  }
+  return result;
+}
 
 void nowtech::LogStdThreadOstream::FreeRtosTimer::run() noexcept {
+  std::unique_lock<std::mutex> lock(mMutex);
   while(mKeepRunning.load()) {
     if(mAlarmed) {
-      if(mConditionVariable.wait_for(mLock, std::chrono::milliseconds(mTimeout)) == std::cv_status::timeout) {
+      if(mConditionVariable.wait_for(lock, std::chrono::milliseconds(mTimeout)) == std::cv_status::timeout) {
         mLambda();
         mAlarmed.store(false);
       }  
@@ -72,7 +176,7 @@ void nowtech::LogStdThreadOstream::FreeRtosTimer::run() noexcept {
       }
     }
     else {
-      mConditionVariable.wait(mLock);
+      mConditionVariable.wait(lock);
     }
   }
 }
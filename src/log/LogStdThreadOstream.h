@@ -25,16 +25,18 @@
 #define NOWTECH_LOG_STD_THREAD_OSTREAM_INCLUDED
 
 #include "Log.h"
+#include "LogUtil.h"
 #include <mutex>
 #include <atomic>
 #include <thread>
 #include <chrono>
-#include <string>
+#include <array>
+#include <memory>
 #include <string>
 #include <ostream>
+#include <algorithm>
 #include <functional>
 #include <condition_variable>
-#include <boost/lockfree/queue.hpp>
 
 namespace nowtech {
 
@@ -42,7 +44,6 @@ namespace nowtech {
   /// provides them.
   class LogStdThreadOstream final : public LogOsInterface {
     static constexpr uint32_t cInvalidGivenTaskId = 0u;
-    static constexpr uint32_t cEnqueuePollDelay = 1u;
 
     struct NameId {
       std::string name;
@@ -57,39 +58,132 @@ namespace nowtech {
       }
     };
 
-    /// Uses moodycamel::ConcurrentQueue to simulate a FreeRTOS queue.
-    class FreeRtosQueue final : public BanCopyMove {
-      boost::lockfree::queue<char *> mQueue;
-      boost::lockfree::queue<char *> mFreeList;
-      std::mutex                     mMutex;
-      std::unique_lock<std::mutex>   mLock;
-      std::condition_variable        mConditionVariable;
+    /// Single producer, single consumer ring of chunks for one logging thread.
+    /// The producer formats the message directly into the reserved chunk and
+    /// publishes it by commit, so nothing is copied and nothing is locked.
+    /// The two indices live on separate cache lines.
+    class ChunkRing final : public BanCopyMove {
+      static constexpr size_t cCacheLine = 64u;
+
+      size_t const            mChunkSize;
+      size_t const            mCapacity;
+      std::unique_ptr<char[]> mBuffer;
+
+      /// Written by the consumer.
+      alignas(cCacheLine) std::atomic<size_t> mHead;
+
+      /// Written by the producer.
+      alignas(cCacheLine) std::atomic<size_t> mTail;
+
+      /// Set while a thread uses the ring as the producer.
+      std::atomic<bool> mOwned;
 
-      size_t const mBlockSize;
-      char        *mBuffer;
-    
     public:
-      /// First implementation, we assume we have plenty of memory.
-      FreeRtosQueue(size_t const aBlockCount, size_t const aBlockSize) noexcept
-        : mQueue(aBlockCount)
-        , mFreeList(aBlockCount)
-        , mLock(mMutex)
-        , mBlockSize(aBlockSize) 
-        , mBuffer(new char[aBlockCount * aBlockSize]) {
-        char *ptr = mBuffer;
-        for(size_t i = 0; i < aBlockCount; ++i) {
-          mFreeList.bounded_push(ptr);
-          ptr += aBlockSize;
+      ChunkRing(size_t const aCapacity, size_t const aChunkSize)
+        : mChunkSize(aChunkSize)
+        , mCapacity(aCapacity)
+        , mBuffer(new char[aCapacity * aChunkSize])
+        , mHead(0u)
+        , mTail(0u)
+        , mOwned(false) {
+      }
+
+      /// Makes the calling thread the producer.
+      /// @return false if an other thread is.
+      bool acquire() noexcept {
+        bool expected = false;
+        return mOwned.compare_exchange_strong(expected, true);
+      }
+
+      /// Called by the producer when it exits, so an other thread may continue the ring.
+      void release() noexcept {
+        mOwned.store(false);
+      }
+
+      /// Called only by the producer.
+      /// @return the chunk at the tail, or nullptr if the ring is full.
+      char * reserve() noexcept {
+        size_t tail = mTail.load(std::memory_order_relaxed);
+        return tail - mHead.load(std::memory_order_acquire) < mCapacity ? mBuffer.get() + tail % mCapacity * mChunkSize : nullptr;
+      }
+
+      /// Called only by the producer.
+      bool isReserved(char const * const aChunkStart) const noexcept {
+        return aChunkStart == mBuffer.get() + mTail.load(std::memory_order_relaxed) % mCapacity * mChunkSize;
+      }
+
+      /// Called only by the producer after reserve returned a chunk.
+      void commit() noexcept {
+        mTail.store(mTail.load(std::memory_order_relaxed) + 1u, std::memory_order_release);
+      }
+
+      /// Called only by the consumer.
+      /// @return false if the ring is empty.
+      bool pop(char * const aChunkStart) noexcept {
+        size_t head = mHead.load(std::memory_order_relaxed);
+        bool result = (head != mTail.load(std::memory_order_acquire));
+        if(result) {
+          char const * const chunk = mBuffer.get() + head % mCapacity * mChunkSize;
+          std::copy(chunk, chunk + mChunkSize, aChunkStart);
+          mHead.store(head + 1u, std::memory_order_release);
         }
+        else { // nothing to do
+        }
+        return result;
       }
+    };
 
-      ~FreeRtosQueue() noexcept {
-        delete[] mBuffer;
+    /// Each logging thread gets a ring on its first message, registered here for the transmitter.
+    /// The ring is released when the thread exits, and reused by the next new thread. Threads
+    /// beyond this many at the same time lose their messages, counted in mLostChunks.
+    static constexpr size_t cMaxRingCount = 256u;
+
+    /// The ring of the calling thread, valid only if created by the current instance.
+    /// Shared, because the thread may exit after the instance is destroyed.
+    struct ThreadRing final {
+      uint32_t                   generation = 0u;
+      std::shared_ptr<ChunkRing> ring;
+
+      ~ThreadRing() noexcept {
+        if(ring) {
+          ring->release();
+        }
+        else { // nothing to do
+        }
       }
+    };
+
+    static thread_local ThreadRing tThreadRing;
+
+    /// Distinguishes the instances for tThreadRing.
+    static std::atomic<uint32_t> sNextGeneration;
+
+    uint32_t const mGeneration;
+
+    /// Length of each ring in chunks.
+    size_t const mRingLength;
+
+    std::array<std::shared_ptr<ChunkRing>, cMaxRingCount> mRings;
+
+    /// Rings [0, mRingCount) are ready for the transmitter.
+    std::atomic<size_t> mRingCount;
+
+    /// Only for assigning the rings to the threads.
+    std::mutex mRingMutex;
 
-      void send(char const * const aChunkStart, bool const aBlocks) noexcept;
-      bool receive(char * const aChunkStart, uint32_t const aPauseLength) noexcept;
-    } mQueue;
+    /// Chunks dropped because of too many threads or a full ring, reported on destruction.
+    std::atomic<uint32_t> mLostChunks;
+
+    /// The transmitter continues with the ring after the last popped one.
+    size_t mNextRing = 0u;
+
+    /// The waiting sides are signalled only if they said so, so normally
+    /// neither the producers nor the transmitter touch the mutex.
+    std::atomic<bool>       mTransmitterWaiting;
+    std::atomic<uint32_t>   mProducersWaiting;
+    std::mutex              mWaitMutex;
+    std::condition_variable mTransmitterCondition;
+    std::condition_variable mProducerCondition;
 
     /// Used to force transmission of partially filled buffer in a defined
     /// period of time.
@@ -97,24 +191,26 @@ namespace nowtech {
       uint32_t                     mTimeout;
       std::function<void()>        mLambda;
       std::mutex                   mMutex;
-      std::unique_lock<std::mutex> mLock;
       std::condition_variable      mConditionVariable;
-      std::thread                  mThread;
+      /// Set before the thread starts, otherwise it might find them false and exit at once.
       std::atomic<bool>            mKeepRunning;
       std::atomic<bool>            mAlarmed;
+      std::thread                  mThread;
 
     public:
       FreeRtosTimer(uint32_t const aTimeout, std::function<void()> aLambda)
       : mTimeout(aTimeout)
       , mLambda(aLambda) 
-      , mLock(mMutex)
+      , mKeepRunning(true)
+      , mAlarmed(false)
       , mThread(&nowtech::LogStdThreadOstream::FreeRtosTimer::run, this) {
-        mKeepRunning.store(true);
-        mAlarmed.store(false);
       }
 
       ~FreeRtosTimer() noexcept {
-        mKeepRunning.store(false);
+        {
+          std::lock_guard<std::mutex> lock(mMutex);
+          mKeepRunning.store(false);
+        }
         mConditionVariable.notify_one();
         mThread.join();
       }
@@ -122,7 +218,10 @@ namespace nowtech {
       void run() noexcept;
 
       void start() noexcept {
-        mAlarmed.store(true);
+        {
+          std::lock_guard<std::mutex> lock(mMutex);
+          mAlarmed.store(true);
+        }
         mConditionVariable.notify_one();
       }
     } mRefreshTimer;
@@ -130,6 +229,39 @@ namespace nowtech {
     /// The output stream to use.
     std::ostream &mOutput;
 
+    /// Buffers the text from mDecoder for the stream.
+    class OutputSink final : public BanCopyMove {
+      static constexpr size_t cLength = 256u;
+
+      std::ostream               &mOutput;
+      std::array<char, cLength>   mBuffer;
+      size_t                      mIndex = 0u;
+
+    public:
+      OutputSink(std::ostream &aOutput) noexcept : mOutput(aOutput) {
+      }
+
+      ~OutputSink() noexcept {
+        mOutput.write(mBuffer.data(), mIndex);
+      }
+
+      void push(char const aChar) noexcept {
+        mBuffer[mIndex++] = aChar;
+        if(mIndex == cLength) {
+          mOutput.write(mBuffer.data(), mIndex);
+          mIndex = 0u;
+        }
+        else { // nothing to do
+        }
+      }
+    };
+
+    /// See LogConfig::deferredFormatting.
+    bool const mDeferredFormatting;
+
+    /// Used only on the transmitter thread.
+    LogDecoder mDecoder;
+
     /// The transmitter task.
     std::thread *mTransmitterThread;
 
@@ -152,13 +284,25 @@ namespace nowtech {
     LogStdThreadOstream(std::ostream &aOutput
       , LogConfig const & aConfig)
       : LogOsInterface(aConfig)
-      , mQueue(aConfig.queueLength, mChunkSize)
+      , mGeneration(sNextGeneration.fetch_add(1u) + 1u)
+      , mRingLength(aConfig.queueLength)
+      , mRingCount(0u)
+      , mLostChunks(0u)
+      , mTransmitterWaiting(false)
+      , mProducersWaiting(0u)
       , mRefreshTimer(mRefreshPeriod, [this]{this->refreshNeeded();})
-      , mOutput(aOutput) {
+      , mOutput(aOutput)
+      , mDeferredFormatting(aConfig.deferredFormatting) {
     }
 
     virtual ~LogStdThreadOstream() {
       delete mTransmitterThread;
+      uint32_t lost = mLostChunks.load();
+      if(lost > 0u) {
+        mOutput << "-=- Lost chunks: " << lost << " -=-\n";
+      }
+      else { // nothing to do
+      }
       mOutput.flush();
     }
 
@@ -201,15 +345,15 @@ namespace nowtech {
       mTransmitterThread->join();
     };
 
-    /// Enqueues the chunks, possibly blocking if the queue is full.
-    virtual void push(char const * const aChunkStart, bool const aBlocks) noexcept {
-      mQueue.send(aChunkStart, aBlocks);
-    }
+    /// Publishes the chunk in the ring of the calling thread, copying it only if it was not reserved.
+    virtual void push(char const * const aChunkStart, bool const aBlocks) noexcept;
 
-    /// Removes the oldest chunk from the queue.
-    virtual bool pop(char * const aChunkStart) noexcept {
-      return mQueue.receive(aChunkStart, mPauseLength);
-    }
+    /// Returns the chunk at the tail of the ring of the calling thread, possibly waiting for the
+    /// transmitter if the ring is full.
+    virtual char * reserve(bool const aBlocks) noexcept;
+
+    /// Removes a chunk from the next non-empty ring, waiting at most mPauseLength if all are empty.
+    virtual bool pop(char * const aChunkStart) noexcept;
 
     /// Pauses execution for the period given in the constructor.
     virtual void pause() noexcept {
@@ -221,7 +365,13 @@ namespace nowtech {
     /// @param length length of data
     /// @param aProgressFlag address of flag to be set on transmission end.
     virtual void transmit(const char * const aBuffer, LogSizeType const aLength, std::atomic<bool> *aProgressFlag) noexcept {
-      mOutput.write(aBuffer, aLength);
+      if(mDeferredFormatting) {
+        OutputSink sink(mOutput);
+        mDecoder.decode(aBuffer, aLength, sink);
+      }
+      else {
+        mOutput.write(aBuffer, aLength);
+      }
       aProgressFlag->store(false);
     }
 
@@ -231,6 +381,19 @@ namespace nowtech {
       mRefreshTimer.start();
     }
 
+  private:
+    /// Reuses a released ring if there is any.
+    /// @return nullptr if there are too many threads.
+    ChunkRing * getThreadRing() noexcept;
+
+    char * reserve(ChunkRing * const aRing, bool const aBlocks) noexcept;
+
+    void commit(ChunkRing * const aRing) noexcept;
+
+    /// Called only by the transmitter.
+    bool popAny(char * const aChunkStart) noexcept;
+
+  public:
     /// Sets the flag.
     void refreshNeeded() noexcept {
       mRefreshNeeded->store(true);
@@ -164,6 +164,102 @@ namespace nowtech {
     void transmitIfNeeded() noexcept;
   };
 
+  /// Expands the records of LogConfig::deferredFormatting into text using the
+  /// formatting of the Log instance, so the result is the same as without deferring.
+  /// Called by the LogOsInterface on the transmitter thread, but could decode a raw log offline.
+  /// A record may be split between two transmitted buffers, so the partial one is kept.
+  class LogDecoder final : public BanCopyMove {
+    static constexpr LogSizeType cHeaderLength = 5u;
+    static constexpr LogSizeType cMaxRecordLength = cHeaderLength + Log::cDeferredMaxGroups;
+
+    uint8_t mRecord[cMaxRecordLength];
+    LogSizeType mRecordLength = 0u;
+
+  public:
+    /// @param aSink anything with push(char).
+    template<typename tSink>
+    void decode(char const * const aBuffer, LogSizeType const aLength, tSink &aSink) noexcept {
+      LogSizeType i = 0u;
+      while(i < aLength) {
+        uint8_t const byte = static_cast<uint8_t>(aBuffer[i]);
+        if(mRecordLength == 0u) {
+          if(byte == static_cast<uint8_t>(Log::cDeferredMarker)) {
+            mRecord[mRecordLength++] = byte;
+          }
+          else {
+            aSink.push(aBuffer[i]);
+          }
+          ++i;
+        }
+        else if(isValid(byte)) {
+          mRecord[mRecordLength++] = byte;
+          if(mRecordLength > cHeaderLength && mRecordLength == cHeaderLength + mRecord[cHeaderLength - 1u] - '0') {
+            expand(aSink);
+            mRecordLength = 0u;
+          }
+          else { // nothing to do
+          }
+          ++i;
+        }
+        else {
+          // broken record, possibly chunks of an other task got in at buffer overflow, this byte is text again
+          aSink.push(Log::cNumericError);
+          mRecordLength = 0u;
+        }
+      }
+    }
+
+  private:
+    /// Checks the next byte of the record.
+    bool isValid(uint8_t const aByte) const noexcept {
+      bool result;
+      if(mRecordLength == cHeaderLength - 1u) {
+        result = aByte > '0' && aByte <= '0' + Log::cDeferredMaxGroups;
+      }
+      else if(mRecordLength < cHeaderLength) {
+        result = aByte >= Log::cDeferredOffset && aByte <= Log::cDeferredOffset + Log::cDeferredLimit;
+      }
+      else {
+        result = (aByte & Log::cDeferredGroupBit) != 0u;
+      }
+      return result;
+    }
+
+    template<typename tSink>
+    void expand(tSink &aSink) noexcept {
+      uint64_t bits = 0u;
+      for(LogSizeType i = cHeaderLength; i < mRecordLength; ++i) {
+        bits |= static_cast<uint64_t>(mRecord[i] & Log::cDeferredGroupMask) << (7u * (i - cHeaderLength));
+      }
+      uint8_t const base = mRecord[2] - Log::cDeferredOffset;
+      uint8_t const fill = mRecord[3] - Log::cDeferredOffset;
+      Log &log = *Log::sInstance;
+      switch(mRecord[1]) {
+      case Log::cDeferredInt32:
+        log.format(aSink, static_cast<int32_t>(Log::unzigzag(bits)), static_cast<int32_t>(base), fill);
+        break;
+      case Log::cDeferredUint32:
+        log.format(aSink, static_cast<uint32_t>(bits), static_cast<uint32_t>(base), fill);
+        break;
+      case Log::cDeferredInt64:
+        log.format(aSink, Log::unzigzag(bits), static_cast<int64_t>(base), fill);
+        break;
+      case Log::cDeferredUint64:
+        log.format(aSink, bits, static_cast<uint64_t>(base), fill);
+        break;
+      case Log::cDeferredDouble: {
+          double value;
+          std::memcpy(&value, &bits, sizeof(value));
+          log.format(aSink, value, fill);
+        }
+        break;
+      default:
+        aSink.push(Log::cNumericError);
+        break;
+      }
+    }
+  };
+
 } // namespace nowtech
 
 #endif // NOWTECH_LOGUTIL_INCLUDED
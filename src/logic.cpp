@@ -3,11 +3,18 @@
 
 using namespace std;
 
-constexpr uint16_t Logic::cTemperatures[static_cast<int32_t>(Program::Count)][static_cast<int32_t>(MachineState::Count)];
-constexpr uint16_t Logic::cWaitMinutes[static_cast<int32_t>(Program::Count)][static_cast<int32_t>(MachineState::Count)];
+Logic::Logic(char const * const aProgramFilename, Tuning const &aTuning)
+  : mTuning(aTuning)
+  , mRemainingTime(mTuning) {
+  if(aProgramFilename != nullptr) {
+    mPrograms.load(aProgramFilename);
+  }
+  else { // nothing to do
+  }
+}
 
-bool Logic::shouldBeQueued(Event const &aEvent) const noexcept {
-  switch(aEvent.getType()) {
+bool Logic::shouldBeQueued(EventType const aType) const noexcept {
+  switch(aType) {
   case EventType::MeasuredWaterLevel:
   case EventType::MeasuredDoor:
   case EventType::Program:
@@ -18,16 +25,25 @@ bool Logic::shouldBeQueued(Event const &aEvent) const noexcept {
 }
 
 void Logic::turnOffAll() noexcept {
-  send(Event(EventType::DesiredResinWash, OnOffState::Off));
-  send(Event(EventType::DesiredCirc, OnOffState::Off));
-  send(EventType::DesiredWaterLevel, 0);
-  send(EventType::DesiredTemperature, 0);
-  send(Event(EventType::DesiredSpray, OnOffState::Off));
+  send<EventType::DesiredResinWash>(OnOffState::Off);
+  send<EventType::DesiredCirc>(OnOffState::Off);
+  send<EventType::DesiredWaterLevel>(0);
+  send<EventType::DesiredTemperature>(0);
+  send<EventType::DesiredSpray>(OnOffState::Off);
   send(Actuate::Detergent0);
   send(Actuate::Regenerate0);
   send(Actuate::Shutdown0);
 }
 
+void Logic::publishRemainingTime() noexcept {
+  std::optional<int32_t> minutes = mRemainingTime.getUpdate(mTimerManager.getPlanTime());
+  if(minutes) {
+    send<EventType::RemainingTime>(minutes.value());
+  }
+  else { // nothing to do
+  }
+}
+
 bool Logic::handleDoor(Event const &aEvent) noexcept {
   if(aEvent.getType() == EventType::MeasuredDoor) {
     if(aEvent.getDoor() == DoorState::Open) {
@@ -44,41 +60,38 @@ bool Logic::handleDoor(Event const &aEvent) noexcept {
 }
 
 void Logic::nextState() noexcept {
-  do {
-    mState = static_cast<MachineState>(static_cast<int32_t>(mState) + 1);
-  } while(mState != MachineState::Count && cTemperatures[static_cast<int>(mProgram)][static_cast<int>(mState)] == No);
-  if(mState == MachineState::Count) {
+  mTimerManager.cancelAll();
+  ++mStepIndex;
+  if(mStepIndex < mSteps->count) {
+    ProgramTable::Step const &step = mSteps->steps[mStepIndex];
+    mState = step.state;
+    mTargetTemperature = step.temperature;
+    mTargetTime = step.length;
+    mNeedDetergent = step.detergent;
+    mRemainingTime.enterStep(mStepIndex, mTimerManager.getPlanTime());
+    send(mState);
+    turnOffAll();
+    mTimerManager.schedule(mTuning.sleepBeforeNextStep, cTimerBeforeNextStep);
+  }
+  else {
     mState = MachineState::Idle;
     mProgram = Program::None;
+    mNeedDetergent = false;
+    mRemainingTime.stop();
+    send(mState);
+    send<EventType::RemainingTime>(0);
+    turnOffAll();
   }
-  else { // nothing to do
-  }
-  mTargetTemperature = cTemperatures[static_cast<int>(mProgram)][static_cast<int>(mState)];
-  mTargetTime = cWaitMinutes[static_cast<int>(mProgram)][static_cast<int>(mState)] * cUsInMinute;
-  send(mState);
-  turnOffAll();
-  mTimerManager.schedule(Config::cSleepBeforeNextStep, cTimerBeforeNextStep);
 }
 
 void Logic::process(Program const aProgram) noexcept {
   if(mState == MachineState::Idle) {
     if(aProgram != Program::Stop && aProgram != Program::None) {
       mProgram = aProgram;
+      mSteps = &mPrograms.get(mProgram);
+      mStepIndex = -1;
+      mRemainingTime.start(*mSteps, mTimerManager.getPlanTime());
       nextState();
-      int32_t remainingMilliseconds = 0;
-      MachineState state = MachineState::Drain;
-      do {
-        remainingMilliseconds += cMsInMinute * cWaitMinutes[static_cast<int>(mProgram)][static_cast<int>(state)];
-        if(state != MachineState::Dry) {
-          remainingMilliseconds += cMsInSecond * Config::cAverageFillDrainSeconds;
-        }
-        else { // nothing to do
-        }
-        do {
-          state = static_cast<MachineState>(static_cast<int32_t>(state) + 1);
-        } while(state != MachineState::Shutdown && cWaitMinutes[static_cast<int>(mProgram)][static_cast<int>(state)] == No);
-      } while(state != MachineState::Shutdown);
-      send(EventType::RemainingTime, remainingMilliseconds / cMsInMinute);
     }
     else { // nothing to do
     }
@@ -89,9 +102,10 @@ void Logic::process(Program const aProgram) noexcept {
       mTimerManager.cancelAll();
       mProgram = Program::None;
       mState = MachineState::Idle;
+      mRemainingTime.stop();
       send(mState);
       send(mProgram);
-      send(EventType::RemainingTime, 0);
+      send<EventType::RemainingTime>(0);
     }
     else { // nothing to do
     }
@@ -106,7 +120,8 @@ void Logic::doIdle(Event const &aEvent) noexcept {
 
 void Logic::doDrain(int32_t const aExpired) noexcept {
   if(aExpired == cTimerBeforeNextStep) {
-    send(EventType::DesiredWaterLevel, 0);
+    mRemainingTime.enterPhase(RemainingTimeEstimator::Phase::Drain, mTimerManager.getPlanTime());
+    send<EventType::DesiredWaterLevel>(0);
   }
   else { // nothing to do
   }
@@ -125,13 +140,15 @@ void Logic::doDrain(const Event &aEvent) noexcept {
 
 void Logic::doResinWash(int32_t const aExpired) noexcept {
   if(aExpired == cTimerBeforeNextStep) {
-    send(Event(EventType::DesiredResinWash, OnOffState::On));
-    mTimerManager.schedule(Config::cResinWashTime, cTimerResinWashReady);
+    mRemainingTime.enterPhase(RemainingTimeEstimator::Phase::Work, mTimerManager.getPlanTime());
+    send<EventType::DesiredResinWash>(OnOffState::On);
+    mTimerManager.schedule(mTuning.resinWashTime, cTimerResinWashReady);
     mResinStopProgramWhenReady = false;
     mResinWashReady = false;
   }
   else if(aExpired == cTimerResinWashReady) {
-    send(Event(EventType::DesiredResinWash, OnOffState::Off));
+    mRemainingTime.enterPhase(RemainingTimeEstimator::Phase::Drain, mTimerManager.getPlanTime());
+    send<EventType::DesiredResinWash>(OnOffState::Off);
     mResinWashReady = true;
     if(mResinStopProgramWhenReady) {
       process(Program::Stop);
@@ -164,7 +181,8 @@ void Logic::doResinWash(const Event &aEvent) noexcept {
 
 void Logic::doWash(int32_t const aExpired) noexcept {
   if(aExpired == cTimerBeforeNextStep) {
-    send(EventType::DesiredWaterLevel, Config::cWaterLevelFull);
+    mRemainingTime.enterPhase(RemainingTimeEstimator::Phase::Fill, mTimerManager.getPlanTime());
+    send<EventType::DesiredWaterLevel>(Config::cWaterLevelFull);
     mWashWaterFill = true;
     mWashWaterDrain = false;
   }
@@ -172,10 +190,11 @@ void Logic::doWash(int32_t const aExpired) noexcept {
     send(Actuate::Detergent0);
   }
   else if(aExpired == cTimerWashWash) {
-    send(Event(EventType::DesiredCirc, OnOffState::Off));
-    send(Event(EventType::DesiredSpray, OnOffState::Off));
-    send(EventType::DesiredTemperature, 0);
-    send(EventType::DesiredWaterLevel, 0);
+    mRemainingTime.enterPhase(RemainingTimeEstimator::Phase::Drain, mTimerManager.getPlanTime());
+    send<EventType::DesiredCirc>(OnOffState::Off);
+    send<EventType::DesiredSpray>(OnOffState::Off);
+    send<EventType::DesiredTemperature>(0);
+    send<EventType::DesiredWaterLevel>(0);
     mWashWaterDrain = true;
   }
   else { // nothing to do
@@ -189,16 +208,17 @@ void Logic::doWash(const Event &aEvent) noexcept {
   else if(aEvent.getType() == EventType::MeasuredWaterLevel) {
     if(mWashWaterFill == true && aEvent.getIntValue() >= Config::cWaterLevelFull) {
       mWashWaterFill = false;
-      send(EventType::DesiredTemperature, mTargetTemperature);
-      send(Event(EventType::DesiredCirc, OnOffState::On));
-      send(Event(EventType::DesiredSpray, OnOffState::On));
+      mRemainingTime.enterPhase(RemainingTimeEstimator::Phase::Work, mTimerManager.getPlanTime());
+      send<EventType::DesiredTemperature>(mTargetTemperature);
+      send<EventType::DesiredCirc>(OnOffState::On);
+      send<EventType::DesiredSpray>(OnOffState::On);
       if(mNeedDetergent) {
         send(Actuate::Detergent1);
-        mTimerManager.schedule(Config::cWashDetergentOpenTime, cTimerWashDetergent);
+        mTimerManager.schedule(mTuning.washDetergentOpenTime, cTimerWashDetergent);
       }
       else { // nothing to do
       }
-      mTimerManager.schedule(cTimerWashWash, mTargetTime);
+      mTimerManager.schedule(mTargetTime, cTimerWashWash);
     }
     else { // nothing to do
     }
@@ -215,8 +235,9 @@ void Logic::doWash(const Event &aEvent) noexcept {
 
 void Logic::doDry(int32_t const aExpired) noexcept {
   if(aExpired == cTimerBeforeNextStep) {
+    mRemainingTime.enterPhase(RemainingTimeEstimator::Phase::Work, mTimerManager.getPlanTime());
     mTimerManager.schedule(mTargetTime, cTimerDryReady);
-    mTimerManager.schedule(Config::cRegenerateValveTime, cTimerDryRegenerate);
+    mTimerManager.schedule(mTuning.regenerateValveTime, cTimerDryRegenerate);
     send(Actuate::Regenerate1);
   }
   else if(aExpired == cTimerDryRegenerate) {
@@ -250,13 +271,17 @@ void Logic::doShutdown(int32_t const aExpired) noexcept {
 }
 
 void Logic::process(const Event &aEvent) noexcept {
-  if(mErrorSoFar.load() != static_cast<int32_t>(Error::None)) {
+  if(mErrorSoFar != static_cast<int32_t>(Error::None)) {
     return; // abandon mProgram to let the display sign the mState when the error occured
   }
   if(handleDoor(aEvent) || mDoorOpen) {
     return;
   }
-  mNeedDetergent = false;
+  if(aEvent.getType() == EventType::MeasuredWaterLevel) {
+    mRemainingTime.measureLevel(aEvent.getIntValue(), mTimerManager.getPlanTime());
+  }
+  else { // nothing to do
+  }
   if(mState == MachineState::Idle) {
     doIdle(aEvent);
   }
@@ -267,15 +292,12 @@ void Logic::process(const Event &aEvent) noexcept {
     doResinWash(aEvent);
   }
   else if(mState == MachineState::PreWash
+       || mState == MachineState::Wash
        || mState == MachineState::Rinse1
        || mState == MachineState::Rinse2
        || mState == MachineState::Rinse3) {
     doWash(aEvent);
   }
-  else if(mState == MachineState::Wash) {
-    mNeedDetergent = true;
-    doWash(aEvent);
-  }
   else if(mState == MachineState::Dry) {
     doDry(aEvent);
   }
@@ -284,6 +306,7 @@ void Logic::process(const Event &aEvent) noexcept {
   else {
     ensure(false);
   }
+  publishRemainingTime();
 }
 
 void Logic::process(int32_t const aExpired) noexcept {
@@ -309,4 +332,5 @@ void Logic::process(int32_t const aExpired) noexcept {
   else {
     ensure(false);
   }
+  publishRemainingTime();
 }
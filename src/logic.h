@@ -3,6 +3,9 @@
 
 
 #include "base.h"
+#include "programtable.h"
+#include "remainingtime.h"
+#include "tuning.h"
 
 /** Performs the program logic using internal timer and measured values.
  * Sends actoator commands or desired values. */
@@ -15,43 +18,6 @@ class Logic final : public Component {
   static constexpr int32_t cTimerDryReady       = 5;
   static constexpr int32_t cTimerShutdownReady  = 6;
 
-  enum What : uint16_t {
-    No  = 0,  // not performed
-    Yes = 1  // done with cold water
-    // other value is the target temperature or time
-  };
-
-  static constexpr uint16_t cTemperatures[static_cast<int32_t>(Program::Count)][static_cast<int32_t>(MachineState::Count)] = {
-//           Idle, Drain, Resin, PreWash, Wash, Rinse1, Rinse2, Rinse3, Dry, Shutdown
-/*None*/   { No,   No,    No,    No,      No,   No,     No,     No,     No,  Yes },
-/*Stop*/   { No,   No,    No,    No,      No,   No,     No,     No,     No,  Yes },
-/*Drain*/  { No,   Yes,   No,    No,      No,   No,     No,     No,     No,  No  },
-/*Rinse*/  { No,   Yes,   No,    No,      No,   Yes,    No,     No,     No,  No  },
-/*Fast*/   { No,   Yes,   Yes,   No,      40,   Yes,    No,     Yes,    No,  Yes },
-/*FastDry*/{ No,   Yes,   Yes,   No,      40,   Yes,    No,     55,     Yes, Yes },
-/*Middle*/ { No,   Yes,   Yes,   Yes,     50,   Yes,    No,     65,     Yes, Yes },
-/*All*/    { No,   Yes,   Yes,   Yes,     50,   Yes,    Yes,    65,     Yes, Yes },
-/*Hot*/    { No,   Yes,   Yes,   Yes,     65,   Yes,    Yes,    65,     Yes, Yes },
-/*Intens.*/{ No,   Yes,   Yes,   40,      65,   Yes,    Yes,    65,     Yes, Yes },
-/*Cook*/   { No,   Yes,   No,    65,      No,   No,     No,     No,     Yes, No  }
-  };
-
-  static constexpr uint16_t cWaitMinutes[static_cast<int32_t>(Program::Count)][static_cast<int32_t>(MachineState::Count)] = {
-//                         ? TODO measure water quantity
-//           Idle, Drain, Resin, PreWash, Wash, Rinse1, Rinse2, Rinse3, Dry, Shutdown
-/*None*/   { No,   No,    No,    No,      No,   No,     No,     No,     No,  Yes },
-/*Stop*/   { No,   No,    No,    No,      No,   No,     No,     No,     No,  Yes },
-/*Drain*/  { No,   Yes,   No,    No,      No,   No,     No,     No,     No,  No  },
-/*Rinse*/  { No,   Yes,   No,    No,      No,   10,     No,     No,     No,  No  },
-/*Fast*/   { No,   Yes,   5,     No,      30,   10,     No,     10,     No,  Yes },
-/*FastDry*/{ No,   Yes,   5,     No,      30,   10,     No,     20,     50,  Yes },
-/*Middle*/ { No,   Yes,   5,     10,      60,   10,     No,     30,     50,  Yes },
-/*All*/    { No,   Yes,   5,     10,      60,   10,     10,     30,     50,  Yes },
-/*Hot*/    { No,   Yes,   5,     10,      60,   10,     10,     30,     50,  Yes },
-/*Intens.*/{ No,   Yes,   5,     10,      60,   10,     10,     30,     50,  Yes },
-/*Cook*/   { No,   Yes,   No,    60,      No,   No,     No,     No,     50,  No  }
-  };
-
   MachineState mState                     = MachineState::Idle;
   Program      mProgram                   = Program::None;
   bool         mNeedDetergent             = false;
@@ -67,6 +33,19 @@ class Logic final : public Component {
   /** Time to wait in this step, if applicable. */
   int64_t mTargetTime;               // us
 
+  Tuning const mTuning;
+  ProgramTable mPrograms;
+
+  /** Steps of the running program, and the index of the current one. */
+  ProgramTable::Steps const *mSteps = nullptr;
+  int32_t mStepIndex = 0;
+
+  RemainingTimeEstimator mRemainingTime;
+
+public:
+  /// @param aProgramFilename optional program definitions replacing the built-in ones, see ProgramTable::load
+  Logic(char const * const aProgramFilename = nullptr, Tuning const &aTuning = Tuning());
+
 protected:
   virtual char const * getTaskName() const noexcept override {
     return "logic  ";
@@ -76,14 +55,27 @@ protected:
     return true;
   }
 
-  virtual bool shouldBeQueued(Event const &aEvent) const noexcept override;
+  virtual bool shouldBeQueued(EventType const aType) const noexcept override;
+
+  virtual bool shouldCoalesce(EventType const aType) const noexcept override {
+    return aType == EventType::MeasuredWaterLevel;
+  }
+
+  /// A door opening must not overtake a program selection sent before it.
+  virtual bool shouldOvertake(EventType const) const noexcept override {
+    return false;
+  }
 
 private:
   void turnOffAll() noexcept;
+
+  /// Sends the remaining time if the estimator has a correction.
+  void publishRemainingTime() noexcept;
   bool handleDoor(Event const &aEvent) noexcept;
 
-  /** MachineState transition according to program.
-   * Every do* function must assure that all signals are shut down before this occurs. */
+  /** MachineState transition according to program, advances to the next precompiled step.
+   * Every do* function must assure that all signals are shut down before this occurs.
+   * The timers of the previous step are cancelled. */
   void nextState() noexcept;
 
   /** Stops it only if prg is Program::Stop */
@@ -0,0 +1,37 @@
+#include "notifier.h"
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <ctime>
+
+Notifier::Notifier() noexcept : mDescriptor(eventfd(0u, EFD_NONBLOCK | EFD_CLOEXEC)) {
+}
+
+Notifier::~Notifier() noexcept {
+  if(mDescriptor != cInvalidDescriptor) {
+    close(mDescriptor);
+  }
+  else { // nothing to do
+  }
+}
+
+void Notifier::signal() noexcept {
+  uint64_t increment = 1u;
+  // Fails only if the counter would overflow, but then it is signalled anyway.
+  static_cast<void>(write(mDescriptor, &increment, sizeof(increment)));
+}
+
+bool Notifier::wait(int64_t const aTimeout) noexcept {
+  pollfd descriptor{mDescriptor, POLLIN, 0};
+  int64_t length = (aTimeout > 0 ? aTimeout : 0);
+  timespec timeout{static_cast<time_t>(length / cUsInSecond), static_cast<long>(length % cUsInSecond * cNsInUs)};
+  bool result = false;
+  if(ppoll(&descriptor, 1u, &timeout, nullptr) > 0 && (descriptor.revents & POLLIN) != 0) {
+    uint64_t counter;
+    static_cast<void>(read(mDescriptor, &counter, sizeof(counter)));
+    result = true;
+  }
+  else { // nothing to do, timeout or interrupted
+  }
+  return result;
+}
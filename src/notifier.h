@@ -0,0 +1,34 @@
+#ifndef DISHWASHER_NOTIFIER_INCLUDED
+#define DISHWASHER_NOTIFIER_INCLUDED
+
+#include "bancopymove.h"
+#include <cstdint>
+
+/// Wakes up a single waiting thread. Built on a Linux eventfd, whose counter keeps a signal
+/// until the waiter consumes it, so there is no lost wakeup window between checking the queue and waiting.
+/// Producers should signal only when the watched queue becomes non-empty.
+class Notifier final : public BanCopyMove {
+  static constexpr int32_t cInvalidDescriptor = -1;
+  static constexpr int64_t cUsInSecond        = 1000000;
+  static constexpr int64_t cNsInUs            = 1000;
+
+  int32_t mDescriptor;
+
+public:
+  Notifier() noexcept;
+  ~Notifier() noexcept;
+
+  operator bool() const noexcept {
+    return mDescriptor != cInvalidDescriptor;
+  }
+
+  /// May be called from any thread.
+  void signal() noexcept;
+
+  /// Waits until signalled or the timeout elapses, and consumes the pending signals.
+  /// @param aTimeout us
+  /// @return true if it was signalled.
+  bool wait(int64_t const aTimeout) noexcept;
+};
+
+#endif // DISHWASHER_NOTIFIER_INCLUDED
@@ -3,8 +3,8 @@
 
 using namespace std;
 
-bool Output::shouldBeQueued(const Event &e) const noexcept {
-    switch(e.getType()) {
+bool Output::shouldBeQueued(EventType const aType) const noexcept {
+    switch(aType) {
     case EventType::MDoor:
     case EventType::Actuate:
         return true;
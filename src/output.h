@@ -21,8 +21,8 @@ protected:
     return false;
   }
 
-  virtual bool shouldBeQueued(Event const &aEvent) const noexcept override {
-    switch(aEvent.getType()) {
+  virtual bool shouldBeQueued(EventType const aType) const noexcept override {
+    switch(aType) {
     case EventType::MeasuredDoor:
     case EventType::Actuate:
         return true;
@@ -0,0 +1,151 @@
+#include "plant.h"
+#include "dishwash.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+constexpr int64_t Plant::cCamSegments[Plant::cCamSegmentCount];
+
+Plant::Plant(int32_t const aSamplePeriod) : Component(), mSamplePeriod(aSamplePeriod) {
+  for(int32_t i = 0; i < cCamSegmentCount; ++i) {
+    mCamCycle += cCamSegments[i];
+  }
+  mTimerManager.schedule(mSamplePeriod, cTimerSample);
+}
+
+bool Plant::shouldBeQueued(EventType const aType) const noexcept {
+  switch(aType) {
+  case EventType::Actuate:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void Plant::integrate(double const aStep) noexcept {
+  if(mFill) {
+    double inflow = Config::cFillFlowRate * aStep;
+    mWaterTemperature = (mWaterTemperature * mWater + cInletTemperature * inflow) / (mWater + inflow);
+    mWater += inflow;
+  }
+  else { // nothing to do
+  }
+  if(mDrain) {
+    mWater = max(0.0, mWater - Config::cDrainFlowRate * aStep);
+  }
+  else { // nothing to do
+  }
+  double transfer = (mWater > cElementCoverVolume ? cElementTransferWet : cElementTransferDry) * (mElementTemperature - mWaterTemperature);
+  double power = mHeat ? Config::cHeaterPower : 0.0;
+  mElementTemperature += (power - transfer) / cElementHeatCapacity * aStep;
+  if(mWater > 0.0) {
+    mWaterTemperature += (transfer - cHeatLoss * (mWaterTemperature - cAmbientTemperature)) / (mWater * cWaterHeatCapacity) * aStep;
+  }
+  else {
+    mWaterTemperature = mElementTemperature;
+  }
+}
+
+int32_t Plant::getPumpCurrent(bool const aRunning, int64_t const aRunTime, int32_t const aNominal, int32_t const aDry) noexcept {
+  int32_t result = 0;
+  if(aRunning) {
+    result = mWater > cPumpPrimeVolume ? aNominal : aDry;
+    if(aRunTime < cInrushTime) {
+      result += result * (cInrushTime - aRunTime) / cInrushTime;
+    }
+    else { // nothing to do
+    }
+    mRandom = mRandom * 1664525u + 1013904223u;
+    result += static_cast<int32_t>(mRandom >> cCurrentNoiseShift) - cCurrentNoiseOffset;
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
+OnOffState Plant::getSprayContact() const noexcept {
+  int64_t position = mCamPosition;
+  int32_t segment = 0;
+  while(segment < cCamSegmentCount - 1 && position >= cCamSegments[segment]) {
+    position -= cCamSegments[segment];
+    ++segment;
+  }
+  return segment % 2 == 0 ? OnOffState::Off : OnOffState::On;
+}
+
+void Plant::sample() noexcept {
+  int32_t steps = static_cast<int32_t>(ceil(mSamplePeriod / (cUsInSecond * cMaxIntegrationStep)));
+  double step = static_cast<double>(mSamplePeriod) / cUsInSecond / steps;
+  for(int32_t i = 0; i < steps; ++i) {
+    integrate(step);
+  }
+  mCircRunning = mCirculate ? mCircRunning + mSamplePeriod : 0;
+  mDrainRunning = mDrain ? mDrainRunning + mSamplePeriod : 0;
+  if(mSpray) {
+    mCamPosition = (mCamPosition + mSamplePeriod) % mCamCycle;
+  }
+  else { // nothing to do
+  }
+
+  if(mDoorSent != DoorState::Closed) {
+    mDoorSent = DoorState::Closed;
+    send(Event(mDoorSent));
+  }
+  else { // nothing to do
+  }
+  if(mSaltSent != OnOffState::On) {
+    mSaltSent = OnOffState::On;
+    send<EventType::MeasuredSalt>(mSaltSent);
+  }
+  else { // nothing to do
+  }
+  if(mLeakSent != OnOffState::Off) {
+    mLeakSent = OnOffState::Off;
+    send<EventType::MeasuredLeak>(mLeakSent);
+  }
+  else { // nothing to do
+  }
+  OnOffState spray = getSprayContact();
+  if(mSpraySent != spray) {
+    mSpraySent = spray;
+    send<EventType::MeasuredSpray>(mSpraySent);
+  }
+  else { // nothing to do
+  }
+  double sump = mCirculate ? max(0.0, mWater - cCirculationHoldup) : mWater;
+  send<EventType::MeasuredWaterLevel>(static_cast<int32_t>(lround(sump / Config::cWaterPerLevel)));
+  send<EventType::MeasuredTemperature>(static_cast<int32_t>(lround(mWaterTemperature)));
+  send<EventType::MeasuredCircCurrent>(getPumpCurrent(mCirculate, mCircRunning, cCircCurrentNominal, cCircCurrentDry));
+  send<EventType::MeasuredDrainCurrent>(getPumpCurrent(mDrain, mDrainRunning, cDrainCurrentNominal, cDrainCurrentDry));
+}
+
+void Plant::process(Event const &aEvent) noexcept {
+  Actuate actuate = aEvent.getActuate();
+  if(actuate == Actuate::Heat0 || actuate == Actuate::Heat1) {
+    mHeat = actuate == Actuate::Heat1;
+  }
+  else if(actuate == Actuate::Drain0 || actuate == Actuate::Drain1) {
+    mDrain = actuate == Actuate::Drain1;
+  }
+  else if(actuate == Actuate::Fill0 || actuate == Actuate::Fill1) {
+    mFill = actuate == Actuate::Fill1;
+  }
+  else if(actuate == Actuate::Circ0 || actuate == Actuate::Circ1) {
+    mCirculate = actuate == Actuate::Circ1;
+  }
+  else if(actuate == Actuate::Spray0 || actuate == Actuate::Spray1) {
+    mSpray = actuate == Actuate::Spray1;
+  }
+  else { // nothing to do
+  }
+}
+
+void Plant::process(int32_t const aExpired) noexcept {
+  if(aExpired == cTimerSample) {
+    mTimerManager.schedule(mSamplePeriod, cTimerSample);
+    sample();
+  }
+  else { // nothing to do
+  }
+}
@@ -0,0 +1,100 @@
+#ifndef DISHWASHER_PLANT_INCLUDED
+#define DISHWASHER_PLANT_INCLUDED
+
+#include "base.h"
+
+/** Simulates the physical machine instead of the sensors for the test version and simulations.
+ * Integrates the water volume, the water and heating element temperatures, the pump currents and
+ * the spray selector cam position from Actuate events. Sends the analog measurements on each sample,
+ * the digital ones only on change. Each sample advances the model with the nominal sample period,
+ * so the time dividor speeds up the plant together with the timers. */
+class Plant final : public Component {
+  static constexpr int32_t cTimerSample              =      0;
+
+  static constexpr int32_t cDefaultSamplePeriod      = 100000; // us
+  /// Longer samples are integrated in more steps to keep the thermal model stable.
+  static constexpr double  cMaxIntegrationStep       =      0.5;  // s
+
+  static constexpr double  cInletTemperature         =     15.0;  // Celsius
+  static constexpr double  cAmbientTemperature       =     22.0;  // Celsius
+  static constexpr double  cWaterHeatCapacity        =      4.186; // J/(ml K)
+  static constexpr double  cElementHeatCapacity      =    400.0;  // J/K
+  static constexpr double  cElementTransferWet       =    100.0;  // W/K
+  static constexpr double  cElementTransferDry       =      2.0;  // W/K
+  static constexpr double  cElementCoverVolume       =    800.0;  // ml
+  static constexpr double  cHeatLoss                 =      3.0;  // W/K
+  /// Water taken out of the sump by the circulation into the pipes and spray arms.
+  static constexpr double  cCirculationHoldup        =    800.0;  // ml
+  /// Water needed to prime the pumps.
+  static constexpr double  cPumpPrimeVolume          =    300.0;  // ml
+
+  static constexpr int32_t cCircCurrentNominal       =    250;    // mA
+  static constexpr int32_t cCircCurrentDry           =    120;    // mA
+  static constexpr int32_t cDrainCurrentNominal      =     90;    // mA
+  static constexpr int32_t cDrainCurrentDry          =     60;    // mA
+  static constexpr int64_t cInrushTime               = 300000;    // us
+  static constexpr int32_t cCurrentNoiseShift        =     29;    // leaves 3 bits
+  static constexpr int32_t cCurrentNoiseOffset       =      4;
+
+  static constexpr int32_t cCamSegmentCount          =      6;
+  /// Cam segments in order. Contact is off in the even and on in the odd segments.
+  static constexpr int64_t cCamSegments[cCamSegmentCount] = {
+    Config::cSprayChangeUpOn,
+    Config::cSprayChangeUpOff,
+    Config::cSprayChangeDownOn,
+    Config::cSprayChangeDownOff,
+    Config::cSprayChangeBothOn,
+    Config::cSprayChangeBothOff
+  };
+
+  int32_t const mSamplePeriod;
+
+  bool    mHeat       = false;
+  bool    mDrain      = false;
+  bool    mFill       = false;
+  bool    mCirculate  = false;
+  bool    mSpray      = false;
+
+  double  mWater              = 0.0;                  // ml
+  double  mWaterTemperature   = cAmbientTemperature;  // Celsius
+  double  mElementTemperature = cAmbientTemperature;  // Celsius
+  int64_t mCircRunning        = 0;                    // us since switch on
+  int64_t mDrainRunning       = 0;                    // us since switch on
+  int64_t mCamPosition        = 0;                    // us in the cam cycle
+  int64_t mCamCycle           = 0;                    // us
+  uint32_t mRandom            = 1u;
+
+  DoorState  mDoorSent   = DoorState::Invalid;
+  OnOffState mSaltSent   = OnOffState::Invalid;
+  OnOffState mLeakSent   = OnOffState::Invalid;
+  OnOffState mSpraySent  = OnOffState::Invalid;
+
+public:
+  /// @param aSamplePeriod simulated time between measurements in us
+  Plant(int32_t const aSamplePeriod = cDefaultSamplePeriod);
+  virtual ~Plant() noexcept {
+  }
+
+protected:
+  virtual char const * getTaskName() const noexcept override {
+    return "plant  ";
+  }
+
+  virtual bool shouldHaltOnError() const noexcept override {
+    return false;
+  }
+
+  virtual bool shouldBeQueued(EventType const aType) const noexcept override;
+
+private:
+  void integrate(double const aStep) noexcept;
+  int32_t getPumpCurrent(bool const aRunning, int64_t const aRunTime, int32_t const aNominal, int32_t const aDry) noexcept;
+  OnOffState getSprayContact() const noexcept;
+  void sample() noexcept;
+
+  virtual void process(Event const &aEvent) noexcept override;
+
+  virtual void process(int32_t const aExpired) noexcept override;
+};
+
+#endif // DISHWASHER_PLANT_INCLUDED
@@ -0,0 +1,106 @@
+#include "programtable.h"
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+
+bool ProgramTable::load(char const * const aFilename) noexcept {
+  bool result = true;
+  uint16_t temperatures[cProgramCount][cStateCount];
+  uint16_t waitMinutes[cProgramCount][cStateCount];
+  bool listed[cProgramCount] = {};
+  memcpy(temperatures, cTemperatures, sizeof(temperatures));
+  memcpy(waitMinutes, cWaitMinutes, sizeof(waitMinutes));
+  try {
+    std::ifstream file(aFilename);
+    if(file) {
+      std::string line;
+      int32_t lineNumber = 0;
+      while(result && std::getline(file, line)) {
+        ++lineNumber;
+        result = parseLine(line, temperatures, waitMinutes, listed);
+        if(!result) {
+          Log::i(nowtech::LogApp::cSystem) << "Invalid program in " << aFilename << " line " << lineNumber << Log::end;
+        }
+        else { // nothing to do
+        }
+      }
+    }
+    else {
+      Log::i(nowtech::LogApp::cSystem) << "Could not open programs " << aFilename << Log::end;
+      result = false;
+    }
+  }
+  catch(std::exception &e) {
+    Log::i(nowtech::LogApp::cSystem) << "Exception while reading " << aFilename << ": " << e.what() << Log::end;
+    result = false;
+  }
+  for(int32_t program = 0; result && program < cProgramCount; ++program) {
+    result = isValid(temperatures[program], waitMinutes[program]);
+    if(!result) {
+      Log::i(nowtech::LogApp::cSystem) << "Invalid program " << Event::cStrProgram[program + 1] << " in " << aFilename << Log::end;
+    }
+    else { // nothing to do
+    }
+  }
+  if(result) {
+    for(int32_t program = 0; program < cProgramCount; ++program) {
+      mPrograms[program] = compile(temperatures[program], waitMinutes[program]);
+    }
+    Log::i(nowtech::LogApp::cSystem) << "Programs loaded from " << aFilename << Log::end;
+  }
+  else {
+    Log::i(nowtech::LogApp::cSystem) << "Using the built-in programs." << Log::end;
+  }
+  return result;
+}
+
+bool ProgramTable::parseLine(std::string const &aLine, uint16_t (&aTemperatures)[cProgramCount][cStateCount], uint16_t (&aWaitMinutes)[cProgramCount][cStateCount], bool (&aListed)[cProgramCount]) {
+  bool result = true;
+  std::istringstream tokens(aLine);
+  std::string programName;
+  if(tokens >> programName && programName[0] != '#') {
+    std::string stateName;
+    std::string temperatureName;
+    int32_t minutes = 0;
+    result = static_cast<bool>(tokens >> stateName >> temperatureName >> minutes);
+    // the string arrays start with Invalid
+    int32_t program = find(Event::cStrProgram, programName) - 1;
+    int32_t state = find(Event::cStrMachineState, stateName) - 1;
+    // None and Stop are used by Logic itself
+    result = result && program > static_cast<int32_t>(Program::Stop) && program < cProgramCount;
+    result = result && state > static_cast<int32_t>(MachineState::Idle) && state < cStateCount;
+    result = result && minutes >= Yes && minutes <= UINT16_MAX;
+    int32_t temperature = Yes;
+    if(result && temperatureName != "cold") {
+      char *end;
+      temperature = static_cast<int32_t>(strtol(temperatureName.c_str(), &end, 10));
+      result = (*end == '\0' && temperature > Yes && temperature <= Config::cTempMax);
+    }
+    else { // nothing to do
+    }
+    std::string rest;
+    result = result && !(tokens >> rest);
+    if(result) {
+      if(!aListed[program]) {
+        aListed[program] = true;
+        for(int32_t i = 0; i < cStateCount; ++i) {
+          aTemperatures[program][i] = No;
+          aWaitMinutes[program][i] = No;
+        }
+      }
+      else { // nothing to do
+      }
+      result = (aTemperatures[program][state] == No);   // no duplicate steps
+      aTemperatures[program][state] = static_cast<uint16_t>(temperature);
+      aWaitMinutes[program][state] = static_cast<uint16_t>(minutes);
+    }
+    else { // nothing to do
+    }
+  }
+  else { // nothing to do, empty line or comment
+  }
+  return result;
+}
@@ -0,0 +1,172 @@
+#ifndef DISHWASHER_PROGRAMTABLE_INCLUDED
+#define DISHWASHER_PROGRAMTABLE_INCLUDED
+
+#include "base.h"
+#include <array>
+#include <string>
+#include <cstring>
+
+/** Washing programs compiled into step lists at compile time, so Logic only has to
+ * advance an index on each state transition. New programs are added to the matrices below.
+ * The built-in programs may be replaced at startup from a text file, see load(). */
+class ProgramTable final {
+public:
+  static constexpr int32_t cProgramCount = static_cast<int32_t>(Program::Count);
+  static constexpr int32_t cStateCount   = static_cast<int32_t>(MachineState::Count);
+  /// Idle is never a step.
+  static constexpr int32_t cMaxStepCount = cStateCount - 1;
+  static constexpr int32_t cUsInMinute   = 60000000;
+
+  enum What : uint16_t {
+    No  = 0,  // not performed
+    Yes = 1  // done with cold water
+    // other value is the target temperature or time
+  };
+
+  static constexpr uint16_t cTemperatures[cProgramCount][cStateCount] = {
+//           Idle, Drain, Resin, PreWash, Wash, Rinse1, Rinse2, Rinse3, Dry, Shutdown
+/*None*/   { No,   No,    No,    No,      No,   No,     No,     No,     No,  Yes },
+/*Stop*/   { No,   No,    No,    No,      No,   No,     No,     No,     No,  Yes },
+/*Drain*/  { No,   Yes,   No,    No,      No,   No,     No,     No,     No,  No  },
+/*Rinse*/  { No,   Yes,   No,    No,      No,   Yes,    No,     No,     No,  No  },
+/*Fast*/   { No,   Yes,   Yes,   No,      40,   Yes,    No,     Yes,    No,  Yes },
+/*FastDry*/{ No,   Yes,   Yes,   No,      40,   Yes,    No,     55,     Yes, Yes },
+/*Middle*/ { No,   Yes,   Yes,   Yes,     50,   Yes,    No,     65,     Yes, Yes },
+/*All*/    { No,   Yes,   Yes,   Yes,     50,   Yes,    Yes,    65,     Yes, Yes },
+/*Hot*/    { No,   Yes,   Yes,   Yes,     65,   Yes,    Yes,    65,     Yes, Yes },
+/*Intens.*/{ No,   Yes,   Yes,   40,      65,   Yes,    Yes,    65,     Yes, Yes },
+/*Cook*/   { No,   Yes,   No,    65,      No,   No,     No,     No,     Yes, No  }
+  };
+
+  static constexpr uint16_t cWaitMinutes[cProgramCount][cStateCount] = {
+//                         ? TODO measure water quantity
+//           Idle, Drain, Resin, PreWash, Wash, Rinse1, Rinse2, Rinse3, Dry, Shutdown
+/*None*/   { No,   No,    No,    No,      No,   No,     No,     No,     No,  Yes },
+/*Stop*/   { No,   No,    No,    No,      No,   No,     No,     No,     No,  Yes },
+/*Drain*/  { No,   Yes,   No,    No,      No,   No,     No,     No,     No,  No  },
+/*Rinse*/  { No,   Yes,   No,    No,      No,   10,     No,     No,     No,  No  },
+/*Fast*/   { No,   Yes,   5,     No,      30,   10,     No,     10,     No,  Yes },
+/*FastDry*/{ No,   Yes,   5,     No,      30,   10,     No,     20,     50,  Yes },
+/*Middle*/ { No,   Yes,   5,     10,      60,   10,     No,     30,     50,  Yes },
+/*All*/    { No,   Yes,   5,     10,      60,   10,     10,     30,     50,  Yes },
+/*Hot*/    { No,   Yes,   5,     10,      60,   10,     10,     30,     50,  Yes },
+/*Intens.*/{ No,   Yes,   5,     10,      60,   10,     10,     30,     50,  Yes },
+/*Cook*/   { No,   Yes,   No,    60,      No,   No,     No,     No,     50,  No  }
+  };
+
+  struct Step final {
+    MachineState state;
+    /// Celsius, 0 is no heating.
+    int32_t      temperature;
+    /// us to wait in the step, if applicable.
+    int64_t      length;
+    bool         detergent;
+  };
+
+  struct Steps final {
+    std::array<Step, cMaxStepCount> steps;
+    int32_t count;
+  };
+
+  /// Checks a row pair of the matrices: a state is performed iff it has a time, Idle is never
+  /// performed, and the temperatures do not exceed Config::cTempMax.
+  static constexpr bool isValid(uint16_t const (&aTemperatures)[cStateCount], uint16_t const (&aWaitMinutes)[cStateCount]) noexcept {
+    bool result = aTemperatures[static_cast<int32_t>(MachineState::Idle)] == No;
+    for(int32_t state = 0; state < cStateCount; ++state) {
+      result = result && ((aTemperatures[state] == No) == (aWaitMinutes[state] == No));
+      result = result && aTemperatures[state] <= Config::cTempMax;
+    }
+    return result;
+  }
+
+  static constexpr bool isValid() noexcept {
+    bool result = true;
+    for(int32_t program = 0; program < cProgramCount; ++program) {
+      result = result && isValid(cTemperatures[program], cWaitMinutes[program]);
+    }
+    return result;
+  }
+
+  /// Turns a row pair into the list of performed steps.
+  static constexpr Steps compile(uint16_t const (&aTemperatures)[cStateCount], uint16_t const (&aWaitMinutes)[cStateCount]) noexcept {
+    Steps result{};
+    for(int32_t state = static_cast<int32_t>(MachineState::Idle) + 1; state < cStateCount; ++state) {
+      if(aTemperatures[state] != No) {
+        Step &step = result.steps[result.count];
+        step.state = static_cast<MachineState>(state);
+        step.temperature = (aTemperatures[state] == Yes ? 0 : aTemperatures[state]);
+        step.length = static_cast<int64_t>(aWaitMinutes[state]) * cUsInMinute;
+        step.detergent = (step.state == MachineState::Wash);
+        ++result.count;
+      }
+      else { // nothing to do
+      }
+    }
+    return result;
+  }
+
+  static constexpr std::array<Steps, cProgramCount> compile() noexcept {
+    std::array<Steps, cProgramCount> result{};
+    for(int32_t program = 0; program < cProgramCount; ++program) {
+      result[program] = compile(cTemperatures[program], cWaitMinutes[program]);
+    }
+    return result;
+  }
+
+  /// The compiled matrices, defined below the class, because the class must be complete to compile them.
+  static std::array<Steps, cProgramCount> const cBuiltIn;
+
+  static constexpr Steps const & getBuiltIn(Program const aProgram) noexcept {
+    return cBuiltIn[static_cast<int32_t>(aProgram)];
+  }
+
+private:
+  /// Step lists of all the programs in one flat array.
+  std::array<Steps, cProgramCount> mPrograms = cBuiltIn;
+
+public:
+  /** Replaces the built-in programs listed in the file. Each non-empty line which does not start
+   * with # defines a step:
+   *   <program> <state> <temperature> <minutes>
+   * using the names of the Program and MachineState values, cold or Celsius for the temperature.
+   * A listed program contains only its listed steps, always in MachineState order.
+   * On any error, including running out of memory while reading, the whole file is rejected
+   * and the built-in programs remain.
+   * @return true if the file was loaded. */
+  bool load(char const * const aFilename) noexcept;
+
+  Steps const & get(Program const aProgram) const noexcept {
+    return mPrograms[static_cast<int32_t>(aProgram)];
+  }
+
+  /// @return the index of the name in a padded string array like Event::cStrProgram, or -1
+  template<size_t tCount, size_t tSize>
+  static int32_t find(char const (&aNames)[tCount][tSize], std::string const &aName) noexcept;
+
+private:
+  /// May throw std::bad_alloc.
+  static bool parseLine(std::string const &aLine, uint16_t (&aTemperatures)[cProgramCount][cStateCount], uint16_t (&aWaitMinutes)[cProgramCount][cStateCount], bool (&aListed)[cProgramCount]);
+};
+
+static_assert(ProgramTable::isValid(), "Malformed program row in cTemperatures or cWaitMinutes.");
+
+inline constexpr std::array<ProgramTable::Steps, ProgramTable::cProgramCount> ProgramTable::cBuiltIn = ProgramTable::compile();
+
+template<size_t tCount, size_t tSize>
+int32_t ProgramTable::find(char const (&aNames)[tCount][tSize], std::string const &aName) noexcept {
+  int32_t result = -1;
+  for(size_t i = 0u; result < 0 && i < tCount; ++i) {
+    size_t length = strlen(aNames[i]);
+    while(length > 0u && aNames[i][length - 1u] == ' ') {
+      --length;
+    }
+    if(aName.size() == length && aName.compare(0u, length, aNames[i], length) == 0) {
+      result = static_cast<int32_t>(i);
+    }
+    else { // nothing to do
+    }
+  }
+  return result;
+}
+
+#endif // DISHWASHER_PROGRAMTABLE_INCLUDED
@@ -0,0 +1,41 @@
+#include "pumpmonitor.h"
+
+using namespace std;
+
+void PumpMonitor::expect(bool const aRunning, int64_t const aNow) noexcept {
+  if(aRunning != mRunning) {
+    mRunning = aRunning;
+    mChanged = aNow;
+    mBlock.clear();
+  }
+  else { // nothing to do
+  }
+}
+
+Error PumpMonitor::measure(int32_t const aCurrent, int64_t const aNow) noexcept {
+  Error result = Error::None;
+  if(aNow - mChanged >= Config::cCurrentSettleTime) {
+    mBlock.add(aCurrent);
+    if(mRunning) {
+      mLifetime.add(aCurrent);
+    }
+    else { // nothing to do
+    }
+    if(mBlock.getCount() >= cBlockLength) {
+      if(mRunning && mBlock.getMean() < mMinCurrent) {
+        result = mConnectorError;
+      }
+      else if(!mRunning && mBlock.getMean() > mMinCurrent / 2) {
+        result = mStuckError;
+      }
+      else { // nothing to do
+      }
+      mBlock.clear();
+    }
+    else { // nothing to do
+    }
+  }
+  else { // nothing to do, the inrush current or the spin-down
+  }
+  return result;
+}
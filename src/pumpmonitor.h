@@ -0,0 +1,78 @@
+#ifndef DISHWASHER_PUMPMONITOR_INCLUDED
+#define DISHWASHER_PUMPMONITOR_INCLUDED
+
+#include "base.h"
+#include <cmath>
+
+/** Checks a pump against its expected state from the current samples for Automat. The samples from
+ * Config::cCurrentSettleTime after each change are accumulated in blocks with Welford's method, and
+ * each full block is decided on. A running pump drawing less than the minimal current has a bad
+ * connector, a pump drawing over half of it while off has a stuck relay. So an error is raised at
+ * most two blocks after the settle time. The running current statistics are kept for the whole
+ * lifetime too, because wear shows up as rising current. The times are plan times in us. */
+class PumpMonitor final {
+public:
+  /// Running mean and variance without storing the samples.
+  class Welford final {
+    int32_t mCount = 0;
+    double  mMean  = 0.0;
+    double  mM2    = 0.0;
+
+  public:
+    void add(double const aSample) noexcept {
+      ++mCount;
+      double delta = aSample - mMean;
+      mMean += delta / mCount;
+      mM2 += delta * (aSample - mMean);
+    }
+
+    void clear() noexcept {
+      mCount = 0;
+      mMean = 0.0;
+      mM2 = 0.0;
+    }
+
+    int32_t getCount() const noexcept {
+      return mCount;
+    }
+
+    double getMean() const noexcept {
+      return mMean;
+    }
+
+    double getStdDev() const noexcept {
+      return mCount > 1 ? std::sqrt(mM2 / (mCount - 1)) : 0.0;
+    }
+  };
+
+private:
+  static constexpr int32_t cBlockLength = 5;  // samples
+
+  int32_t const mMinCurrent;
+  Error const   mConnectorError;
+  Error const   mStuckError;
+
+  bool    mRunning = false;
+  int64_t mChanged = 0;
+  Welford mBlock;
+  Welford mLifetime;
+
+public:
+  /// @param aMinCurrent mA a running pump draws at least
+  PumpMonitor(int32_t const aMinCurrent, Error const aConnectorError, Error const aStuckError) noexcept
+  : mMinCurrent(aMinCurrent), mConnectorError(aConnectorError), mStuckError(aStuckError) {
+  }
+
+  /// Must be called when the pump is expected to start or stop, including the door cutting the power.
+  void expect(bool const aRunning, int64_t const aNow) noexcept;
+
+  /// @return Error::None if the pump follows the expected state.
+  Error measure(int32_t const aCurrent, int64_t const aNow) noexcept;
+
+  /// Over all the settled samples of the running pump.
+  Welford const & getLifetime() const noexcept {
+    return mLifetime;
+  }
+};
+
+#endif // DISHWASHER_PUMPMONITOR_INCLUDED
@@ -0,0 +1,137 @@
+#include "remainingtime.h"
+#include <algorithm>
+
+using namespace std;
+
+RemainingTimeEstimator::RemainingTimeEstimator(Tuning const &aTuning) noexcept
+  : mTuning(aTuning)
+  , mFillRate(static_cast<double>(Config::cFillFlowRate) / Config::cWaterPerLevel)
+  , mDrainRate(static_cast<double>(Config::cDrainFlowRate) / Config::cWaterPerLevel) {
+}
+
+void RemainingTimeEstimator::start(ProgramTable::Steps const &aSteps, int64_t const aNow) noexcept {
+  mSteps = &aSteps;
+  mPublishedAt = aNow;
+  enterStep(0, aNow);
+}
+
+void RemainingTimeEstimator::enterStep(int32_t const aIndex, int64_t const aNow) noexcept {
+  mStepIndex = aIndex;
+  mPublishNow = true;
+  enterPhase(Phase::Pause, aNow);
+}
+
+void RemainingTimeEstimator::enterPhase(Phase const aPhase, int64_t const aNow) noexcept {
+  mPhase = aPhase;
+  mPhaseStart = aNow;
+  mAnchorLevel = mLevel;
+  mAnchorTime = aNow;
+}
+
+void RemainingTimeEstimator::measureLevel(int32_t const aLevel, int64_t const aNow) noexcept {
+  mLevel = aLevel;
+  int32_t change = aLevel - mAnchorLevel;
+  bool rising = (mPhase == Phase::Fill && change > 0);
+  bool falling = (mPhase == Phase::Drain && change < 0);
+  if(!rising && !falling) {
+    // also restarts the measurement if the level moves the wrong way
+    if(change != 0) {
+      mAnchorLevel = aLevel;
+      mAnchorTime = aNow;
+    }
+    else { // nothing to do
+    }
+  }
+  else if(abs(change) >= cMinRateLevelChange) {
+    learn(rising ? mFillRate : mDrainRate, abs(change), aNow - mAnchorTime);
+    mAnchorLevel = aLevel;
+    mAnchorTime = aNow;
+  }
+  else { // nothing to do, wait for more change
+  }
+}
+
+int64_t RemainingTimeEstimator::estimate(int64_t const aNow) const noexcept {
+  int64_t result = 0;
+  if(mSteps != nullptr && mPhase != Phase::Done && mStepIndex < mSteps->count) {
+    result = getStepRemaining(mSteps->steps[mStepIndex], mPhase, aNow - mPhaseStart, mLevel);
+    for(int32_t i = mStepIndex + 1; i < mSteps->count; ++i) {
+      result += getStepRemaining(mSteps->steps[i], Phase::Pause, 0, 0);
+    }
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
+std::optional<int32_t> RemainingTimeEstimator::getUpdate(int64_t const aNow) noexcept {
+  std::optional<int32_t> result;
+  if(mPhase != Phase::Done) {
+    int32_t minutes = static_cast<int32_t>((estimate(aNow) + cUsInMinute - 1) / cUsInMinute);
+    int32_t shown = std::max<int32_t>(mPublished - static_cast<int32_t>((aNow - mPublishedAt) / cUsInMinute), 0);
+    if(mPublishNow || (abs(minutes - shown) > cPublishTolerance && aNow - mPublishedAt >= cMinPublishInterval)) {
+      mPublished = minutes;
+      mPublishedAt = aNow;
+      mPublishNow = false;
+      result = minutes;
+    }
+    else { // nothing to do
+    }
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
+bool RemainingTimeEstimator::isWashing(MachineState const aState) noexcept {
+  return aState == MachineState::PreWash || aState == MachineState::Wash
+      || aState == MachineState::Rinse1 || aState == MachineState::Rinse2 || aState == MachineState::Rinse3;
+}
+
+int64_t RemainingTimeEstimator::getStepRemaining(ProgramTable::Step const &aStep, Phase const aPhase, int64_t const aElapsed, int32_t const aLevel) const noexcept {
+  int64_t result = 0;
+  bool washing = isWashing(aStep.state);
+  if(aStep.state != MachineState::Shutdown) {   // lasts until power off
+    if(aPhase == Phase::Pause) {
+      result += std::max<int64_t>(mTuning.sleepBeforeNextStep - aElapsed, 0);
+    }
+    else { // nothing to do
+    }
+    if(aPhase <= Phase::Fill && washing) {
+      result += getFillTime(aLevel);
+    }
+    else { // nothing to do
+    }
+    if(aPhase <= Phase::Work) {
+      int64_t length = (aStep.state == MachineState::Resin ? mTuning.resinWashTime : aStep.length);
+      length = (washing || aStep.state == MachineState::Resin || aStep.state == MachineState::Dry ? length : 0);
+      result += std::max<int64_t>(length - (aPhase == Phase::Work ? aElapsed : 0), 0);
+    }
+    else { // nothing to do
+    }
+    if(aStep.state != MachineState::Dry) {
+      result += getDrainTime(washing && aPhase < Phase::Drain ? Config::cWaterLevelFull : aLevel);
+    }
+    else { // nothing to do
+    }
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
+int64_t RemainingTimeEstimator::getFillTime(int32_t const aFrom) const noexcept {
+  return static_cast<int64_t>(std::max(Config::cWaterLevelFull - aFrom, 0) / mFillRate * cUsInSecond);
+}
+
+int64_t RemainingTimeEstimator::getDrainTime(int32_t const aFrom) const noexcept {
+  return static_cast<int64_t>(std::max(aFrom - Config::cWaterLevelHisteresis, 0) / mDrainRate * cUsInSecond);
+}
+
+void RemainingTimeEstimator::learn(double &aRate, int32_t const aChange, int64_t const aLength) noexcept {
+  if(aLength > 0) {
+    aRate += cRateWeight * (aChange * cUsInSecond / aLength - aRate);
+  }
+  else { // nothing to do
+  }
+}
@@ -0,0 +1,92 @@
+#ifndef DISHWASHER_REMAININGTIME_INCLUDED
+#define DISHWASHER_REMAININGTIME_INCLUDED
+
+#include "programtable.h"
+#include "tuning.h"
+#include <optional>
+
+/** Estimates the remaining time of the running program for Logic. The fill and drain rates
+ * are learnt from the measured water levels, so the estimate follows the actual machine.
+ * The times are plan times in us, see TimerManager::getPlanTime.
+ * Heating runs parallel with the wash timer in Logic, so it does not take part here. */
+class RemainingTimeEstimator final {
+public:
+  /// Parts of a step in order. Each step has all of them, but some are empty for some steps.
+  enum class Phase : uint8_t {
+    Pause,  // Tuning::sleepBeforeNextStep
+    Fill,
+    Work,   // washing, resin wash or drying
+    Drain,
+    Done    // no program is running
+  };
+
+private:
+  /// Smaller level changes give too noisy rate measurements.
+  static constexpr int32_t cMinRateLevelChange = 10;       // mm
+  /// EWMA weight of a new rate measurement.
+  static constexpr double  cRateWeight         = 0.25;
+  static constexpr double  cUsInSecond         = 1000000.0;
+  /// Corrections are not published more often, the display counts down by itself.
+  static constexpr int64_t cMinPublishInterval = 60000000; // us
+  /// Smaller differences from the countdown are not published.
+  static constexpr int32_t cPublishTolerance   = 1;        // minutes
+  static constexpr int64_t cUsInMinute         = ProgramTable::cUsInMinute;
+
+  Tuning const &mTuning;
+
+  ProgramTable::Steps const *mSteps = nullptr;
+  int32_t mStepIndex                = 0;
+  Phase   mPhase                    = Phase::Done;
+  int64_t mPhaseStart               = 0;
+  int32_t mLevel                    = 0;
+
+  /// mm/s
+  double  mFillRate;
+  double  mDrainRate;
+
+  /// Start of the current rate measurement.
+  int32_t mAnchorLevel              = 0;
+  int64_t mAnchorTime               = 0;
+
+  /// The last published value in minutes and its time.
+  int32_t mPublished                = 0;
+  int64_t mPublishedAt              = 0;
+  bool    mPublishNow               = false;
+
+public:
+  RemainingTimeEstimator(Tuning const &aTuning) noexcept;
+
+  void start(ProgramTable::Steps const &aSteps, int64_t const aNow) noexcept;
+
+  void stop() noexcept {
+    mPhase = Phase::Done;
+    mSteps = nullptr;
+  }
+
+  /// Starts the step with its Pause phase.
+  void enterStep(int32_t const aIndex, int64_t const aNow) noexcept;
+
+  void enterPhase(Phase const aPhase, int64_t const aNow) noexcept;
+
+  /// Should be called with all the measured levels, even without a running program.
+  void measureLevel(int32_t const aLevel, int64_t const aNow) noexcept;
+
+  /// @return us until the end of the program, 0 without one.
+  int64_t estimate(int64_t const aNow) const noexcept;
+
+  /// @return minutes to publish if the estimate differs from what the display counts down
+  /// more than the tolerance and the last publication is old enough, or a new step has started.
+  std::optional<int32_t> getUpdate(int64_t const aNow) noexcept;
+
+private:
+  static bool isWashing(MachineState const aState) noexcept;
+
+  /// @return us left from the step starting with aPhase, which has been lasting for aElapsed.
+  int64_t getStepRemaining(ProgramTable::Step const &aStep, Phase const aPhase, int64_t const aElapsed, int32_t const aLevel) const noexcept;
+
+  int64_t getFillTime(int32_t const aFrom) const noexcept;
+  int64_t getDrainTime(int32_t const aFrom) const noexcept;
+  void    learn(double &aRate, int32_t const aChange, int64_t const aLength) noexcept;
+};
+
+#endif // DISHWASHER_REMAININGTIME_INCLUDED
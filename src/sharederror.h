@@ -0,0 +1,45 @@
+#ifndef DISHWASHER_SHAREDERROR_INCLUDED
+#define DISHWASHER_SHAREDERROR_INCLUDED
+
+#include "bancopymove.h"
+#include <atomic>
+#include <cstdint>
+
+/// The errors raised so far in all the components, ORed into a single word on its own cache line.
+/// The upper half is an epoch counter incremented whenever a new error bit appears, so the
+/// readers can poll it with a single load and look at the bits only if it has changed.
+/// Raising an error already present does not touch the line at all.
+class SharedError final : public BanCopyMove {
+  static constexpr size_t   cCacheLine  = 64u;
+  static constexpr uint32_t cEpochShift = 32u;
+  static constexpr uint64_t cErrorMask  = 0xffffffffu;
+
+  alignas(cCacheLine) std::atomic<uint64_t> mState = 0u;
+
+public:
+  /// Called from any thread.
+  /// @return the bits of aErrors not raised before, 0 if there were none.
+  int32_t raise(int32_t const aErrors) noexcept {
+    uint64_t state = mState.load(std::memory_order_acquire);
+    uint32_t fresh = static_cast<uint32_t>(aErrors) & ~getErrors(state);
+    while(fresh != 0u && !mState.compare_exchange_weak(state, ((state >> cEpochShift) + 1u) << cEpochShift | (state & cErrorMask) | fresh,
+                                                       std::memory_order_acq_rel, std::memory_order_acquire)) {
+      fresh = static_cast<uint32_t>(aErrors) & ~getErrors(state);
+    }
+    return static_cast<int32_t>(fresh);
+  }
+
+  uint64_t load() const noexcept {
+    return mState.load(std::memory_order_acquire);
+  }
+
+  static uint32_t getEpoch(uint64_t const aState) noexcept {
+    return static_cast<uint32_t>(aState >> cEpochShift);
+  }
+
+  static uint32_t getErrors(uint64_t const aState) noexcept {
+    return static_cast<uint32_t>(aState & cErrorMask);
+  }
+};
+
+#endif // DISHWASHER_SHAREDERROR_INCLUDED
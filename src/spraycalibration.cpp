@@ -0,0 +1,181 @@
+#include "spraycalibration.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+
+using namespace std;
+
+constexpr int64_t SprayCalibration::cNominal[];
+
+SprayCalibration::SprayCalibration(char const * const aFilename) noexcept : mFilename(aFilename) {
+  std::copy(std::begin(cNominal), std::end(cNominal), mModel.begin());
+  if(mFilename != nullptr) {
+    load();
+  }
+  else { // nothing to do
+  }
+}
+
+int64_t SprayCalibration::scale(int64_t const aNominal) const noexcept {
+  int64_t cycle = 0;
+  for(auto const segment : mModel) {
+    cycle += segment;
+  }
+  return aNominal * cycle / cNominalCycle;
+}
+
+void SprayCalibration::startSearch() noexcept {
+  mSearching = true;
+  mIntervalCount = 0;
+  mLastEdge = cNever;
+  mSegment = cInvalidSegment;
+  save(false);
+}
+
+bool SprayCalibration::fit() noexcept {
+  mSearching = false;
+  // the intervals before the shortest segment can not be aligned
+  int32_t first = 0;
+  while(first < mIntervalCount && mIntervals[first] >= cShortLimit) {
+    ++first;
+  }
+  bool result = (mIntervalCount - first >= cSegmentCount);
+  std::array<int64_t, cSegmentCount> model;
+  for(int32_t segment = 0; result && segment < cSegmentCount; ++segment) {
+    std::array<int64_t, cMaxSampleCount> samples;
+    int32_t count = 0;
+    for(int32_t i = first + segment; i < mIntervalCount; i += cSegmentCount) {
+      samples[count++] = mIntervals[i];
+    }
+    std::nth_element(samples.begin(), samples.begin() + count / 2, samples.begin() + count);
+    int64_t median = samples[count / 2];
+    int64_t sum = 0;
+    int32_t inliers = 0;
+    for(int32_t i = 0; i < count; ++i) {
+      if(std::abs(samples[i] - median) <= cOutlierRatio * median) {
+        sum += samples[i];
+        ++inliers;
+      }
+      else { // nothing to do
+      }
+    }
+    // the median itself is always an inlier
+    model[segment] = sum / inliers;
+    result = std::abs(model[segment] - cNominal[segment]) <= cFitTolerance * cNominal[segment];
+  }
+  // the cam is in the segment after the last interval
+  int32_t segment = (mIntervalCount - first) % cSegmentCount;
+  result = result && isContactOn(segment) == (mContact == OnOffState::On);
+  if(result) {
+    mModel = model;
+    mModelValid = true;
+    mSegment = segment;
+    mOutliers = 0;
+    Log::i(nowtech::LogApp::cSystem) << "Spray cam fitted on " << mIntervalCount << " intervals, cycle "
+                                     << static_cast<int32_t>(scale(cNominalCycle) / 1000) << " ms" << Log::end;
+    save(true);
+  }
+  else {
+    Log::i(nowtech::LogApp::cError) << "Spray cam fit failed on " << mIntervalCount << " intervals" << Log::end;
+    mSegment = cInvalidSegment;
+  }
+  return result;
+}
+
+void SprayCalibration::motor(bool const aOn) noexcept {
+  mRunning = aOn;
+  if(!mSearching) {
+    // the interval from the start or until the stop is not a complete segment
+    mLastEdge = cNever;
+  }
+  else { // nothing to do
+  }
+}
+
+void SprayCalibration::contact(OnOffState const aContact, int64_t const aNow) noexcept {
+  if(mContact == OnOffState::Invalid) {
+    if(mSegment != cInvalidSegment && isContactOn(mSegment) != (aContact == OnOffState::On)) {
+      Log::i(nowtech::LogApp::cSystem) << "Persisted spray position contradicts the contact" << Log::end;
+      mSegment = cInvalidSegment;
+    }
+    else { // nothing to do
+    }
+  }
+  else if(aContact == mContact) {
+    // nothing to do
+  }
+  else if(mSearching) {
+    if(mLastEdge != cNever && mIntervalCount < cMaxIntervalCount) {
+      mIntervals[mIntervalCount++] = aNow - mLastEdge;
+    }
+    else { // nothing to do
+    }
+    mLastEdge = aNow;
+  }
+  else if(mSegment != cInvalidSegment) {
+    int32_t passed = mSegment;
+    mSegment = (mSegment + 1) % cSegmentCount;
+    if(mLastEdge != cNever) {
+      track(passed, aNow - mLastEdge);
+    }
+    else { // nothing to do
+    }
+    mLastEdge = (mRunning ? aNow : cNever);
+  }
+  else { // nothing to do
+  }
+  mContact = aContact;
+}
+
+void SprayCalibration::track(int32_t const aSegment, int64_t const aInterval) noexcept {
+  int64_t &model = mModel[aSegment];
+  if(std::abs(aInterval - model) <= cOutlierRatio * model) {
+    model += static_cast<int64_t>(cWeight * (aInterval - model));
+    mOutliers = 0;
+  }
+  else if(++mOutliers >= cMaxOutliers) {
+    Log::i(nowtech::LogApp::cError) << "Spray cam lost, needs a search" << Log::end;
+    mModelValid = false;
+    mSegment = cInvalidSegment;
+  }
+  else { // nothing to do
+  }
+}
+
+void SprayCalibration::save(bool const aPositionKnown) const noexcept {
+  if(mFilename != nullptr) {
+    // the segment first, then the segment lengths in us
+    std::ofstream file(mFilename, std::ios::trunc);
+    file << (aPositionKnown && mModelValid ? mSegment : cInvalidSegment);
+    for(auto const segment : mModel) {
+      file << ' ' << segment;
+    }
+    file << '\n';
+    if(!file) {
+      Log::i(nowtech::LogApp::cError) << "Could not save the spray model " << mFilename << Log::end;
+    }
+    else { // nothing to do
+    }
+  }
+  else { // nothing to do
+  }
+}
+
+void SprayCalibration::load() noexcept {
+  std::ifstream file(mFilename);
+  std::array<int64_t, cSegmentCount> model;
+  int32_t segment;
+  bool valid = static_cast<bool>(file >> segment) && segment >= cInvalidSegment && segment < cSegmentCount;
+  for(int32_t i = 0; valid && i < cSegmentCount; ++i) {
+    valid = static_cast<bool>(file >> model[i]) && std::abs(model[i] - cNominal[i]) <= cFitTolerance * cNominal[i];
+  }
+  if(valid) {
+    mModel = model;
+    mModelValid = true;
+    mSegment = segment;
+    Log::i(nowtech::LogApp::cSystem) << "Spray model loaded from " << mFilename << Log::end;
+  }
+  else {
+    Log::i(nowtech::LogApp::cSystem) << "No valid spray model in " << mFilename << ", the cam needs a search" << Log::end;
+  }
+}
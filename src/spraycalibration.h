@@ -0,0 +1,104 @@
+#ifndef DISHWASHER_SPRAYCALIBRATION_INCLUDED
+#define DISHWASHER_SPRAYCALIBRATION_INCLUDED
+
+#include "base.h"
+#include <array>
+
+/** Calibration of the spray selector cam for Automat. The search runs the motor for a while and
+ * records the contact intervals. The fit aligns them on the shortest segment and takes the median
+ * of each segment with the outliers rejected. Later each complete segment passed during the spray
+ * changes updates the model, so it follows the motor slowing down. The model and the cam position
+ * are persisted, so the search is needed only if they are missing or turn out invalid.
+ * The times are plan times in us, see TimerManager::getPlanTime. */
+class SprayCalibration final {
+public:
+  static constexpr int32_t cSegmentCount    = 6;
+  static constexpr int32_t cInvalidSegment  = -1;
+
+private:
+  static constexpr int32_t cMaxIntervalCount = 30;
+  static constexpr int32_t cMaxSampleCount   = cMaxIntervalCount / cSegmentCount + 1;
+  static constexpr int64_t cNever            = -1;
+  /// Cam segments in order from the upper position. Contact is off in the even and on in the odd segments.
+  static constexpr int64_t cNominal[cSegmentCount] = {
+    Config::cSprayChangeUpOn,
+    Config::cSprayChangeUpOff,
+    Config::cSprayChangeDownOn,
+    Config::cSprayChangeDownOff,
+    Config::cSprayChangeBothOn,
+    Config::cSprayChangeBothOff
+  };
+  static constexpr int64_t cNominalCycle     = cNominal[0] + cNominal[1] + cNominal[2] + cNominal[3] + cNominal[4] + cNominal[5];
+  /// Only the first segment is shorter than this.
+  static constexpr int64_t cShortLimit       = (Config::cSprayChangeUpOn + Config::cSprayChangeBothOn) / 2;
+  /// Samples farther from the median or the model are outliers.
+  static constexpr double  cOutlierRatio     = 0.15;
+  /// A fitted segment must be this close to the nominal one.
+  static constexpr double  cFitTolerance     = 0.3;
+  /// EWMA weight of a segment passed during a spray change.
+  static constexpr double  cWeight           = 0.2;
+  /// So many outliers in a row mean a slipping or a stuck cam.
+  static constexpr int32_t cMaxOutliers      = 3;
+
+  char const * const mFilename;
+  std::array<int64_t, cSegmentCount> mModel;
+  bool       mModelValid    = false;
+  /// The segment the cam is in now.
+  int32_t    mSegment       = cInvalidSegment;
+  OnOffState mContact       = OnOffState::Invalid;
+  bool       mRunning       = false;
+  bool       mSearching     = false;
+  /// Only while the motor runs, so the interval from it is a complete segment.
+  int64_t    mLastEdge      = cNever;
+  int32_t    mOutliers      = 0;
+
+  std::array<int64_t, cMaxIntervalCount> mIntervals;
+  int32_t    mIntervalCount = 0;
+
+public:
+  /// @param aFilename of the persisted model, nullptr for none
+  SprayCalibration(char const * const aFilename) noexcept;
+
+  /// The search can be skipped.
+  bool isValid() const noexcept {
+    return mModelValid && mSegment != cInvalidSegment;
+  }
+
+  bool isSearching() const noexcept {
+    return mSearching;
+  }
+
+  /// @return cInvalidSegment if unknown.
+  int32_t getSegment() const noexcept {
+    return mSegment;
+  }
+
+  /// @return aNominal scaled by the speed of the cam in the model.
+  int64_t scale(int64_t const aNominal) const noexcept;
+
+  void startSearch() noexcept;
+
+  /// Fits the model on the intervals of the search, and saves it on success.
+  bool fit() noexcept;
+
+  /// Must be called on each motor switching.
+  void motor(bool const aOn) noexcept;
+
+  /// Must be called on each measurement, the first one is checked against the persisted segment.
+  void contact(OnOffState const aContact, int64_t const aNow) noexcept;
+
+  /// Saves the position only if aPositionKnown, otherwise a crash while moving would leave a wrong one.
+  void save(bool const aPositionKnown) const noexcept;
+
+private:
+  void load() noexcept;
+
+  /// Updates the model with a complete segment passed during a spray change.
+  void track(int32_t const aSegment, int64_t const aInterval) noexcept;
+
+  static bool isContactOn(int32_t const aSegment) noexcept {
+    return aSegment % 2 == 1;
+  }
+};
+
+#endif // DISHWASHER_SPRAYCALIBRATION_INCLUDED
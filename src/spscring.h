@@ -0,0 +1,85 @@
+#ifndef DISHWASHER_SPSCRING_INCLUDED
+#define DISHWASHER_SPSCRING_INCLUDED
+
+#include "bancopymove.h"
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+/// Wait-free bounded ring for exactly one producer and one consumer thread.
+/// The items are stored contiguously, the two indices live on separate cache lines,
+/// and each side caches the other's index to touch the shared line only when the cached one runs out.
+/// The capacity is rounded up to a power of two.
+template<typename tItem>
+class SpscRing final : public BanCopyMove {
+  static constexpr size_t cCacheLine = 64u;
+
+  size_t const mCapacity;
+  size_t const mMask;
+  std::unique_ptr<tItem[]> mItems;
+
+  /// Written by the consumer.
+  alignas(cCacheLine) std::atomic<size_t> mHead = 0u;
+  /// Consumer copy of mTail.
+  size_t mCachedTail = 0u;
+
+  /// Written by the producer.
+  alignas(cCacheLine) std::atomic<size_t> mTail = 0u;
+  /// Producer copy of mHead.
+  size_t mCachedHead = 0u;
+
+public:
+  /// May throw std::bad_alloc.
+  SpscRing(size_t const aCapacity)
+    : mCapacity(roundUp(aCapacity))
+    , mMask(mCapacity - 1u)
+    , mItems(new tItem[mCapacity]) {
+  }
+
+  /// Called only by the producer.
+  /// @return false if the ring is full.
+  bool push(tItem const &aItem) noexcept {
+    size_t tail = mTail.load(std::memory_order_relaxed);
+    if(tail - mCachedHead == mCapacity) {
+      mCachedHead = mHead.load(std::memory_order_acquire);
+    }
+    else { // nothing to do
+    }
+    bool result = tail - mCachedHead < mCapacity;
+    if(result) {
+      mItems[tail & mMask] = aItem;
+      mTail.store(tail + 1u, std::memory_order_release);
+    }
+    else { // nothing to do
+    }
+    return result;
+  }
+
+  /// Called only by the consumer.
+  /// @return the oldest item or nullptr if the ring is empty. Valid until pop().
+  tItem const * front() noexcept {
+    size_t head = mHead.load(std::memory_order_relaxed);
+    if(head == mCachedTail) {
+      mCachedTail = mTail.load(std::memory_order_acquire);
+    }
+    else { // nothing to do
+    }
+    return head == mCachedTail ? nullptr : &mItems[head & mMask];
+  }
+
+  /// Called only by the consumer after front() returned an item.
+  void pop() noexcept {
+    mHead.store(mHead.load(std::memory_order_relaxed) + 1u, std::memory_order_release);
+  }
+
+private:
+  static size_t roundUp(size_t const aCapacity) noexcept {
+    size_t result = 1u;
+    while(result < aCapacity) {
+      result <<= 1u;
+    }
+    return result;
+  }
+};
+
+#endif // DISHWASHER_SPSCRING_INCLUDED
@@ -1,25 +1,91 @@
 #include "staticerror.h"
 #include "dishwash.h"
+#include <algorithm>
 
 using namespace std;
 
-bool StaticError::shouldBeQueued(const Event &e) const noexcept {
-    switch(e.getType()) {
+constexpr int32_t StaticError::cWindowLengths[];
+constexpr StaticError::Limit StaticError::cLimits[];
+
+bool StaticError::shouldBeQueued(EventType const aType) const noexcept {
+    switch(aType) {
     case EventType::MeasuredLeak:
     case EventType::MeasuredCircCurrent:
     case EventType::MeasuredDrainCurrent:
     case EventType::MeasuredWaterLevel:
     case EventType::MeasuredTemperature:
+    case EventType::Actuate:
         return true;
     default:
         return false;
     }
 }
 
-void StaticError::process(const Event &event) noexcept {
+void StaticError::push(Signal const aSignal, int32_t const aValue) noexcept {
+  int32_t const length = cWindowLengths[static_cast<int32_t>(aSignal)];
+  Window &window = mWindows[static_cast<int32_t>(aSignal)];
+  window.samples[window.next] = aValue;
+  window.next = (window.next + 1) % length;
+  window.count = std::min(window.count + 1, length);
+  window.min = aValue;
+  window.max = aValue;
+  window.last = aValue;
+  for(int32_t i = 0; i < window.count; ++i) {
+    window.min = std::min(window.min, window.samples[i]);
+    window.max = std::max(window.max, window.samples[i]);
+  }
+}
 
+int32_t StaticError::evaluate(int64_t const aNow) const noexcept {
+  int32_t result = static_cast<int32_t>(Error::None);
+  for(auto const &limit : cLimits) {
+    int32_t const signal = static_cast<int32_t>(limit.signal);
+    Window const &window = mWindows[signal];
+    int32_t low = (limit.instant ? window.last : window.min);
+    int32_t high = (limit.instant ? window.last : window.max);
+    bool armed = (window.count >= (limit.instant ? 1 : cWindowLengths[signal])) & !(limit.settle & (aNow < mSettleUntil[signal]));
+    bool violated = (low > limit.max) | (high < limit.min);
+    result |= -static_cast<int32_t>(armed & violated) & static_cast<int32_t>(limit.error);
+  }
+  return result;
 }
 
-void StaticError::process(int32_t const aExpired) noexcept {
+void StaticError::process(Event const &aEvent) noexcept {
+  EventType type = aEvent.getType();
+  int64_t now = mTimerManager.getPlanTime();
+  if(type == EventType::Actuate) {
+    Actuate actuate = aEvent.getActuate();
+    if(actuate == Actuate::Circ1) {
+      mSettleUntil[static_cast<int32_t>(Signal::CircCurrent)] = now + Config::cCurrentSettleTime;
+    }
+    else if(actuate == Actuate::Drain1) {
+      mSettleUntil[static_cast<int32_t>(Signal::DrainCurrent)] = now + Config::cCurrentSettleTime;
+    }
+    else { // nothing to do
+    }
+  }
+  else if(type >= EventType::MeasuredLeak && type <= EventType::MeasuredTemperature) {
+    Signal signal = static_cast<Signal>(static_cast<int32_t>(type) - static_cast<int32_t>(EventType::MeasuredLeak));
+    push(signal, type == EventType::MeasuredLeak ? static_cast<int32_t>(aEvent.getOnOff()) : aEvent.getIntValue());
+    int32_t fresh = evaluate(now) & ~mRaised;
+    if(fresh != static_cast<int32_t>(Error::None)) {
+      for(auto const &limit : cLimits) {
+        if((fresh & static_cast<int32_t>(limit.error)) != 0) {
+          Window const &window = mWindows[static_cast<int32_t>(limit.signal)];
+          Log::i(nowtech::LogApp::cError) << "window " << window.min << ".." << window.max << " last " << window.last << " limits " << limit.min << ".." << limit.max << Log::end;
+          raise(limit.error, limit.reason);
+          mRaised |= static_cast<int32_t>(limit.error);
+        }
+        else { // nothing to do
+        }
+      }
+    }
+    else { // nothing to do
+    }
+  }
+  else { // nothing to do
+  }
+}
 
+void StaticError::process(int32_t const aExpired) noexcept {
 }
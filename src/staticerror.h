@@ -2,8 +2,70 @@
 #define DISHWASHER_STATICERROR_INCLUDED
 
 #include "base.h"
+#include <array>
+#include <climits>
 
+/** Checks the measurements against the fixed limits of the machine, whatever the program wants.
+ * The hard safety maxima are checked against the newest sample, so they are raised within one
+ * sample period. The range checks of the noisy analog signals keep a short window of the last
+ * samples, and are violated only if the whole window is out of range, so single spikes are filtered.
+ * The limits are in a table evaluated entirely on each sample, without allocation. The pump current
+ * limits are masked for Config::cCurrentSettleTime after switching the pump on, because of the inrush current. */
 class StaticError final : public Component {
+  /// In the order of the EventTypes from MeasuredLeak.
+  enum class Signal : int32_t {
+    Leak, CircCurrent, DrainCurrent, WaterLevel, Temperature, Count
+  };
+
+  static constexpr int32_t cSignalCount     = static_cast<int32_t>(Signal::Count);
+  static constexpr int32_t cMaxWindowLength = 4;
+  /// Samples. The digital signals are sent only on change, so they can not be windowed.
+  /// The currents have only maxima.
+  static constexpr int32_t cWindowLengths[cSignalCount] = { 1, 1, 1, cMaxWindowLength, cMaxWindowLength };
+
+  struct Limit final {
+    Signal       signal;
+    int32_t      min;
+    int32_t      max;
+    /// Masked for Config::cCurrentSettleTime after the pump is switched on.
+    bool         settle;
+    /// Only the newest sample is checked, otherwise the whole window.
+    bool         instant;
+    Error        error;
+    char const * reason;
+  };
+
+  static constexpr Limit cLimits[] = {
+    { Signal::Leak,         INT_MIN,                     static_cast<int32_t>(OnOffState::Off), false, true,  Error::Leak,          "leak" },
+    { Signal::CircCurrent,  INT_MIN,                     Config::cCirculateCurrentMax,          true,  true,  Error::CircOverload,  "circulation pump overload" },
+    { Signal::DrainCurrent, INT_MIN,                     Config::cDrainCurrentMax,              true,  true,  Error::DrainOverload, "drain pump overload" },
+    { Signal::WaterLevel,   INT_MIN,                     Config::cWaterLevelMax,                false, true,  Error::OverFill,      "water level over maximum" },
+    { Signal::WaterLevel,   Config::cWaterLevelRangeMin, Config::cWaterLevelRangeMax,           false, false, Error::InvalidSignal, "water level out of range" },
+    // the controller may overshoot by the hysteresis at the maximal program temperature
+    { Signal::Temperature,  INT_MIN,                     Config::cTempMax + Config::cTempHisteresis, false, true, Error::Overheat, "overheat" },
+    { Signal::Temperature,  Config::cTempRangeMin,       Config::cTempRangeMax,                 false, false, Error::InvalidTemp,   "temperature out of range" }
+  };
+
+  struct Window final {
+    std::array<int32_t, cMaxWindowLength> samples;
+    int32_t next  = 0;
+    /// Saturates at the window length.
+    int32_t count = 0;
+    int32_t min   = 0;
+    int32_t max   = 0;
+    int32_t last  = 0;
+  };
+
+  std::array<Window, cSignalCount>  mWindows;
+  /// us, plan time
+  std::array<int64_t, cSignalCount> mSettleUntil = {};
+  /// Each error is raised only once.
+  int32_t mRaised = 0;
+
+public:
+  virtual ~StaticError() noexcept {
+  }
+
 protected:
   virtual char const * getTaskName() const noexcept override {
     return "s_error";
@@ -13,9 +75,14 @@ protected:
     return false;
   }
 
-  virtual bool shouldBeQueued(Event const &aEvent) const noexcept override;
+  virtual bool shouldBeQueued(EventType const aType) const noexcept override;
 
 private:
+  void push(Signal const aSignal, int32_t const aValue) noexcept;
+
+  /// @return the errors of all the violated limits.
+  int32_t evaluate(int64_t const aNow) const noexcept;
+
   virtual void process(Event const &aEvent) noexcept override;
 
   virtual void process(int32_t const aExpired) noexcept override;
@@ -0,0 +1,85 @@
+#include "statistics.h"
+#include <algorithm>
+
+using namespace std;
+
+LatencyHistogram::LatencyHistogram() noexcept {
+  for(auto &bucket : mBuckets) {
+    bucket.store(0u, std::memory_order_relaxed);
+  }
+}
+
+void LatencyHistogram::record(int64_t const aValue) noexcept {
+  uint64_t value = (aValue > 0 ? aValue : 0);
+  mBuckets[getIndex(value)].fetch_add(1u, std::memory_order_relaxed);
+  mCount.fetch_add(1u, std::memory_order_relaxed);
+  mSum.fetch_add(value, std::memory_order_relaxed);
+  updateMax(mMax, static_cast<int64_t>(value));
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const noexcept {
+  Snapshot result;
+  // The buckets are summed again, because they may be updated meanwhile.
+  uint64_t count = 0u;
+  for(auto const &bucket : mBuckets) {
+    count += bucket.load(std::memory_order_relaxed);
+  }
+  result.count = count;
+  result.max   = mMax.load(std::memory_order_relaxed);
+  uint64_t recorded = mCount.load(std::memory_order_relaxed);
+  result.mean  = (recorded > 0u ? mSum.load(std::memory_order_relaxed) / static_cast<int64_t>(recorded) : 0);
+  result.p50   = getPercentile(count, 0.5);
+  result.p90   = getPercentile(count, 0.9);
+  result.p99   = getPercentile(count, 0.99);
+  result.p999  = getPercentile(count, 0.999);
+  return result;
+}
+
+int32_t LatencyHistogram::getIndex(uint64_t const aValue) noexcept {
+  int32_t result;
+  if(aValue < static_cast<uint64_t>(cSubBucketCount)) {
+    result = static_cast<int32_t>(aValue);
+  }
+  else {
+    int32_t magnitude = 63 - __builtin_clzll(aValue);  // at least cSubBucketBits
+    if(magnitude >= cMaxBits) {
+      result = cBucketCount - 1;
+    }
+    else {
+      int32_t shift = magnitude - cSubBucketBits;
+      int32_t subBucket = static_cast<int32_t>(aValue >> shift) - cSubBucketCount;
+      result = (shift + 1) * cSubBucketCount + subBucket;
+    }
+  }
+  return result;
+}
+
+int64_t LatencyHistogram::getUpperBound(int32_t const aIndex) noexcept {
+  int64_t result;
+  if(aIndex < cSubBucketCount) {
+    result = aIndex;
+  }
+  else {
+    int32_t shift = aIndex / cSubBucketCount - 1;
+    int64_t subBucket = aIndex % cSubBucketCount + cSubBucketCount;
+    result = ((subBucket + 1) << shift) - 1;
+  }
+  return result;
+}
+
+int64_t LatencyHistogram::getPercentile(uint64_t const aCount, double const aPercentile) const noexcept {
+  int64_t result = 0;
+  if(aCount > 0u) {
+    uint64_t target = static_cast<uint64_t>(aPercentile * aCount);
+    uint64_t seen = 0u;
+    int32_t index = 0;
+    while(index < cBucketCount - 1 && seen + mBuckets[index].load(std::memory_order_relaxed) <= target) {
+      seen += mBuckets[index].load(std::memory_order_relaxed);
+      ++index;
+    }
+    result = std::min(getUpperBound(index), mMax.load(std::memory_order_relaxed));
+  }
+  else { // nothing to do
+  }
+  return result;
+}
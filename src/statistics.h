@@ -0,0 +1,76 @@
+#ifndef DISHWASHER_STATISTICS_INCLUDED
+#define DISHWASHER_STATISTICS_INCLUDED
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/// Log-linear histogram of non-negative durations in us, like HdrHistogram with 1 significant digit.
+/// Each power of two range is split into cSubBucketCount linear buckets, so the relative error
+/// is at most 1 / cSubBucketCount. Recording is lock-free, so another thread may take snapshots.
+class LatencyHistogram final {
+public:
+  struct Snapshot final {
+    uint64_t count;
+    int64_t  max;   /// us
+    int64_t  mean;  /// us
+    int64_t  p50;   /// us, upper bound of the bucket
+    int64_t  p90;
+    int64_t  p99;
+    int64_t  p999;
+  };
+
+private:
+  static constexpr int32_t cSubBucketBits  = 4;
+  static constexpr int32_t cSubBucketCount = 1 << cSubBucketBits;
+  /// Values above 2^36 us (19 hours) fall in the last bucket.
+  static constexpr int32_t cMaxBits        = 36;
+  static constexpr int32_t cBucketCount    = (cMaxBits - cSubBucketBits + 1) * cSubBucketCount;
+
+  std::array<std::atomic<uint64_t>, cBucketCount> mBuckets;
+  std::atomic<uint64_t> mCount = 0u;
+  std::atomic<int64_t>  mSum   = 0;
+  std::atomic<int64_t>  mMax   = 0;
+
+public:
+  LatencyHistogram() noexcept;
+
+  /// Negative values are recorded as 0.
+  void record(int64_t const aValue) noexcept;
+
+  Snapshot snapshot() const noexcept;
+
+private:
+  static int32_t getIndex(uint64_t const aValue) noexcept;
+  static int64_t getUpperBound(int32_t const aIndex) noexcept;
+  int64_t getPercentile(uint64_t const aCount, double const aPercentile) const noexcept;
+};
+
+/// Sets aMax to aValue if that is greater. Lock-free.
+template<typename tValue>
+void updateMax(std::atomic<tValue> &aMax, tValue const aValue) noexcept {
+  tValue previous = aMax.load(std::memory_order_relaxed);
+  while(previous < aValue && !aMax.compare_exchange_weak(previous, aValue, std::memory_order_relaxed)) {
+  }
+}
+
+/// Instrumentation of a Component, written by its own thread (and the senders for the queue fields).
+class ComponentStatistics final {
+public:
+  /// From queueEvent until the start of process.
+  LatencyHistogram      queueLatency;
+  /// Duration of process for events and timers.
+  LatencyHistogram      processDuration;
+  /// Delay between the timer expiration and its processing.
+  LatencyHistogram      timerLateness;
+
+  std::atomic<uint64_t> processedEvents    = 0u;
+  std::atomic<uint64_t> coalescedEvents    = 0u;
+  std::atomic<uint64_t> expiredTimers      = 0u;
+  /// Events lost with Error::Queue.
+  std::atomic<uint64_t> droppedEvents      = 0u;
+  /// Most events waiting at the same time.
+  std::atomic<int32_t>  queueHighWater     = 0;
+};
+
+#endif // DISHWASHER_STATISTICS_INCLUDED
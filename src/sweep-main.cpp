@@ -0,0 +1,248 @@
+#include "logic.h"
+#include "automat.h"
+#include "plant.h"
+#include "accounting.h"
+#include "dishwash.h"
+#include "LogStdThreadOstream.h"
+
+#include <atomic>
+#include <bitset>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Runs full program cycles with the real Logic and Automat against the simulated Plant under the
+ * virtual clock, each with its own parameter set. The runs are distributed among all the cores,
+ * because each simulation owns its thread and clock. Accounting measures the cycles.
+ * The input file has a run in each line:
+ *   <name> [program=<Program>] [programs=<file>] [journal=<file>] [<Tuning member>=<us>]...
+ * A run with a journal replays the recorded events instead of selecting the program, see
+ * Dishwasher::replay. The Plant takes part only if the recording had one, otherwise the recorded
+ * measurements are injected, so a journal from the field reproduces the failure.
+ * Empty lines and lines starting with # are skipped. The results are printed as CSV. */
+
+class Sweep final {
+  /// Lets the plant send its initial measurements before the program selection.
+  static constexpr int64_t cSettleTime   = 2000000;                 // us
+  static constexpr int64_t cMaxCycleTime = 8LL * 3600LL * 1000000LL; // us
+  static constexpr double  cMsInSecond   = 1000.0;
+
+public:
+  struct Run final {
+    std::string name;
+    Program     program = Program::Intensive;
+    std::string programFilename;
+    std::string journalFilename;
+    Tuning      tuning;
+
+    bool        simulated    = false;
+    Accounting::Run result{};
+  };
+
+private:
+  std::vector<Run>     mRuns;
+  std::atomic<size_t>  mNextRun = 0u;
+
+public:
+  /// @return false if a line is invalid, which is reported on stderr.
+  bool load(char const * const aFilename) {
+    bool result = true;
+    std::ifstream file(aFilename);
+    if(file) {
+      std::string line;
+      int32_t lineNumber = 0;
+      while(std::getline(file, line)) {
+        ++lineNumber;
+        std::optional<Run> run = parse(line, result);
+        if(!result) {
+          std::cerr << aFilename << ':' << lineNumber << ": invalid run\n";
+          break;
+        }
+        else if(run) {
+          mRuns.push_back(run.value());
+        }
+        else { // nothing to do, empty line or comment
+        }
+      }
+    }
+    else {
+      std::cerr << "Could not open " << aFilename << '\n';
+      result = false;
+    }
+    return result;
+  }
+
+  void run(int32_t const aThreadCount) {
+    std::vector<std::thread> threads;
+    for(int32_t i = 0; i < aThreadCount; ++i) {
+      threads.emplace_back(&Sweep::work, this);
+    }
+    for(auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  void print() const {
+    std::printf("name,program,completed,cycle_s,heater_s,energy_kWh,water_l,pump_h,heating_rise_C,errors,error_mask\n");
+    for(auto const &run : mRuns) {
+      Accounting::Run const &result = run.result;
+      // a replayed journal selects its own program
+      Program program = (run.journalFilename.empty() || !result.completed ? run.program : result.program);
+      std::printf("%s,%s,%s,%.0f,%.0f,%.3f,%.2f,%.2f,%d,%zu,0x%x\n", run.name.c_str(), getProgramName(program).c_str(),
+        (run.simulated ? (result.completed ? "yes" : "no") : "failed"), result.length / cMsInSecond,
+        result.getOnTime(Accounting::Meter::Heat) / cMsInSecond, result.getEnergy(), result.getWater(), result.getPumpHours(),
+        result.heatingRise, std::bitset<32>(result.errors).count(), result.errors);
+    }
+  }
+
+private:
+  static std::string getProgramName(Program const aProgram) {
+    std::string result(Event::cStrProgram[static_cast<int32_t>(aProgram) + 1]);
+    return result.substr(0u, result.find(' '));
+  }
+
+  static std::optional<Run> parse(std::string const &aLine, bool &aValid);
+  static bool parse(std::string const &aKey, std::string const &aValue, Run &aRun);
+
+  void work() noexcept {
+    TimerManager::useVirtualClock(0);
+    size_t index;
+    while((index = mNextRun.fetch_add(1u)) < mRuns.size()) {
+      simulate(mRuns[index]);
+    }
+  }
+
+  static void simulate(Run &aRun) noexcept;
+};
+
+std::optional<Sweep::Run> Sweep::parse(std::string const &aLine, bool &aValid) {
+  std::optional<Run> result;
+  std::istringstream tokens(aLine);
+  std::string name;
+  if(tokens >> name && name[0] != '#') {
+    Run run;
+    run.name = name;
+    std::string token;
+    while(aValid && tokens >> token) {
+      size_t separator = token.find('=');
+      aValid = (separator != std::string::npos && parse(token.substr(0u, separator), token.substr(separator + 1u), run));
+    }
+    aValid = aValid && run.tuning.isValid() && (run.programFilename.empty() || ProgramTable().load(run.programFilename.c_str()))
+                    && (run.journalFilename.empty() || JournalReader(run.journalFilename.c_str()));
+    result = run;
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
+bool Sweep::parse(std::string const &aKey, std::string const &aValue, Run &aRun) {
+  bool result = true;
+  if(aKey == "program") {
+    // the string array starts with Invalid, None and Stop do not make a cycle
+    int32_t program = ProgramTable::find(Event::cStrProgram, aValue) - 1;
+    result = (program > static_cast<int32_t>(Program::Stop) && program < ProgramTable::cProgramCount);
+    aRun.program = static_cast<Program>(program);
+  }
+  else if(aKey == "programs") {
+    aRun.programFilename = aValue;
+  }
+  else if(aKey == "journal") {
+    aRun.journalFilename = aValue;
+  }
+  else {
+    char *end;
+    int32_t value = static_cast<int32_t>(strtol(aValue.c_str(), &end, 10));
+    result = (*end == '\0');
+    if(aKey == "sleepBeforeNextStep") {
+      aRun.tuning.sleepBeforeNextStep = value;
+    }
+    else if(aKey == "resinWashTime") {
+      aRun.tuning.resinWashTime = value;
+    }
+    else if(aKey == "washDetergentOpenTime") {
+      aRun.tuning.washDetergentOpenTime = value;
+    }
+    else if(aKey == "regenerateValveTime") {
+      aRun.tuning.regenerateValveTime = value;
+    }
+    else if(aKey == "sprayChangeKeepPosition") {
+      aRun.tuning.sprayChangeKeepPosition = value;
+    }
+    else if(aKey == "heaterPwmPeriod") {
+      aRun.tuning.heaterPwmPeriod = value;
+    }
+    else {
+      result = false;
+    }
+  }
+  return result;
+}
+
+void Sweep::simulate(Run &aRun) noexcept {
+  try {
+    Logic logic(aRun.programFilename.empty() ? nullptr : aRun.programFilename.c_str(), aRun.tuning);
+    Automat automat(nullptr, aRun.tuning);
+    Plant plant;
+    Accounting accounting;
+    if(aRun.journalFilename.empty()) {
+      Dishwasher dishwasher({&logic, &automat, &plant, &accounting});
+      dishwasher.simulate(cSettleTime);
+      dishwasher.send(nullptr, Event(aRun.program));
+      // an error also finishes the run
+      dishwasher.simulate(cMaxCycleTime, [&accounting]{ return accounting.getRunCount() > 0; });
+    }
+    else {
+      JournalReader journal(aRun.journalFilename.c_str());
+      bool recordedPlant = false;
+      for(int32_t origin = 0; origin < journal.getComponentCount(); ++origin) {
+        recordedPlant = recordedPlant || strcmp(journal.getName(origin), plant.getName()) == 0;
+      }
+      std::unique_ptr<Dishwasher> dishwasher = (recordedPlant
+        ? std::make_unique<Dishwasher>(std::initializer_list<Component*>{&logic, &automat, &plant, &accounting})
+        : std::make_unique<Dishwasher>(std::initializer_list<Component*>{&logic, &automat, &accounting}));
+      dishwasher->replay(journal, [&accounting]{ return accounting.getRunCount() > 0; });
+    }
+    aRun.simulated = true;
+    if(accounting.getRunCount() > 0) {
+      aRun.result = accounting.getRun(0);
+    }
+    else { // nothing to do, did not finish in cMaxCycleTime
+    }
+  }
+  catch(std::exception &e) {
+    std::cerr << aRun.name << ": " << e.what() << '\n';
+  }
+}
+
+int main(int argc, char **argv) {
+  int result = 0;
+  if(argc > 1) {
+    // Nothing is registered, because the simulations run on unregistered threads. The log is still
+    // needed for the components, and they must not log concurrently.
+    nowtech::LogConfig logConfig;
+    nowtech::LogStdThreadOstream osInterface(std::cerr, logConfig);
+    nowtech::Log log(osInterface, logConfig);
+    Sweep sweep;
+    if(sweep.load(argv[1])) {
+      int32_t threadCount = (argc > 2 ? atoi(argv[2]) : static_cast<int32_t>(std::thread::hardware_concurrency()));
+      sweep.run(threadCount > 0 ? threadCount : 1);
+      sweep.print();
+    }
+    else {
+      result = 1;
+    }
+  }
+  else {
+    std::cerr << "Usage: " << argv[0] << " <runs file> [threads]\n";
+    result = 1;
+  }
+  return result;
+}
@@ -181,7 +181,7 @@ void Display::refresh() noexcept {
   static constexpr int32_t cCtrlC = 3;
   int32_t keyPressed = ::getch();
   if(std::find(cButtonsProgram, cButtonsProgram + sizeof(cButtonsProgram), keyPressed) != cButtonsProgram + sizeof(cButtonsProgram)) {
-    send(EventType::KeyPressed, static_cast<int32_t>(keyPressed));
+    send<EventType::KeyPressed>(static_cast<int32_t>(keyPressed));
   }
   else if(keyPressed == cCtrlC) {
     Dishwasher::stop();
@@ -192,13 +192,13 @@ void Display::refresh() noexcept {
       // needs to arrange it here, because won't receive the event sent by itself
       mTimerFactor = cTimerFactors[found - cButtonsTimerFactor];
       mTimerManager.setTimeDividor(mTimerFactor);
-      send(EventType::TimeFactorChanged, mTimerFactor);
+      send<EventType::TimeFactorChanged>(mTimerFactor);
       mNeedsRefresh = true;
     }
     else { // nothing to do
     }
   }
-  if(mNeedsRefresh) { // Will be enough to display the remaining time as well, because there are frequent measurements.
+  if(mNeedsRefresh) {
     mvaddstr(cStartSensorValues.y + 6, cStartSensorValues.x, Event::cStrDoorState[static_cast<int32_t>(mDoor) + 1]);
     mvaddstr(cStartSensorValues.y + 3, cStartSensorValues.x, Event::cStrOnOffState[static_cast<int32_t>(mSalt) + 1]);
     mvaddstr(cStartSensorValues.y + 5, cStartSensorValues.x, Event::cStrOnOffState[static_cast<int32_t>(mSprayContact) + 1]);
@@ -207,7 +207,7 @@ void Display::refresh() noexcept {
     mvprintw(cStartSensorValues.y + 1, cStartSensorValues.x, "%3d", mDrainCurrent);
     mvprintw(cStartSensorValues.y + 2, cStartSensorValues.x, "%3d", mWaterLevel);
     mvprintw(cStartSensorValues.y, cStartSensorValues.x, "%3d", mTemperature);
-    int32_t errorSoFar = mErrorSoFar.load();
+    int32_t errorSoFar = mErrorSoFar;
     for(int32_t i = 0; i < 31; ++i) {
       if(errorSoFar & (1 << i)) {
         mvaddstr(cStartErrorValues.y + i, cStartErrorValues.x, cErrorMessages[i]);
@@ -223,6 +223,6 @@ void Display::refresh() noexcept {
     mvprintw(cStartStateValues.y + 2, cStartStateValues.x, "%3d", mRemainingTime);
     mvprintw(cStartStateValues.y + 3, cStartStateValues.x, "%3d", mTimerFactor);
     ::refresh();
-    mNeedsRefresh = false; // TODO handle countdown
+    mNeedsRefresh = false;
   }
 }
@@ -10,8 +10,8 @@ Input::Input() : Component() {
 Input::~Input() noexcept {
 }
 
-bool Input::shouldBeQueued(Event const &aEvent) const noexcept {
-  switch(aEvent.getType()) {
+bool Input::shouldBeQueued(EventType const aType) const noexcept {
+  switch(aType) {
   case EventType::KeyPressed:
       return true;
   default:
@@ -4,10 +4,14 @@
 #include "display.h"
 #include "staticerror.h"
 #include "output.h"
+#include "plant.h"
+#include "accounting.h"
 #include "dishwash.h"
 #include "LogStdThreadOstream.h"
 
 #include <fstream>
+#include <memory>
+#include <string>
 
 int main(int argc, char **argv) {
   char defaultLogFilename[] = "dishwasher.log";
@@ -18,6 +22,7 @@ int main(int argc, char **argv) {
     logConfig.circularBufferLength = 8192u;
     logConfig.transmitBufferLength = 8192u;
     logConfig.refreshPeriod        =  200u;
+    logConfig.deferredFormatting   = true;
     std::ofstream logFile(argc == 1 ? defaultLogFilename : argv[1]);
     nowtech::LogStdThreadOstream osInterface(logFile, logConfig);
     nowtech::Log log(osInterface, logConfig);
@@ -28,12 +33,29 @@ int main(int argc, char **argv) {
     Log::registerCurrentTask("main   ");
 
     Input input;
-    Logic logic;
-    Automat automat;
+    // the optional third argument is a program definition file
+    Logic logic(argc > 3 ? argv[3] : nullptr);
+    // the optional fourth argument persists the spray cam model
+    Automat automat(argc > 4 ? argv[4] : nullptr);
     Display display;
     StaticError staticError;
     Output output;
-    Dishwasher dishwash({&input, &logic, &automat, &display, &staticError, &output});
+    Plant plant;
+    Accounting accounting;
+    Dishwasher dishwash({&input, &logic, &automat, &display, &staticError, &output, &plant, &accounting});
+    // the optional second argument records the events into a binary journal instead of the log, - for none
+    std::unique_ptr<Journal> journal;
+    if(argc > 2 && std::string(argv[2]) != "-") {
+      journal = std::make_unique<Journal>(argv[2]);
+      if(*journal) {
+        dishwash.setJournal(*journal);
+      }
+      else {
+        Log::i(nowtech::LogApp::cSystem) << "keeping the event log" << Log::end;
+      }
+    }
+    else { // nothing to do
+    }
     dishwash.run();
   }
   catch(std::exception &e) {
@@ -4,12 +4,14 @@
 #include <algorithm>
 
 TimerManager::ClockToUse TimerManager::sClockToUse = TimerManager::ClockToUse::Invalid;
+thread_local bool TimerManager::sVirtualClock = false;
+thread_local int64_t TimerManager::sVirtualNow = 0;
 
-TimerManager::TimerManager(int32_t const aMaxLength, int32_t const aWatchdogLength) noexcept
-  : mTimers(new Timer[aMaxLength])
-  , mWatchdogLength(aWatchdogLength)
-  , mMaxLength(aMaxLength) {
-  if(sClockToUse == ClockToUse::Invalid) {
+TimerManager::TimerManager(int32_t const aInitialCapacity, int32_t const aWatchdogLength)
+  : mWatchdogLength(aWatchdogLength) {
+  mHeap.reserve(aInitialCapacity);
+  mSlots.reserve(aInitialCapacity);
+  if(sClockToUse == ClockToUse::Invalid && !sVirtualClock) {
     std::optional<int32_t> highResolutionDelay = measureShortestThreadSleep<std::chrono::high_resolution_clock>();
     std::optional<int32_t> steadyDelay = measureShortestThreadSleep<std::chrono::steady_clock>();
     sClockToUse = (highResolutionDelay && highResolutionDelay.value() < steadyDelay.value() ? ClockToUse::HighResolution : ClockToUse::Steady);
@@ -18,24 +20,19 @@ TimerManager::TimerManager(int32_t const aMaxLength, int32_t const aWatchdogLeng
   }
   mTimeDividor = cRealtime;
   mWatchdogStart = now();
+  mPlanRebase = mWatchdogStart;
 }
 
 std::optional<int64_t> TimerManager::getEarliestValidTimeoutLength() const noexcept {
   std::optional<int64_t> result;
   int64_t current = now();
-  int32_t currentIndex = mStartIndex;
-  for(int32_t i = 0; i < mLength; ++i) {
-    double expires = mTimers[currentIndex].getExpiration();
-    if(!mPaused && expires > current) {
-      result = expires - current;
-      break;
-    }
-    else { // nothing to do
-    }
-    currentIndex = mTimers[currentIndex].nextIndex;
+  if(!mPauseStart && !mHeap.empty()) {
+    result = std::max<int64_t>(mHeap.front().expiration - current, 0);
+  }
+  else { // nothing to do
   }
   int64_t watchdogTimeout = mWatchdogStart + mWatchdogLength - current;
-  if(watchdogTimeout > 0 && (!result || result < watchdogTimeout)) {
+  if(watchdogTimeout > 0 && (!result || watchdogTimeout < result.value())) {
     result = watchdogTimeout;
   }
   else { // nothing to do
@@ -43,16 +40,37 @@ std::optional<int64_t> TimerManager::getEarliestValidTimeoutLength() const noexc
   return result;
 }
 
+void TimerManager::cancelAll() noexcept {
+  for(auto const &timer : mHeap) {
+    releaseSlot(timer.slot);
+  }
+  mHeap.clear();
+}
+
+bool TimerManager::cancel(Handle const aHandle) noexcept {
+  bool result = false;
+  int32_t slot = static_cast<int32_t>(aHandle & 0xffffffffu) - 1;
+  uint32_t generation = static_cast<uint32_t>(aHandle >> cHandleGenerationShift);
+  if(slot >= 0 && slot < static_cast<int32_t>(mSlots.size()) && mSlots[slot].used && mSlots[slot].generation == generation) {
+    remove(mSlots[slot].index);
+    result = true;
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
 void TimerManager::setTimeDividor(double const aTimeDividor) noexcept {
   if(aTimeDividor >= cRealtime) {
     Log::i(nowtech::LogApp::cSystem) << "Timer factor set to " << aTimeDividor << Log::end;
+    rebasePlanTime();
     mTimeDividor = aTimeDividor;
-    std::sort(mTimers, mTimers + mLength);
-    mStartIndex = 0;
-    mEndIndex = mLength - 1;
-    for(int32_t i = 0; i < mLength; ++i) {
-      mTimers[i].prevIndex = i - 1;
-      mTimers[i].prevIndex = (i < mLength - 1 ? i + 1 : cEmptyIndex);
+    for(auto &timer : mHeap) {
+      timer.expiration = timer.start + static_cast<int64_t>(timer.length / mTimeDividor);
+    }
+    // relative order of timers started at different times may change
+    for(int32_t i = static_cast<int32_t>(mHeap.size()) / 2 - 1; i >= 0; --i) {
+      siftDown(i);
     }
   }
   else { // nothing to do
@@ -61,20 +79,36 @@ void TimerManager::setTimeDividor(double const aTimeDividor) noexcept {
 
 void TimerManager::resume() noexcept {
   if(mPauseStart) {
+    rebasePlanTime();
     int64_t shift = now() - mPauseStart.value();
     mPauseStart.reset();
-    for(int32_t i = 0; i < mLength; ++i) {
-      mTimers[i].start += shift;
+    mPlanRebase += shift;
+    // the same shift for all timers keeps the heap order
+    for(auto &timer : mHeap) {
+      timer.start += shift;
+      timer.expiration += shift;
     }
-    setTimeDividor(mTimeDividor);
   }
   else { // nothing to do
   }
 }
 
-int64_t TimerManager::now() const noexcept {
+int64_t TimerManager::getPlanTime() const noexcept {
+  int64_t wall = (mPauseStart ? mPauseStart.value() : now());
+  return mPlanBase + static_cast<int64_t>((wall - mPlanRebase) * mTimeDividor);
+}
+
+void TimerManager::rebasePlanTime() noexcept {
+  mPlanBase = getPlanTime();
+  mPlanRebase = (mPauseStart ? mPauseStart.value() : now());
+}
+
+int64_t TimerManager::now() noexcept {
   int64_t result;
-  if(sClockToUse == ClockToUse::HighResolution) {
+  if(sVirtualClock) {
+    result = sVirtualNow;
+  }
+  else if(sClockToUse == ClockToUse::HighResolution) {
     result = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
   }
   else {
@@ -87,54 +121,115 @@ void TimerManager::keepPattingWatchdog() noexcept {
   mWatchdogStart = now();
 }
 
+TimerManager::Handle TimerManager::schedule(int64_t const aLength, int32_t const aAction) {
+  int32_t slot = acquireSlot();
+  Timer timer;
+  timer.start = now();
+  timer.length = aLength;
+  timer.expiration = timer.start + static_cast<int64_t>(aLength / mTimeDividor);
+  timer.sequence = mNextSequence++;
+  timer.action = aAction;
+  timer.slot = slot;
+  mHeap.push_back(timer);
+  int32_t index = static_cast<int32_t>(mHeap.size()) - 1;
+  mSlots[slot].index = index;
+  siftUp(index);
+  return (static_cast<Handle>(mSlots[slot].generation) << cHandleGenerationShift) | static_cast<Handle>(slot + 1);
+}
+
 std::optional<int32_t> TimerManager::pop() noexcept {
   std::optional<int32_t> result;
-  if(!mPaused && mLength > 0 && now() >= mTimers[mStartIndex].getExpiration()) {
-    result = mTimers[mStartIndex].action;
-    if(mLength == 1) {
-      mStartIndex = mEndIndex = cEmptyIndex;
+  if(!mPauseStart && !mHeap.empty() && now() >= mHeap.front().expiration) {
+    result = mHeap.front().action;
+    remove(0);
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
+int32_t TimerManager::acquireSlot() {
+  int32_t result;
+  if(mFreeSlot != cEmptyIndex) {
+    result = mFreeSlot;
+    mFreeSlot = mSlots[result].index;
+  }
+  else {
+    result = static_cast<int32_t>(mSlots.size());
+    mSlots.push_back(Slot{cEmptyIndex, 0u, false});
+  }
+  mSlots[result].used = true;
+  return result;
+}
+
+void TimerManager::releaseSlot(int32_t const aSlot) noexcept {
+  mSlots[aSlot].used = false;
+  ++mSlots[aSlot].generation;
+  mSlots[aSlot].index = mFreeSlot;
+  mFreeSlot = aSlot;
+}
+
+void TimerManager::place(int32_t const aIndex, Timer const &aTimer) noexcept {
+  mHeap[aIndex] = aTimer;
+  mSlots[aTimer.slot].index = aIndex;
+}
+
+void TimerManager::siftUp(int32_t aIndex) noexcept {
+  Timer timer = mHeap[aIndex];
+  while(aIndex > 0) {
+    int32_t parent = (aIndex - 1) / 2;
+    if(timer < mHeap[parent]) {
+      place(aIndex, mHeap[parent]);
+      aIndex = parent;
     }
     else {
-      if(mStartIndex < mLength - 1) {
-        int32_t nextStart = mTimers[mStartIndex].nextIndex;
-        mTimers[mStartIndex] = mTimers[mLength - 1];
-        if(mTimers[mStartIndex].nextIndex != cEmptyIndex) {
-          mTimers[mTimers[mStartIndex].nextIndex].prevIndex = mStartIndex;
-        }
-        else { // nothing to do
-        }
-        if(mTimers[mStartIndex].prevIndex != cEmptyIndex) {
-          mTimers[mTimers[mStartIndex].prevIndex].nextIndex = mStartIndex;
-        }
-        else { // nothing to do
-        }
-        mStartIndex = nextStart;
-      }
-      else {
-        mStartIndex = mTimers[mStartIndex].nextIndex;
-      }
-      mTimers[mStartIndex].prevIndex = cEmptyIndex;
+      break;
     }
-    --mLength;
   }
-  return result;
+  place(aIndex, timer);
 }
 
-void TimerManager::schedule(Timer const &aTimer) {
-  if(mLength == mMaxLength) {
-    throw std::out_of_range("no timers left");
+void TimerManager::siftDown(int32_t aIndex) noexcept {
+  int32_t length = static_cast<int32_t>(mHeap.size());
+  Timer timer = mHeap[aIndex];
+  while(true) {
+    int32_t child = aIndex * 2 + 1;
+    if(child >= length) {
+      break;
+    }
+    else { // nothing to do
+    }
+    if(child + 1 < length && mHeap[child + 1] < mHeap[child]) {
+      ++child;
+    }
+    else { // nothing to do
+    }
+    if(mHeap[child] < timer) {
+      place(aIndex, mHeap[child]);
+      aIndex = child;
+    }
+    else {
+      break;
+    }
   }
-  else {
-    mTimers[mLength] = aTimer;
-    mTimers[mLength].manager = this;
-    if(mLength == 0) {
-      mStartIndex = mEndIndex = 0;
+  place(aIndex, timer);
+}
+
+void TimerManager::remove(int32_t const aIndex) noexcept {
+  releaseSlot(mHeap[aIndex].slot);
+  int32_t last = static_cast<int32_t>(mHeap.size()) - 1;
+  if(aIndex < last) {
+    bool goesUp = mHeap[last] < mHeap[aIndex];
+    place(aIndex, mHeap[last]);
+    mHeap.pop_back();
+    if(goesUp) {
+      siftUp(aIndex);
     }
     else {
-      mTimers[mEndIndex].nextIndex = mLength;
-      mTimers[mLength].prevIndex = mEndIndex;
-      mEndIndex = mLength;
+      siftDown(aIndex);
     }
-    ++mLength;
+  }
+  else {
+    mHeap.pop_back();
   }
 }
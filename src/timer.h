@@ -2,14 +2,25 @@
 #define DISHWASHER_TIMER_INCLUDED
 
 #include "bancopymove.h"
-#include <array>
+#include <vector>
 #include <thread>
 #include <chrono>
 #include <optional>
 
 /// Class to manage action delays and changing realtime execution by dividing the delay length with a custom dividor.
 /// The constructor will choose the most precise steady clock to use.
+/// Timers are kept in a binary min-heap keyed by expiration, so schedule, cancel and pop are O(log n).
+/// The heap grows on demand, the constructor argument is only the initially reserved capacity.
+/// A thread may switch to a virtual clock for simulation. Then now() returns a value set by the simulator,
+/// which jumps from one expiration to the next without waiting.
 class TimerManager final : public BanCopyMove  {
+public:
+  /// Identifies a scheduled timer for cancellation. Becomes stale when the timer expires or gets cancelled.
+  typedef uint64_t Handle;
+
+  static constexpr Handle  cInvalidHandle                       =  0u;
+
+private:
   enum class ClockToUse : int32_t {
     Invalid        = -1,
     HighResolution =  0,
@@ -22,77 +33,105 @@ class TimerManager final : public BanCopyMove  {
   static constexpr double  cMeasureShortestThreadSleepExcess    =  1.05; // At most 5% error
   static constexpr int32_t cMeasureShortestThreadSleepRepeats   = 20;
   static constexpr int32_t cMeasureShortestThreadSleepMaxMillis = 50; // Must work for 50 ms
+  static constexpr int32_t cHandleGenerationShift               = 32;
 
   struct Timer final {
-    int64_t start;  /// us
-    int64_t length; /// us, realtime without dividing
-    int32_t action;
-    TimerManager *manager;
-
-    /// cEmptyIndex for beginning
-    int32_t prevIndex;
-
-    /// cEmptyIndex for final
-    int32_t nextIndex;
-
-    Timer() : prevIndex(cEmptyIndex), nextIndex(cEmptyIndex) {
-    }
-
-    Timer(int64_t const aStart, int64_t const aLength, int32_t aAction) : start(aStart), length(aLength), action(aAction), prevIndex(cEmptyIndex), nextIndex(cEmptyIndex) {
-    }
-
-    double getExpiration() const noexcept {
-      return start + length / manager->mTimeDividor;
+    int64_t  start;      /// us
+    int64_t  length;     /// us, realtime without dividing
+    int64_t  expiration; /// us, start + length / mTimeDividor
+    uint64_t sequence;   /// breaks ties between equal expirations in scheduling order
+    int32_t  action;
+    int32_t  slot;       /// index in mSlots
+
+    bool operator<(Timer const &aOther) const noexcept {
+      return expiration < aOther.expiration || (expiration == aOther.expiration && sequence < aOther.sequence);
     }
+  };
 
-    bool operator<(Timer const &other) const noexcept {
-      return getExpiration() < other.getExpiration();
-    }
-  } *mTimers;
+  /// Stable place of a timer for handles, since heap positions move.
+  struct Slot final {
+    /// Position in mHeap, or the next free slot when unused.
+    int32_t  index;
+    /// Incremented on each release to make old handles stale.
+    uint32_t generation;
+    bool     used;
+  };
 
   static ClockToUse sClockToUse;
 
+  /// True if this thread runs a simulation.
+  static thread_local bool    sVirtualClock;
+  static thread_local int64_t sVirtualNow;
+
   int64_t mWatchdogStart;
   int64_t mWatchdogLength;
 
   /// Can be anything from 1 up
   double mTimeDividor;
 
-  /// True if only watchdog events are considered
-  bool    mPaused     = false;
-
+  /// Valid while paused, when only watchdog events are considered
   std::optional<int64_t> mPauseStart;
 
-  /// cEmptyIndex if the list is empty
-  int32_t mStartIndex = cEmptyIndex;
+  /// getPlanTime() was mPlanBase at mPlanRebase.
+  int64_t mPlanBase = 0;
+  int64_t mPlanRebase;
 
-  /// cEmptyIndex if the list is empty
-  int32_t mEndIndex   = cEmptyIndex;
-  int32_t mLength     = 0;
-  int32_t mMaxLength  = 0;
+  std::vector<Timer> mHeap;
+  std::vector<Slot>  mSlots;
 
-  int32_t getLength() const noexcept {
-    return mLength;
-  }
+  /// cEmptyIndex if there is no released slot
+  int32_t  mFreeSlot = cEmptyIndex;
+  uint64_t mNextSequence = 0u;
 
 public:
-  TimerManager(int32_t const aMaxLength, int32_t const aWatchdogLength) noexcept;
+  /// @param aInitialCapacity timer count to reserve space for
+  /// @param aWatchdogLength watchdog patting interval in us
+  TimerManager(int32_t const aInitialCapacity, int32_t const aWatchdogLength);
+
+  operator bool() const noexcept {
+    return mHeap.capacity() > 0u && mSlots.capacity() > 0u;
+  }
 
-  ~TimerManager() noexcept {
-    delete[] mTimers;
+  /// Switches the calling thread to the virtual clock. Should be called before constructing
+  /// the components, so the clock measurement is also skipped.
+  /// @param aStart initial value of now() in us
+  static void useVirtualClock(int64_t const aStart) noexcept {
+    sVirtualClock = true;
+    sVirtualNow = aStart;
   }
 
-  operator bool() const noexcept {
-    return mTimers != nullptr;
+  static bool isVirtualClock() noexcept {
+    return sVirtualClock;
+  }
+
+  /// Moves the virtual clock forward. Values in the past are ignored.
+  static void advanceVirtualClock(int64_t const aNow) noexcept {
+    if(aNow > sVirtualNow) {
+      sVirtualNow = aNow;
+    }
+    else { // nothing to do
+    }
   }
 
   std::optional<int64_t> getEarliestValidTimeoutLength() const noexcept;
 
-  void cancelAll() noexcept {
-    mStartIndex = mEndIndex = cEmptyIndex;
-    mLength = 0;
+  /// Returns the absolute expiration time of the first timer in us, if any. Empty while paused.
+  std::optional<int64_t> getEarliestExpiration() const noexcept {
+    std::optional<int64_t> result;
+    if(!mPauseStart && !mHeap.empty()) {
+      result = mHeap.front().expiration;
+    }
+    else { // nothing to do
+    }
+    return result;
   }
 
+  void cancelAll() noexcept;
+
+  /// Cancels the timer if it is still pending.
+  /// @return true if the timer was found and removed
+  bool cancel(Handle const aHandle) noexcept;
+
   void setTimeDividor(double const aTimeDividor) noexcept;
 
   void pause() noexcept {
@@ -105,24 +144,35 @@ public:
 
   void resume() noexcept;
 
-  int64_t now() const noexcept;
+  static int64_t now() noexcept;
+
+  /// Time in us as the timers see it: multiplied by the time dividor and stopped while paused,
+  /// so it can be compared to the planned timer lengths.
+  int64_t getPlanTime() const noexcept;
 
   void keepPattingWatchdog() noexcept;
 
   /// Creates an action timer from now on
   /// @param aLength planned delay in us
   /// @param aAction action as int to delay
-  void schedule(int64_t const aLength, int32_t const aAction) {
-    schedule(Timer(now(), aLength, aAction));
-  }
+  /// @return handle to cancel the timer
+  Handle schedule(int64_t const aLength, int32_t const aAction);
 
-  /// May only be called if the actual timer expired, so there is something to return.
   /// Pops the first event only if it is expired regarding now(). Otherwise the return optional is empty.
-  /// cPatWatchdog return value means watchdog timer expiration.
   std::optional<int32_t> pop() noexcept;
 
 private:
-  void schedule(Timer const &aTimer);
+  int32_t acquireSlot();
+  void releaseSlot(int32_t const aSlot) noexcept;
+  void place(int32_t const aIndex, Timer const &aTimer) noexcept;
+  void siftUp(int32_t aIndex) noexcept;
+  void siftDown(int32_t aIndex) noexcept;
+
+  /// Removes the timer at the given heap position.
+  void remove(int32_t const aIndex) noexcept;
+
+  /// Moves the plan time reference to now, before the dividor or the pause state changes.
+  void rebasePlanTime() noexcept;
 
   template <typename Chrono>
   std::optional<int32_t> measureShortestThreadSleep() noexcept {
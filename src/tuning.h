@@ -0,0 +1,24 @@
+#ifndef DISHWASHER_TUNING_INCLUDED
+#define DISHWASHER_TUNING_INCLUDED
+
+#include "dishwash-config.h"
+
+/** Timing parameters of Logic and Automat which may be changed without recompiling,
+ * like for the simulated runs of a parameter sweep. The defaults come from Config.
+ * All times are in us. */
+class Tuning final {
+public:
+  int32_t sleepBeforeNextStep     = Config::cSleepBeforeNextStep;
+  int32_t resinWashTime           = Config::cResinWashTime;
+  int32_t washDetergentOpenTime   = Config::cWashDetergentOpenTime;
+  int32_t regenerateValveTime     = Config::cRegenerateValveTime;
+  int32_t sprayChangeKeepPosition = Config::cSprayChangeKeepPosition;
+  int32_t heaterPwmPeriod         = Config::cHeaterPwmPeriod;
+
+  bool isValid() const noexcept {
+    return sleepBeforeNextStep >= 0 && resinWashTime > 0 && washDetergentOpenTime > 0 && regenerateValveTime > 0 && sprayChangeKeepPosition > 0
+        && heaterPwmPeriod >= 0;
+  }
+};
+
+#endif // DISHWASHER_TUNING_INCLUDED
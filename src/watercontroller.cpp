@@ -0,0 +1,133 @@
+#include "watercontroller.h"
+#include <algorithm>
+
+using namespace std;
+
+WaterController::Flow WaterController::start(int32_t const aTarget, int32_t const aLevel, int64_t const aNow) noexcept {
+  mTarget = aTarget;
+  mLevel = aLevel;
+  mClosed = cNever;
+  if(mLevel < mTarget) {
+    startFlow(Flow::Fill, aNow);
+  }
+  else if(mLevel > mTarget + Config::cWaterLevelHisteresis) {
+    startFlow(Flow::Drain, aNow);
+  }
+  else {
+    mFlow = Flow::None;
+  }
+  return mFlow;
+}
+
+WaterController::Flow WaterController::measure(int32_t const aLevel, int64_t const aNow) noexcept {
+  mLevel = aLevel;
+  checkRate(aNow);
+  checkTarget(aNow);
+  checkLag(aNow);
+  return mFlow;
+}
+
+void WaterController::startFlow(Flow const aFlow, int64_t const aNow) noexcept {
+  mFlow = aFlow;
+  mFlowStarted = aNow;
+  mWindowStart = cNever;
+  mEmptySince = cNever;
+}
+
+void WaterController::checkRate(int64_t const aNow) noexcept {
+  if(mFlow == Flow::None || mEmptySince != cNever) {
+    // nothing to do
+  }
+  else if(mWindowStart == cNever) {
+    if(aNow - mFlowStarted >= cFlowStartTime) {
+      mWindowStart = aNow;
+      mWindowLevel = mLevel;
+    }
+    else { // nothing to do
+    }
+  }
+  else if(aNow - mWindowStart >= cCheckTime) {
+    bool fill = (mFlow == Flow::Fill);
+    int32_t change = (fill ? mLevel - mWindowLevel : mWindowLevel - mLevel);
+    double elapsed = (aNow - mWindowStart) / cUsInSecond;
+    double &rate = (fill ? mFillRate : mDrainRate);
+    // the sump may level off anywhere in the hysteresis band when empty
+    int32_t drainable = std::max(mWindowLevel - Config::cWaterLevelHisteresis, 0);
+    double expected = (fill ? rate * elapsed : std::min(rate * elapsed, static_cast<double>(drainable)));
+    if(!fill && drainable == 0) {
+      // nothing to do, the sump was empty for the sensor already
+    }
+    else if(change < cMinRateRatio * expected) {
+      mError = (fill ? Error::NoWater : Error::NoDrain);
+    }
+    else if(fill && change > cMaxRateRatio * expected) {
+      mError = Error::OverFill;
+    }
+    else if(change >= cMinRateChange && (fill || mLevel > Config::cWaterLevelHisteresis)) {
+      rate += cWeight * (change / elapsed - rate);
+    }
+    else { // nothing to do
+    }
+    mWindowStart = aNow;
+    mWindowLevel = mLevel;
+  }
+  else { // nothing to do
+  }
+}
+
+void WaterController::checkTarget(int64_t const aNow) noexcept {
+  if(mFlow == Flow::Fill) {
+    if(mLevel + mFillRate * mLag >= mTarget) {
+      mFlow = Flow::None;
+      mClosedLevel = mLevel;
+      mPeak = mLevel;
+      mClosed = aNow;
+    }
+    else { // nothing to do
+    }
+  }
+  else if(mFlow == Flow::Drain) {
+    if(mTarget > 0) {
+      // the pump stops at once
+      if(mLevel <= mTarget) {
+        mFlow = Flow::None;
+      }
+      else { // nothing to do
+      }
+    }
+    else if(mLevel > Config::cWaterLevelHisteresis) {
+      mEmptySince = cNever;
+    }
+    else if(mEmptySince == cNever) {
+      mEmptySince = aNow;
+    }
+    else if(aNow - mEmptySince >= cDrainAfterRun) {
+      mFlow = Flow::None;
+    }
+    else { // nothing to do
+    }
+  }
+  else { // nothing to do
+  }
+}
+
+void WaterController::checkLag(int64_t const aNow) noexcept {
+  if(mClosed != cNever) {
+    mPeak = std::max(mPeak, mLevel);
+    if(aNow - mClosed >= cLagMeasureTime) {
+      double lag = std::min((mPeak - mClosedLevel) / mFillRate, cMaxLag);
+      mLag += cWeight * (lag - mLag);
+      mClosed = cNever;
+      if(mLevel < mTarget) {
+        // closed too early, the lag is shorter by now
+        startFlow(Flow::Fill, aNow);
+      }
+      else { // nothing to do
+      }
+    }
+    else { // nothing to do
+    }
+  }
+  else { // nothing to do
+  }
+}
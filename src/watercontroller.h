@@ -0,0 +1,111 @@
+#ifndef DISHWASHER_WATERCONTROLLER_INCLUDED
+#define DISHWASHER_WATERCONTROLLER_INCLUDED
+
+#include "base.h"
+
+/** Water level control for Automat. Learns the fill and drain rates from the level samples and
+ * the lag of the level behind the closing fill valve, and closes the valve early so that the level
+ * stops at the target. The flow is checked against the learnt rates in windows: too slow flow raises
+ * NoWater or NoDrain, too fast filling OverFill. Like in Logic, a level within Config::cWaterLevelHisteresis
+ * counts as empty. The times are plan times in us, see TimerManager::getPlanTime. */
+class WaterController final {
+public:
+  enum class Flow : int32_t {
+    None, Fill, Drain
+  };
+
+private:
+  static constexpr double  cUsInSecond       = 1000000.0;
+  static constexpr double  cDefaultFillRate  = static_cast<double>(Config::cFillFlowRate) / Config::cWaterPerLevel;  // mm/s
+  static constexpr double  cDefaultDrainRate = static_cast<double>(Config::cDrainFlowRate) / Config::cWaterPerLevel; // mm/s
+  static constexpr double  cDefaultLag       = 0.5;      // s
+  static constexpr double  cMaxLag           = 5.0;      // s
+  /// The flow needs time to start, and the sump level to settle after the circulation.
+  static constexpr int64_t cFlowStartTime    = 5000000;  // us
+  /// Length of a window checking the flow.
+  static constexpr int64_t cCheckTime        = 10000000; // us
+  /// Smaller changes give too noisy rate measurements.
+  static constexpr int32_t cMinRateChange    = 5;        // mm
+  /// EWMA weight of a new measurement.
+  static constexpr double  cWeight           = 0.3;
+  /// Allowed measured rate relative to the learnt one.
+  static constexpr double  cMinRateRatio     = 0.3;
+  static constexpr double  cMaxRateRatio     = 3.0;
+  /// The sensor shows an empty sump before the last water is out.
+  static constexpr int64_t cDrainAfterRun    = 5000000;  // us
+  /// The level is watched this long after closing the fill valve to learn the lag.
+  static constexpr int64_t cLagMeasureTime   = 3000000;  // us
+  static constexpr int64_t cNever            = -1;
+
+  Flow    mFlow          = Flow::None;
+  int32_t mTarget        = 0;
+  int32_t mLevel         = 0;
+  Error   mError         = Error::None;
+  int64_t mFlowStarted   = cNever;
+
+  /// mm/s
+  double  mFillRate      = cDefaultFillRate;
+  double  mDrainRate     = cDefaultDrainRate;
+  /// s, the rise after closing the fill valve divided by the fill rate.
+  double  mLag           = cDefaultLag;
+
+  /// Start of the current check window.
+  int32_t mWindowLevel   = 0;
+  int64_t mWindowStart   = cNever;
+
+  int64_t mEmptySince    = cNever;
+
+  /// Lag measurement after closing the fill valve.
+  int32_t mClosedLevel   = 0;
+  int32_t mPeak          = 0;
+  int64_t mClosed        = cNever;
+
+public:
+  /// Starts filling or draining towards aTarget.
+  /// @param aLevel the current level, measure() may not have seen the latest ones.
+  /// @return the flow needed now.
+  Flow start(int32_t const aTarget, int32_t const aLevel, int64_t const aNow) noexcept;
+
+  /// @return the flow needed now.
+  Flow measure(int32_t const aLevel, int64_t const aNow) noexcept;
+
+  /// Abandons the target, the circulation takes the water out of the sump.
+  void stop() noexcept {
+    mFlow = Flow::None;
+    mClosed = cNever;
+  }
+
+  /// Error::None while the flow follows the model.
+  Error getError() const noexcept {
+    return mError;
+  }
+
+  /// mm/s
+  double getFillRate() const noexcept {
+    return mFillRate;
+  }
+
+  /// mm/s
+  double getDrainRate() const noexcept {
+    return mDrainRate;
+  }
+
+  /// s
+  double getLag() const noexcept {
+    return mLag;
+  }
+
+private:
+  void startFlow(Flow const aFlow, int64_t const aNow) noexcept;
+
+  /// Checks and learns the rate at the end of each window.
+  void checkRate(int64_t const aNow) noexcept;
+
+  /// Closes the valves when the target is reached or predicted to be reached.
+  void checkTarget(int64_t const aNow) noexcept;
+
+  /// Learns the lag after closing the fill valve, and tops up if the level stopped short.
+  void checkLag(int64_t const aNow) noexcept;
+};
+
+#endif // DISHWASHER_WATERCONTROLLER_INCLUDED